@@ -1,6 +1,20 @@
 #include "Camera.h"
 
-cyMatrix4f Camera::GetCameraTransform()
+Camera::Camera()
 {
-    return cyMatrix4f::View(Position.XYZ(), (Position + Forward).XYZ(), Up.XYZ());
+    TransformValid = false;
+}
+
+const cyMatrix4f& Camera::GetCameraTransform()
+{
+    //cyVec4f's operator!= needs every component to differ, and w always matches, so changes are found with operator==
+    if (!TransformValid || !(TransformPosition == Position) || !(TransformForward == Forward) || !(TransformUp == Up))
+    {
+        Transform = cyMatrix4f::View(Position.XYZ(), (Position + Forward).XYZ(), Up.XYZ());
+        TransformPosition = Position;
+        TransformForward = Forward;
+        TransformUp = Up;
+        TransformValid = true;
+    }
+    return Transform;
 }
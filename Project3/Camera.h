@@ -3,10 +3,20 @@
 class Camera
 {
 public:
+	Camera();
+
 	cyVec4f Position;
 	cyVec4f Forward;
 	cyVec4f Up;
 
-	cyMatrix4f GetCameraTransform();
+	//Cached until Position, Forward or Up change.
+	const cyMatrix4f& GetCameraTransform();
+
+private:
+	cyMatrix4f Transform;
+	cyVec4f TransformPosition;
+	cyVec4f TransformForward;
+	cyVec4f TransformUp;
+	bool TransformValid;
 };
 
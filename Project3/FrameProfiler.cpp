@@ -0,0 +1,188 @@
+#include "FrameProfiler.h"
+
+FrameProfiler::FrameProfiler()
+{
+	for (int i = 0; i < FRAME_PROFILER_QUERY_FRAMES; i++)
+	{
+		QueryFrames[i].UsedPairs = 0;
+		QueryFrames[i].Pending = false;
+	}
+	CurrentQueryFrame = 0;
+	DroppedGpuFrames = 0;
+	GpuTimers = GLEW_VERSION_3_3 || GLEW_ARB_timer_query;
+	InFrame = false;
+	if (!GpuTimers)
+	{
+		fprintf(stderr, "Timer queries need OpenGL 3.3, profiling CPU scopes only\n");
+	}
+}
+
+FrameProfiler::~FrameProfiler()
+{
+	for (int i = 0; i < FRAME_PROFILER_QUERY_FRAMES; i++)
+	{
+		std::vector<GLuint>& queries = QueryFrames[i].Queries;
+		if (!queries.empty())
+		{
+			glDeleteQueries((GLsizei)queries.size(), queries.data());
+		}
+	}
+}
+
+void FrameProfiler::BeginFrame()
+{
+	QueryFrame& frame = QueryFrames[CurrentQueryFrame];
+	if (frame.Pending)
+	{
+		CollectGpuTimes(frame);
+	}
+	frame.UsedPairs = 0;
+	frame.Scopes.clear();
+	frame.Pending = false;
+	InFrame = true;
+}
+
+void FrameProfiler::EndFrame()
+{
+	QueryFrames[CurrentQueryFrame].Pending = QueryFrames[CurrentQueryFrame].UsedPairs > 0;
+	CurrentQueryFrame = (CurrentQueryFrame + 1) % FRAME_PROFILER_QUERY_FRAMES;
+	InFrame = false;
+}
+
+void FrameProfiler::CollectGpuTimes(QueryFrame& frame)
+{
+	//Timestamps complete in order, so the last one being ready means all of them are
+	GLint available = 0;
+	glGetQueryObjectiv(frame.Queries[frame.UsedPairs * 2 - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+	if (!available)
+	{
+		DroppedGpuFrames++;
+		return;
+	}
+	for (unsigned int pair = 0; pair < frame.UsedPairs; pair++)
+	{
+		GLuint64 start = 0, end = 0;
+		glGetQueryObjectui64v(frame.Queries[pair * 2], GL_QUERY_RESULT, &start);
+		glGetQueryObjectui64v(frame.Queries[pair * 2 + 1], GL_QUERY_RESULT, &end);
+		Scopes[frame.Scopes[pair]].Gpu.Record((end - start) * 1.0e-9);
+	}
+}
+
+int FrameProfiler::FindScope(const char* name)
+{
+	for (size_t i = 0; i < Scopes.size(); i++)
+	{
+		if (Scopes[i].Name == name)
+		{
+			return (int)i;
+		}
+	}
+	Scopes.push_back(ScopeStats());
+	Scopes.back().Name = name;
+	return (int)Scopes.size() - 1;
+}
+
+void FrameProfiler::BeginScope(const char* name, int kinds)
+{
+	OpenScopes.push_back(OpenScope());
+	OpenScope& open = OpenScopes.back();
+	open.Scope = FindScope(name);
+	open.Kinds = kinds;
+	open.QueryPair = -1;
+
+	//GPU times are only collected per frame; scopes outside one, such as at startup, measure the CPU side
+	if ((kinds & PROFILE_GPU) && GpuTimers && InFrame)
+	{
+		QueryFrame& frame = QueryFrames[CurrentQueryFrame];
+		if (frame.UsedPairs * 2 == frame.Queries.size())
+		{
+			size_t first = frame.Queries.size();
+			frame.Queries.resize(first + 16);
+			glGenQueries(16, &frame.Queries[first]);
+		}
+		open.QueryPair = (int)frame.UsedPairs++;
+		frame.Scopes.push_back(open.Scope);
+		glQueryCounter(frame.Queries[open.QueryPair * 2], GL_TIMESTAMP);
+	}
+	open.WallTimer.Start();
+	open.CpuTimer.Start();
+}
+
+void FrameProfiler::EndScope()
+{
+	OpenScope& open = OpenScopes.back();
+	ScopeStats& scope = Scopes[open.Scope];
+	if (open.Kinds & PROFILE_CPU)
+	{
+		scope.Wall.Record(open.WallTimer.Stop());
+		scope.Cpu.Record(open.CpuTimer.Stop());
+	}
+	if (open.QueryPair >= 0)
+	{
+		glQueryCounter(QueryFrames[CurrentQueryFrame].Queries[open.QueryPair * 2 + 1], GL_TIMESTAMP);
+	}
+	OpenScopes.pop_back();
+}
+
+//Average, min, max and standard deviation in milliseconds; false if nothing was recorded.
+static bool statsInMilliseconds(const cy::TimerStats& stats, double values[4])
+{
+	if (stats.GetRecordCount() == 0)
+	{
+		return false;
+	}
+	values[0] = stats.GetAverage() * 1000.0;
+	values[1] = stats.GetMin() * 1000.0;
+	values[2] = stats.GetMax() * 1000.0;
+	values[3] = stats.GetStdev() * 1000.0;
+	return true;
+}
+
+void FrameProfiler::Dump(FILE* file) const
+{
+	fprintf(file, "%-20s %-5s %8s %8s %8s %8s\n", "Scope (ms)", "", "avg", "min", "max", "stdev");
+	for (const ScopeStats& scope : Scopes)
+	{
+		const cy::TimerStats* stats[3] = { &scope.Wall, &scope.Cpu, &scope.Gpu };
+		const char* labels[3] = { "wall", "cpu", "gpu" };
+		for (int i = 0; i < 3; i++)
+		{
+			double values[4];
+			if (statsInMilliseconds(*stats[i], values))
+			{
+				fprintf(file, "%-20s %-5s %8.3f %8.3f %8.3f %8.3f\n", scope.Name.c_str(), labels[i], values[0], values[1], values[2], values[3]);
+			}
+		}
+	}
+	if (DroppedGpuFrames > 0)
+	{
+		fprintf(file, "%u frames of GPU times were dropped because the GPU had not finished them in time\n", DroppedGpuFrames);
+	}
+}
+
+bool FrameProfiler::WriteCsv(const char* filename) const
+{
+	FILE* file = fopen(filename, "w");
+	if (!file)
+	{
+		fprintf(stderr, "Could not write profile to %s\n", filename);
+		return false;
+	}
+	fprintf(file, "scope,clock,samples,avg_ms,min_ms,max_ms,stdev_ms\n");
+	for (const ScopeStats& scope : Scopes)
+	{
+		const cy::TimerStats* stats[3] = { &scope.Wall, &scope.Cpu, &scope.Gpu };
+		const char* labels[3] = { "wall", "cpu", "gpu" };
+		for (int i = 0; i < 3; i++)
+		{
+			double values[4];
+			if (statsInMilliseconds(*stats[i], values))
+			{
+				fprintf(file, "\"%s\",%s,%u,%.4f,%.4f,%.4f,%.4f\n", scope.Name.c_str(), labels[i], (unsigned int)stats[i]->GetRecordCount(),
+					values[0], values[1], values[2], values[3]);
+			}
+		}
+	}
+	fclose(file);
+	return true;
+}
@@ -0,0 +1,102 @@
+#pragma once
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include "GL/glew.h"
+#include "cyTimer.h"
+
+//Frames whose GPU timestamps can be in flight at once. A frame's queries are read back when its set comes around again.
+#define FRAME_PROFILER_QUERY_FRAMES 2
+
+//What a scope measures.
+#define PROFILE_CPU 1
+#define PROFILE_GPU 2
+#define PROFILE_CPU_GPU (PROFILE_CPU | PROFILE_GPU)
+
+//Named per frame scopes, each keeping cy::TimerStats of its last 128 measurements. CPU scopes record both wall time
+//and process time from cy::TimerCPU. GPU scopes bracket their commands with GL_TIMESTAMP queries, which unlike
+//GL_TIME_ELAPSED may nest; results are read back FRAME_PROFILER_QUERY_FRAMES frames later, and only if the GPU already
+//has them, so profiling never waits on the GPU. Frames whose results are not ready yet are dropped and counted.
+class FrameProfiler
+{
+public:
+	FrameProfiler();
+	~FrameProfiler();
+
+	//Collects the GPU times of the frame that last used this frame's query set.
+	void BeginFrame();
+	void EndFrame();
+
+	//Scopes must end in the reverse order they began; ProfileScope takes care of that.
+	void BeginScope(const char* name, int kinds);
+	void EndScope();
+
+	//A table of every scope's average, min, max and standard deviation in milliseconds.
+	void Dump(FILE* file) const;
+	bool WriteCsv(const char* filename) const;
+
+	bool HasGpuTimers() const { return GpuTimers; }
+	unsigned int GetDroppedGpuFrames() const { return DroppedGpuFrames; }
+
+private:
+	struct ScopeStats
+	{
+		std::string Name;
+		cy::TimerStats Wall; //seconds, as all TimerStats here
+		cy::TimerStats Cpu;
+		cy::TimerStats Gpu;
+	};
+
+	struct OpenScope
+	{
+		int Scope;
+		int Kinds;
+		int QueryPair; //-1 without a GPU measurement
+		cy::Timer WallTimer;
+		cy::TimerCPU CpuTimer;
+	};
+
+	//Timestamp pairs issued during one frame, and the scope each pair belongs to.
+	struct QueryFrame
+	{
+		std::vector<GLuint> Queries;
+		std::vector<int> Scopes;
+		unsigned int UsedPairs;
+		bool Pending;
+	};
+
+	int FindScope(const char* name);
+	void CollectGpuTimes(QueryFrame& frame);
+
+	std::vector<ScopeStats> Scopes;
+	std::vector<OpenScope> OpenScopes;
+	QueryFrame QueryFrames[FRAME_PROFILER_QUERY_FRAMES];
+	unsigned int CurrentQueryFrame;
+	unsigned int DroppedGpuFrames;
+	bool GpuTimers;
+	bool InFrame;
+};
+
+//Measures the enclosing block as a scope of profiler; does nothing if profiler is NULL.
+class ProfileScope
+{
+public:
+	ProfileScope(FrameProfiler* profiler, const char* name, int kinds = PROFILE_CPU) : Profiler(profiler)
+	{
+		if (Profiler)
+		{
+			Profiler->BeginScope(name, kinds);
+		}
+	}
+	~ProfileScope()
+	{
+		if (Profiler)
+		{
+			Profiler->EndScope();
+		}
+	}
+
+private:
+	FrameProfiler* Profiler;
+};
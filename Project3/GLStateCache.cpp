@@ -0,0 +1,135 @@
+#include "GLStateCache.h"
+
+#include <string.h>
+
+GLuint GLStateCache::Program;
+GLuint GLStateCache::VertexArray;
+GLuint GLStateCache::ActiveTextureUnit;
+GLuint GLStateCache::Textures[GL_STATE_CACHE_TEXTURE_UNITS];
+GLenum GLStateCache::TextureTargets[GL_STATE_CACHE_TEXTURE_UNITS];
+GLStateCache::BufferBinding GLStateCache::UniformBuffers[GL_STATE_CACHE_BUFFER_BINDINGS];
+GLStateCache::BufferBinding GLStateCache::StorageBuffers[GL_STATE_CACHE_BUFFER_BINDINGS];
+bool GLStateCache::Valid = false;
+GLStateCounters GLStateCache::Counters;
+GLStateCounters GLStateCache::LastFrameCounters;
+
+void GLStateCache::Invalidate()
+{
+	Valid = false;
+}
+
+void GLStateCache::Forget()
+{
+	//All ones is a name GL never hands out, so the next bind of anything misses
+	Program = (GLuint)-1;
+	VertexArray = (GLuint)-1;
+	ActiveTextureUnit = (GLuint)-1;
+	memset(Textures, 0xFF, sizeof(Textures));
+	memset(TextureTargets, 0xFF, sizeof(TextureTargets));
+	memset(UniformBuffers, 0xFF, sizeof(UniformBuffers));
+	memset(StorageBuffers, 0xFF, sizeof(StorageBuffers));
+	Valid = true;
+}
+
+void GLStateCache::UseProgram(GLuint program)
+{
+	if (!Valid)
+	{
+		Forget();
+	}
+	if (Program == program)
+	{
+		Counters.ProgramBindsSkipped++;
+		return;
+	}
+	Program = program;
+	glUseProgram(program);
+	Counters.ProgramBinds++;
+}
+
+void GLStateCache::BindVertexArray(GLuint vertexArray)
+{
+	if (!Valid)
+	{
+		Forget();
+	}
+	if (VertexArray == vertexArray)
+	{
+		Counters.VertexArrayBindsSkipped++;
+		return;
+	}
+	VertexArray = vertexArray;
+	glBindVertexArray(vertexArray);
+	Counters.VertexArrayBinds++;
+}
+
+void GLStateCache::BindTexture(GLuint unit, GLenum target, GLuint texture)
+{
+	if (!Valid)
+	{
+		Forget();
+	}
+	if (unit < GL_STATE_CACHE_TEXTURE_UNITS && Textures[unit] == texture && TextureTargets[unit] == target)
+	{
+		Counters.TextureBindsSkipped++;
+		return;
+	}
+	if (ActiveTextureUnit != unit)
+	{
+		glActiveTexture(GL_TEXTURE0 + unit);
+		ActiveTextureUnit = unit;
+	}
+	glBindTexture(target, texture);
+	if (unit < GL_STATE_CACHE_TEXTURE_UNITS)
+	{
+		Textures[unit] = texture;
+		TextureTargets[unit] = target;
+	}
+	Counters.TextureBinds++;
+}
+
+bool GLStateCache::BindBuffer(BufferBinding* bindings, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size)
+{
+	if (!Valid)
+	{
+		Forget();
+	}
+	if (index >= GL_STATE_CACHE_BUFFER_BINDINGS)
+	{
+		Counters.BufferBinds++;
+		return true;
+	}
+	BufferBinding& binding = bindings[index];
+	if (binding.Buffer == buffer && binding.Offset == offset && binding.Size == size)
+	{
+		Counters.BufferBindsSkipped++;
+		return false;
+	}
+	binding.Buffer = buffer;
+	binding.Offset = offset;
+	binding.Size = size;
+	Counters.BufferBinds++;
+	return true;
+}
+
+void GLStateCache::BindBufferRange(GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size)
+{
+	if (BindBuffer(target == GL_UNIFORM_BUFFER ? UniformBuffers : StorageBuffers, index, buffer, offset, size))
+	{
+		glBindBufferRange(target, index, buffer, offset, size);
+	}
+}
+
+void GLStateCache::BindBufferBase(GLenum target, GLuint index, GLuint buffer)
+{
+	if (BindBuffer(target == GL_UNIFORM_BUFFER ? UniformBuffers : StorageBuffers, index, buffer, 0, -1))
+	{
+		glBindBufferBase(target, index, buffer);
+	}
+}
+
+void GLStateCache::EndFrame()
+{
+	LastFrameCounters = Counters;
+	Counters = GLStateCounters();
+}
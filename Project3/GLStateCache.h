@@ -0,0 +1,65 @@
+#pragma once
+
+#include "GL/glew.h"
+
+//Texture units and indexed buffer binding points the cache tracks; binds beyond these always reach GL.
+#define GL_STATE_CACHE_TEXTURE_UNITS 16
+#define GL_STATE_CACHE_BUFFER_BINDINGS 16
+
+//Binds issued to GL and binds skipped because the state was already set.
+struct GLStateCounters
+{
+	unsigned int ProgramBinds;
+	unsigned int ProgramBindsSkipped;
+	unsigned int VertexArrayBinds;
+	unsigned int VertexArrayBindsSkipped;
+	unsigned int TextureBinds;
+	unsigned int TextureBindsSkipped;
+	unsigned int BufferBinds; //indexed uniform and storage buffer bindings
+	unsigned int BufferBindsSkipped;
+};
+
+//Shadow copy of the GL bindings that change per draw. The context is process wide, so the cache is too; code that
+//binds these objects behind its back has to call Invalidate.
+class GLStateCache
+{
+public:
+	static void UseProgram(GLuint program);
+	static void BindVertexArray(GLuint vertexArray);
+	static void BindTexture(GLuint unit, GLenum target, GLuint texture);
+
+	//target is GL_UNIFORM_BUFFER or GL_SHADER_STORAGE_BUFFER.
+	static void BindBufferRange(GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size);
+	static void BindBufferBase(GLenum target, GLuint index, GLuint buffer);
+
+	//Forgets every cached binding, so the next bind of each goes to GL.
+	static void Invalidate();
+
+	//Counts since the last EndFrame, and the totals of the frame before it.
+	static const GLStateCounters& GetCounters() { return Counters; }
+	static const GLStateCounters& GetLastFrameCounters() { return LastFrameCounters; }
+	static void EndFrame();
+
+private:
+	struct BufferBinding
+	{
+		GLuint Buffer;
+		GLintptr Offset;
+		GLsizeiptr Size; //-1 for a whole buffer bind
+	};
+
+	static void Forget();
+	static bool BindBuffer(BufferBinding* bindings, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size);
+
+	static GLuint Program;
+	static GLuint VertexArray;
+	static GLuint ActiveTextureUnit;
+	static GLuint Textures[GL_STATE_CACHE_TEXTURE_UNITS];
+	static GLenum TextureTargets[GL_STATE_CACHE_TEXTURE_UNITS];
+	static BufferBinding UniformBuffers[GL_STATE_CACHE_BUFFER_BINDINGS];
+	static BufferBinding StorageBuffers[GL_STATE_CACHE_BUFFER_BINDINGS];
+	static bool Valid;
+
+	static GLStateCounters Counters;
+	static GLStateCounters LastFrameCounters;
+};
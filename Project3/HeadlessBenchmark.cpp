@@ -0,0 +1,254 @@
+#include "HeadlessBenchmark.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+
+#define BENCHMARK_TWO_PI 6.283185307f
+
+BenchmarkPath::BenchmarkPath(float cameraDistance, float lightAngleX)
+{
+	BenchmarkKeyframe start = { 0.0f, 0.3f, 0.0f, cameraDistance, lightAngleX, 0.0f };
+	BenchmarkKeyframe middle = { 0.5f, -0.2f, 0.5f * BENCHMARK_TWO_PI, 0.6f * cameraDistance, lightAngleX, -0.5f * BENCHMARK_TWO_PI };
+	BenchmarkKeyframe end = { 1.0f, 0.3f, BENCHMARK_TWO_PI, cameraDistance, lightAngleX, -BENCHMARK_TWO_PI };
+	Keyframes.push_back(start);
+	Keyframes.push_back(middle);
+	Keyframes.push_back(end);
+}
+
+bool BenchmarkPath::Load(const char* filename)
+{
+	FILE* file = fopen(filename, "r");
+	if (!file)
+	{
+		fprintf(stderr, "Could not open benchmark path %s\n", filename);
+		return false;
+	}
+
+	std::vector<BenchmarkKeyframe> keyframes;
+	char line[256];
+	while (fgets(line, sizeof(line), file))
+	{
+		char* comment = strchr(line, '#');
+		if (comment)
+		{
+			*comment = '\0';
+		}
+		BenchmarkKeyframe keyframe;
+		int count = sscanf(line, "%f %f %f %f %f %f", &keyframe.Time, &keyframe.CameraAngleX, &keyframe.CameraAngleY,
+			&keyframe.CameraDistance, &keyframe.LightAngleX, &keyframe.LightAngleY);
+		if (count == 6)
+		{
+			keyframes.push_back(keyframe);
+		}
+		else if (count > 0)
+		{
+			fprintf(stderr, "Skipping benchmark path line with %d of 6 values: %s", count, line);
+		}
+	}
+	fclose(file);
+
+	if (keyframes.empty())
+	{
+		fprintf(stderr, "Benchmark path %s has no keyframes\n", filename);
+		return false;
+	}
+	std::stable_sort(keyframes.begin(), keyframes.end(), [](const BenchmarkKeyframe& a, const BenchmarkKeyframe& b) { return a.Time < b.Time; });
+	Keyframes = keyframes;
+	return true;
+}
+
+BenchmarkKeyframe BenchmarkPath::Evaluate(float time) const
+{
+	if (time <= Keyframes.front().Time)
+	{
+		return Keyframes.front();
+	}
+	for (size_t i = 1; i < Keyframes.size(); i++)
+	{
+		const BenchmarkKeyframe& next = Keyframes[i];
+		if (time < next.Time)
+		{
+			const BenchmarkKeyframe& previous = Keyframes[i - 1];
+			float t = (time - previous.Time) / (next.Time - previous.Time);
+			BenchmarkKeyframe keyframe;
+			keyframe.Time = time;
+			keyframe.CameraAngleX = previous.CameraAngleX + t * (next.CameraAngleX - previous.CameraAngleX);
+			keyframe.CameraAngleY = previous.CameraAngleY + t * (next.CameraAngleY - previous.CameraAngleY);
+			keyframe.CameraDistance = previous.CameraDistance + t * (next.CameraDistance - previous.CameraDistance);
+			keyframe.LightAngleX = previous.LightAngleX + t * (next.LightAngleX - previous.LightAngleX);
+			keyframe.LightAngleY = previous.LightAngleY + t * (next.LightAngleY - previous.LightAngleY);
+			return keyframe;
+		}
+	}
+	return Keyframes.back();
+}
+
+BenchmarkRecorder::BenchmarkRecorder(unsigned int frameCount)
+{
+	FrameCount = frameCount;
+	RecordedFrames = 0;
+	TimestampQueries.resize(frameCount * 2);
+	PrimitiveQueries.resize(frameCount);
+	CpuTimes.resize(frameCount);
+	if (frameCount > 0)
+	{
+		glGenQueries((GLsizei)TimestampQueries.size(), TimestampQueries.data());
+		glGenQueries((GLsizei)PrimitiveQueries.size(), PrimitiveQueries.data());
+	}
+}
+
+BenchmarkRecorder::~BenchmarkRecorder()
+{
+	if (FrameCount > 0)
+	{
+		glDeleteQueries((GLsizei)TimestampQueries.size(), TimestampQueries.data());
+		glDeleteQueries((GLsizei)PrimitiveQueries.size(), PrimitiveQueries.data());
+	}
+}
+
+void BenchmarkRecorder::BeginFrame()
+{
+	//Timestamps instead of a GL_TIME_ELAPSED query, which could not nest with other timer queries inside the frame
+	glQueryCounter(TimestampQueries[RecordedFrames * 2], GL_TIMESTAMP);
+	glBeginQuery(GL_PRIMITIVES_GENERATED, PrimitiveQueries[RecordedFrames]);
+	FrameTimer.Start();
+}
+
+void BenchmarkRecorder::EndFrame()
+{
+	CpuTimes[RecordedFrames] = FrameTimer.Stop() * 1000.0;
+	glEndQuery(GL_PRIMITIVES_GENERATED);
+	glQueryCounter(TimestampQueries[RecordedFrames * 2 + 1], GL_TIMESTAMP);
+	RecordedFrames++;
+}
+
+static void writeJsonString(FILE* file, const char* text)
+{
+	fputc('"', file);
+	for (const char* c = text ? text : ""; *c; c++)
+	{
+		if (*c == '"' || *c == '\\')
+		{
+			fputc('\\', file);
+			fputc(*c, file);
+		}
+		else if ((unsigned char)*c < 0x20)
+		{
+			fprintf(file, "\\u%04x", (unsigned int)(unsigned char)*c);
+		}
+		else
+		{
+			fputc(*c, file);
+		}
+	}
+	fputc('"', file);
+}
+
+bool BenchmarkRecorder::WriteJson(const char* filename, const char* objFilename, const char* mode, int width, int height)
+{
+	FILE* file = filename ? fopen(filename, "w") : stdout;
+	if (!file)
+	{
+		fprintf(stderr, "Could not write benchmark results to %s\n", filename);
+		return false;
+	}
+
+	//Blocks until the GPU has finished the last recorded frame
+	std::vector<double> gpuTimes(RecordedFrames);
+	std::vector<GLuint64> primitives(RecordedFrames);
+	for (unsigned int frame = 0; frame < RecordedFrames; frame++)
+	{
+		GLuint64 start = 0, end = 0;
+		glGetQueryObjectui64v(TimestampQueries[frame * 2], GL_QUERY_RESULT, &start);
+		glGetQueryObjectui64v(TimestampQueries[frame * 2 + 1], GL_QUERY_RESULT, &end);
+		glGetQueryObjectui64v(PrimitiveQueries[frame], GL_QUERY_RESULT, &primitives[frame]);
+		gpuTimes[frame] = (end - start) / 1000000.0;
+	}
+
+	double cpuTotal = 0, gpuTotal = 0;
+	double cpuMax = 0, gpuMax = 0;
+	for (unsigned int frame = 0; frame < RecordedFrames; frame++)
+	{
+		cpuTotal += CpuTimes[frame];
+		gpuTotal += gpuTimes[frame];
+		cpuMax = std::max(cpuMax, CpuTimes[frame]);
+		gpuMax = std::max(gpuMax, gpuTimes[frame]);
+	}
+	double frames = RecordedFrames > 0 ? RecordedFrames : 1;
+
+	fprintf(file, "{\n  \"obj\": ");
+	writeJsonString(file, objFilename);
+	fprintf(file, ",\n  \"mode\": ");
+	writeJsonString(file, mode);
+	fprintf(file, ",\n  \"renderer\": ");
+	writeJsonString(file, (const char*)glGetString(GL_RENDERER));
+	fprintf(file, ",\n  \"version\": ");
+	writeJsonString(file, (const char*)glGetString(GL_VERSION));
+	fprintf(file, ",\n  \"width\": %d,\n  \"height\": %d,\n  \"frameCount\": %u,\n", width, height, RecordedFrames);
+	fprintf(file, "  \"summary\": { \"cpuMsAverage\": %.4f, \"cpuMsMax\": %.4f, \"gpuMsAverage\": %.4f, \"gpuMsMax\": %.4f },\n",
+		cpuTotal / frames, cpuMax, gpuTotal / frames, gpuMax);
+	fprintf(file, "  \"frames\": [\n");
+	for (unsigned int frame = 0; frame < RecordedFrames; frame++)
+	{
+		fprintf(file, "    { \"frame\": %u, \"cpuMs\": %.4f, \"gpuMs\": %.4f, \"triangles\": %llu }%s\n", frame, CpuTimes[frame], gpuTimes[frame],
+			(unsigned long long)primitives[frame], frame + 1 < RecordedFrames ? "," : "");
+	}
+	fprintf(file, "  ]\n}\n");
+
+	if (file != stdout)
+	{
+		fclose(file);
+	}
+	return true;
+}
+
+static GLFWwindow* createHiddenWindow(int width, int height, int contextApi)
+{
+	glfwDefaultWindowHints();
+	glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+	glfwWindowHint(GLFW_CONTEXT_CREATION_API, contextApi);
+	GLFWwindow* window = glfwCreateWindow(width, height, "Project3 headless", NULL, NULL);
+	glfwDefaultWindowHints();
+	return window;
+}
+
+GLFWwindow* CreateHeadlessWindow(int width, int height)
+{
+#ifdef GLFW_PLATFORM_NULL
+	//GLFW 3.4 runs without a display server on its null platform, whose contexts come from OSMesa
+	if (glfwPlatformSupported(GLFW_PLATFORM_NULL))
+	{
+		glfwInitHint(GLFW_PLATFORM, GLFW_PLATFORM_NULL);
+		if (glfwInit())
+		{
+			GLFWwindow* window = createHiddenWindow(width, height, GLFW_OSMESA_CONTEXT_API);
+			if (window)
+			{
+				fprintf(stdout, "Status: Rendering headless through an OSMesa context\n");
+				return window;
+			}
+			glfwTerminate();
+		}
+		glfwInitHint(GLFW_PLATFORM, GLFW_ANY_PLATFORM);
+	}
+#endif
+
+	if (!glfwInit())
+	{
+		return NULL;
+	}
+	const int contextApis[] = { GLFW_EGL_CONTEXT_API, GLFW_OSMESA_CONTEXT_API, GLFW_NATIVE_CONTEXT_API };
+	const char* contextNames[] = { "an EGL", "an OSMesa", "a hidden window's" };
+	for (int i = 0; i < 3; i++)
+	{
+		GLFWwindow* window = createHiddenWindow(width, height, contextApis[i]);
+		if (window)
+		{
+			fprintf(stdout, "Status: Rendering headless through %s context\n", contextNames[i]);
+			return window;
+		}
+	}
+	glfwTerminate();
+	return NULL;
+}
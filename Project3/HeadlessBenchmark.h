@@ -0,0 +1,63 @@
+#pragma once
+
+#include <vector>
+#include "GL/glew.h"
+#include "GLFW/glfw3.h"
+#include "cyTimer.h"
+
+//Camera and light placement at one point of a benchmark path. Angles are radians around the origin, as the mouse sets them.
+struct BenchmarkKeyframe
+{
+	float Time; //0 at the first recorded frame, 1 at the last
+	float CameraAngleX;
+	float CameraAngleY;
+	float CameraDistance;
+	float LightAngleX;
+	float LightAngleY;
+};
+
+//Path played back by the headless benchmark, interpolated linearly between keyframes.
+//Files hold one keyframe per line: time cameraAngleX cameraAngleY cameraDistance lightAngleX lightAngleY; # starts a comment.
+class BenchmarkPath
+{
+public:
+	//Defaults to one orbit of the camera around the model, dipping closer halfway, with the light circling the other way.
+	BenchmarkPath(float cameraDistance, float lightAngleX);
+
+	bool Load(const char* filename);
+	BenchmarkKeyframe Evaluate(float time) const;
+
+private:
+	std::vector<BenchmarkKeyframe> Keyframes;
+};
+
+//Records CPU time, GPU time and primitives drawn for a fixed number of frames. Every frame has its own queries,
+//which are only read back by WriteJson, so recording never waits on the GPU.
+class BenchmarkRecorder
+{
+public:
+	BenchmarkRecorder(unsigned int frameCount);
+	~BenchmarkRecorder();
+
+	void BeginFrame();
+	void EndFrame();
+
+	unsigned int GetRecordedFrameCount() const { return RecordedFrames; }
+	unsigned int GetFrameCount() const { return FrameCount; }
+	bool IsComplete() const { return RecordedFrames == FrameCount; }
+
+	//Writes the frames as JSON to filename, or to stdout if it is NULL.
+	bool WriteJson(const char* filename, const char* objFilename, const char* mode, int width, int height);
+
+private:
+	unsigned int FrameCount;
+	unsigned int RecordedFrames;
+	std::vector<GLuint> TimestampQueries; //start and end of each frame
+	std::vector<GLuint> PrimitiveQueries;
+	std::vector<double> CpuTimes; //ms
+	cy::Timer FrameTimer;
+};
+
+//Initializes GLFW and creates an invisible window whose context renders offscreen. Tries GLFW's null platform with
+//OSMesa first, then EGL and OSMesa contexts, then a hidden native window. Returns NULL, with GLFW terminated, if none works.
+GLFWwindow* CreateHeadlessWindow(int width, int height);
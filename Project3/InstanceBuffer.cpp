@@ -0,0 +1,97 @@
+#include "InstanceBuffer.h"
+
+#include <math.h>
+#include <algorithm>
+
+InstanceBuffer::InstanceBuffer()
+{
+	Buffer = 0;
+	Capacity = 0;
+}
+
+InstanceBuffer::~InstanceBuffer()
+{
+	if (Buffer)
+	{
+		glDeleteBuffers(1, &Buffer);
+	}
+}
+
+void InstanceBuffer::Resize(unsigned int count)
+{
+	TransformRow0.resize(count, cyVec4f(1, 0, 0, 0));
+	TransformRow1.resize(count, cyVec4f(0, 1, 0, 0));
+	TransformRow2.resize(count, cyVec4f(0, 0, 1, 0));
+	MaxScales.resize(count, 1.0f);
+	Colors.resize(count, cyVec4f(1, 1, 1, 1));
+}
+
+void InstanceBuffer::SetTransform(unsigned int instance, const cyMatrix4f& transform)
+{
+	//cyMatrix4f is column major
+	const float* c = transform.cell;
+	TransformRow0[instance] = cyVec4f(c[0], c[4], c[8], c[12]);
+	TransformRow1[instance] = cyVec4f(c[1], c[5], c[9], c[13]);
+	TransformRow2[instance] = cyVec4f(c[2], c[6], c[10], c[14]);
+	float scaleX = cyVec3f(c[0], c[1], c[2]).Length();
+	float scaleY = cyVec3f(c[4], c[5], c[6]).Length();
+	float scaleZ = cyVec3f(c[8], c[9], c[10]).Length();
+	MaxScales[instance] = std::max(scaleX, std::max(scaleY, scaleZ));
+}
+
+void InstanceBuffer::Upload(unsigned int count)
+{
+	if (!Buffer)
+	{
+		glGenBuffers(1, &Buffer);
+	}
+	glBindBuffer(GL_ARRAY_BUFFER, Buffer);
+	if (count > Capacity)
+	{
+		Capacity = std::max(count, Capacity * 2);
+	}
+
+	//The four streams sit one after another; reallocating the storage lets the driver hand out
+	//fresh memory instead of waiting for last frame's draws
+	size_t streamSize = Capacity * sizeof(cyVec4f);
+	glBufferData(GL_ARRAY_BUFFER, streamSize * 4, NULL, GL_STREAM_DRAW);
+	if (count == 0)
+	{
+		return;
+	}
+	glBufferSubData(GL_ARRAY_BUFFER, 0, count * sizeof(cyVec4f), StreamRow0.data());
+	glBufferSubData(GL_ARRAY_BUFFER, streamSize, count * sizeof(cyVec4f), StreamRow1.data());
+	glBufferSubData(GL_ARRAY_BUFFER, streamSize * 2, count * sizeof(cyVec4f), StreamRow2.data());
+	glBufferSubData(GL_ARRAY_BUFFER, streamSize * 3, count * sizeof(cyVec4f), StreamColors.data());
+}
+
+void InstanceBuffer::BindAttributes(unsigned int firstInstance)
+{
+	glBindBuffer(GL_ARRAY_BUFFER, Buffer);
+	size_t streamSize = Capacity * sizeof(cyVec4f);
+	for (int i = 0; i < 4; i++)
+	{
+		GLuint attribute = i < 3 ? INSTANCE_TRANSFORM_ATTRIBUTE + i : INSTANCE_COLOR_ATTRIBUTE;
+		glVertexAttribPointer(attribute, 4, GL_FLOAT, GL_FALSE, 0, (void*)(streamSize * i + firstInstance * sizeof(cyVec4f)));
+		glVertexAttribDivisor(attribute, 1);
+		glEnableVertexAttribArray(attribute);
+	}
+}
+
+void InstanceBuffer::UnbindAttributes()
+{
+	for (int i = 0; i < 3; i++)
+	{
+		glDisableVertexAttribArray(INSTANCE_TRANSFORM_ATTRIBUTE + i);
+	}
+	glDisableVertexAttribArray(INSTANCE_COLOR_ATTRIBUTE);
+	ResetDefaultAttributes();
+}
+
+void InstanceBuffer::ResetDefaultAttributes()
+{
+	glVertexAttrib4f(INSTANCE_TRANSFORM_ATTRIBUTE, 1, 0, 0, 0);
+	glVertexAttrib4f(INSTANCE_TRANSFORM_ATTRIBUTE + 1, 0, 1, 0, 0);
+	glVertexAttrib4f(INSTANCE_TRANSFORM_ATTRIBUTE + 2, 0, 0, 1, 0);
+	glVertexAttrib4f(INSTANCE_COLOR_ATTRIBUTE, 1, 1, 1, 1);
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <vector>
+#include "GL/glew.h"
+#include "cyVector.h"
+#include "cyMatrix.h"
+
+//Vertex attribute locations of the per-instance streams in shader.vert.
+#define INSTANCE_TRANSFORM_ATTRIBUTE 3 //three consecutive rows of an affine transform
+#define INSTANCE_COLOR_ATTRIBUTE 6
+
+//Per-instance transforms and colors for drawing many copies of one RenderableObject,
+//kept as a structure of arrays so culling and LOD passes only touch the streams they read.
+class InstanceBuffer
+{
+public:
+	InstanceBuffer();
+	~InstanceBuffer();
+
+	void Resize(unsigned int count);
+	unsigned int Count() const { return (unsigned int)Colors.size(); }
+
+	//Stores the top three rows of an affine transform applied after the object's own model transform.
+	void SetTransform(unsigned int instance, const cyMatrix4f& transform);
+	void SetColor(unsigned int instance, const cyVec4f& color) { Colors[instance] = color; }
+
+	std::vector<cyVec4f> TransformRow0;
+	std::vector<cyVec4f> TransformRow1;
+	std::vector<cyVec4f> TransformRow2;
+	std::vector<float> MaxScales; //largest axis scale of each transform, for bounding spheres
+	std::vector<cyVec4f> Colors; //multiplies the material's diffuse and ambient color
+
+	//Instances surviving the culling pass, regrouped by LOD. RenderableObject::DrawInstanced fills these each frame.
+	std::vector<cyVec4f> StreamRow0;
+	std::vector<cyVec4f> StreamRow1;
+	std::vector<cyVec4f> StreamRow2;
+	std::vector<cyVec4f> StreamColors;
+
+	//Replaces the GPU copy of the first count stream entries, orphaning last frame's storage.
+	void Upload(unsigned int count);
+
+	//Points the instance attributes of the bound VAO at the stream, starting at firstInstance.
+	void BindAttributes(unsigned int firstInstance);
+	static void UnbindAttributes();
+
+	//Sets the constant instance attributes non-instanced draws read: identity transform, white color.
+	static void ResetDefaultAttributes();
+
+private:
+	GLuint Buffer;
+	unsigned int Capacity;
+};
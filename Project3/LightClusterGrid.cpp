@@ -0,0 +1,327 @@
+#include "LightClusterGrid.h"
+
+#include <math.h>
+#include <algorithm>
+#include "cyTimer.h"
+#include "GLStateCache.h"
+#include "TraceProfiler.h"
+
+#define LIGHT_CLUSTER_SLICE_SIZE (LIGHT_CLUSTER_GRID_X * LIGHT_CLUSTER_GRID_Y)
+
+LightClusterGrid::LightClusterGrid()
+{
+	ClusterMin.resize(LIGHT_CLUSTER_COUNT);
+	ClusterMax.resize(LIGHT_CLUSTER_COUNT);
+	ClusterRanges.resize(LIGHT_CLUSTER_COUNT * 2);
+	ClusterProjection.Zero();
+	NearPlane = FarPlane = 1;
+	SliceScale = SliceBias = 0;
+	TileWidth = TileHeight = 1;
+	LightCount = 0;
+	MaxClusterLightCount = 0;
+	BuildTime = 0;
+
+	glGenBuffers(3, Buffers);
+	glGenTextures(3, Textures);
+	GLenum formats[3] = { GL_RGBA32F, GL_RG32UI, GL_R32UI };
+	for (int i = 0; i < 3; i++)
+	{
+		glBindBuffer(GL_TEXTURE_BUFFER, Buffers[i]);
+		glBufferData(GL_TEXTURE_BUFFER, 16, NULL, GL_STREAM_DRAW);
+		GLStateCache::BindTexture(LIGHT_CLUSTER_LIGHTS_TEXTURE_UNIT + i, GL_TEXTURE_BUFFER, Textures[i]);
+		glTexBuffer(GL_TEXTURE_BUFFER, formats[i], Buffers[i]);
+	}
+
+	//Slices are independent, so the threads never share a list; one slice is the smallest share
+	WorkGeneration = 0;
+	ActiveThreads = 1;
+	SlicesPerThread = LIGHT_CLUSTER_GRID_Z;
+	PendingWorkers = 0;
+	StopWorkers = false;
+	unsigned int threadCount = std::min((unsigned int)LIGHT_CLUSTER_GRID_Z, std::max(1u, std::thread::hardware_concurrency()));
+	for (unsigned int worker = 1; worker < threadCount; worker++)
+	{
+		Workers.push_back(std::thread(&LightClusterGrid::WorkerLoop, this, worker));
+	}
+}
+
+LightClusterGrid::~LightClusterGrid()
+{
+	{
+		std::lock_guard<std::mutex> lock(WorkMutex);
+		StopWorkers = true;
+	}
+	WorkReady.notify_all();
+	for (std::thread& worker : Workers)
+	{
+		worker.join();
+	}
+	glDeleteTextures(3, Textures);
+	glDeleteBuffers(3, Buffers);
+	GLStateCache::Invalidate();
+}
+
+void LightClusterGrid::UpdateClusterBounds(const cyMatrix4f& projection)
+{
+	//For a GL perspective matrix cell 10 is (f + n) / (n - f) and cell 14 is 2fn / (n - f)
+	ClusterProjection = projection;
+	NearPlane = projection.cell[14] / (projection.cell[10] - 1);
+	FarPlane = projection.cell[14] / (projection.cell[10] + 1);
+	SliceScale = LIGHT_CLUSTER_GRID_Z / logf(FarPlane / NearPlane);
+	SliceBias = -SliceScale * logf(NearPlane);
+
+	for (int z = 0; z < LIGHT_CLUSTER_GRID_Z; z++)
+	{
+		float depths[2] = { NearPlane * powf(FarPlane / NearPlane, (float)z / LIGHT_CLUSTER_GRID_Z),
+			NearPlane * powf(FarPlane / NearPlane, (float)(z + 1) / LIGHT_CLUSTER_GRID_Z) };
+		for (int y = 0; y < LIGHT_CLUSTER_GRID_Y; y++)
+		{
+			for (int x = 0; x < LIGHT_CLUSTER_GRID_X; x++)
+			{
+				//Corners of the tile's frustum slab; the projection is assumed to be symmetric
+				cyVec3f boundMin(1e30f, 1e30f, 1e30f);
+				cyVec3f boundMax(-1e30f, -1e30f, -1e30f);
+				for (int corner = 0; corner < 8; corner++)
+				{
+					float ndcX = 2.0f * (x + (corner & 1)) / LIGHT_CLUSTER_GRID_X - 1;
+					float ndcY = 2.0f * (y + ((corner >> 1) & 1)) / LIGHT_CLUSTER_GRID_Y - 1;
+					float depth = depths[corner >> 2];
+					cyVec3f point(ndcX * depth / projection.cell[0], ndcY * depth / projection.cell[5], -depth);
+					boundMin = cyVec3f(std::min(boundMin.x, point.x), std::min(boundMin.y, point.y), std::min(boundMin.z, point.z));
+					boundMax = cyVec3f(std::max(boundMax.x, point.x), std::max(boundMax.y, point.y), std::max(boundMax.z, point.z));
+				}
+				int cluster = (z * LIGHT_CLUSTER_GRID_Y + y) * LIGHT_CLUSTER_GRID_X + x;
+				ClusterMin[cluster] = boundMin;
+				ClusterMax[cluster] = boundMax;
+			}
+		}
+	}
+}
+
+void LightClusterGrid::Build(const PointLight* lights, unsigned int lightCount, const cyMatrix4f& view, const cyMatrix4f& projection,
+	unsigned int viewportWidth, unsigned int viewportHeight)
+{
+	cy::Timer timer;
+	timer.Start();
+	if (projection != ClusterProjection)
+	{
+		UpdateClusterBounds(projection);
+	}
+	TileWidth = (float)viewportWidth / LIGHT_CLUSTER_GRID_X;
+	TileHeight = (float)viewportHeight / LIGHT_CLUSTER_GRID_Y;
+
+	LightCount = lightCount;
+	LightData.resize(lightCount * 2);
+	for (unsigned int i = 0; i < lightCount; i++)
+	{
+		const PointLight& light = lights[i];
+		cyVec3f viewPosition = (view * cyVec4f(light.LightPosition.XYZ(), 1)).XYZ();
+		LightData[i * 2] = cyVec4f(viewPosition, light.Radius);
+		LightData[i * 2 + 1] = cyVec4f(light.Color * light.LightIntensity, 0);
+	}
+
+	//Each thread bins every light into its own range of slices
+	unsigned int threadCount = lightCount < LIGHT_CLUSTER_PARALLEL_LIGHTS ? 1 : (unsigned int)Workers.size() + 1;
+	unsigned int slicesPerThread = (LIGHT_CLUSTER_GRID_Z + threadCount - 1) / threadCount;
+	if (threadCount > 1)
+	{
+		{
+			std::lock_guard<std::mutex> lock(WorkMutex);
+			ActiveThreads = threadCount;
+			SlicesPerThread = slicesPerThread;
+			//Rounding up the share can leave the last threads without a slice
+			PendingWorkers = (LIGHT_CLUSTER_GRID_Z + slicesPerThread - 1) / slicesPerThread - 1;
+			WorkGeneration++;
+		}
+		WorkReady.notify_all();
+	}
+	BinSlices(0, std::min(slicesPerThread, (unsigned int)LIGHT_CLUSTER_GRID_Z));
+	if (threadCount > 1)
+	{
+		std::unique_lock<std::mutex> lock(WorkMutex);
+		WorkDone.wait(lock, [this] { return PendingWorkers == 0; });
+	}
+
+	//Slice lists are already in froxel order, so they only need shifting past the slices before them
+	LightIndices.clear();
+	MaxClusterLightCount = 0;
+	for (int slice = 0; slice < LIGHT_CLUSTER_GRID_Z; slice++)
+	{
+		unsigned int sliceOffset = (unsigned int)LightIndices.size();
+		for (int cluster = slice * LIGHT_CLUSTER_SLICE_SIZE; cluster < (slice + 1) * LIGHT_CLUSTER_SLICE_SIZE; cluster++)
+		{
+			ClusterRanges[cluster * 2] += sliceOffset;
+			MaxClusterLightCount = std::max(MaxClusterLightCount, ClusterRanges[cluster * 2 + 1]);
+		}
+		LightIndices.insert(LightIndices.end(), SliceLights[slice].begin(), SliceLights[slice].end());
+	}
+
+	//Orphaned each frame; buffer textures keep pointing at the same buffer names
+	const void* data[3] = { LightData.data(), ClusterRanges.data(), LightIndices.data() };
+	size_t sizes[3] = { LightData.size() * sizeof(cyVec4f), ClusterRanges.size() * sizeof(unsigned int), LightIndices.size() * sizeof(unsigned int) };
+	for (int i = 0; i < 3; i++)
+	{
+		glBindBuffer(GL_TEXTURE_BUFFER, Buffers[i]);
+		glBufferData(GL_TEXTURE_BUFFER, std::max<size_t>(sizes[i], 16), NULL, GL_STREAM_DRAW);
+		if (sizes[i] > 0)
+		{
+			glBufferSubData(GL_TEXTURE_BUFFER, 0, sizes[i], data[i]);
+		}
+	}
+	BuildTime = timer.Stop() * 1000.0;
+}
+
+void LightClusterGrid::WorkerLoop(unsigned int worker)
+{
+	TRACE_THREAD_NAME("light binning");
+	unsigned int seenGeneration = 0;
+	while (true)
+	{
+		unsigned int firstSlice, endSlice;
+		{
+			std::unique_lock<std::mutex> lock(WorkMutex);
+			WorkReady.wait(lock, [&] { return StopWorkers || WorkGeneration != seenGeneration; });
+			if (StopWorkers)
+			{
+				return;
+			}
+			seenGeneration = WorkGeneration;
+			firstSlice = std::min(worker * SlicesPerThread, (unsigned int)LIGHT_CLUSTER_GRID_Z);
+			endSlice = std::min(firstSlice + SlicesPerThread, (unsigned int)LIGHT_CLUSTER_GRID_Z);
+			if (worker >= ActiveThreads || firstSlice == endSlice)
+			{
+				continue;
+			}
+		}
+
+		BinSlices(firstSlice, endSlice);
+		{
+			std::lock_guard<std::mutex> lock(WorkMutex);
+			PendingWorkers--;
+		}
+		WorkDone.notify_one();
+	}
+}
+
+void LightClusterGrid::BinSlices(unsigned int firstSlice, unsigned int endSlice)
+{
+	TRACE_SCOPE("bin light slices");
+	for (unsigned int slice = firstSlice; slice < endSlice; slice++)
+	{
+		SliceEntries[slice].clear();
+	}
+
+	const float* projection = ClusterProjection.cell;
+	for (unsigned int i = 0; i < LightCount; i++)
+	{
+		cyVec3f center = LightData[i * 2].XYZ();
+		float radius = LightData[i * 2].w;
+		float nearDepth = -center.z - radius;
+		float farDepth = -center.z + radius;
+		if (farDepth < NearPlane || nearDepth > FarPlane)
+		{
+			continue;
+		}
+		int slice0 = (int)floorf(logf(std::max(nearDepth, NearPlane)) * SliceScale + SliceBias);
+		int slice1 = (int)floorf(logf(std::min(farDepth, FarPlane)) * SliceScale + SliceBias);
+		slice0 = std::max(slice0, (int)firstSlice);
+		slice1 = std::min(slice1, (int)endSlice - 1);
+		if (slice0 > slice1)
+		{
+			continue;
+		}
+
+		//Screen rectangle of the sphere's bounding box; spheres reaching behind the near plane may cover any tile
+		int tileX0 = 0, tileX1 = LIGHT_CLUSTER_GRID_X - 1;
+		int tileY0 = 0, tileY1 = LIGHT_CLUSTER_GRID_Y - 1;
+		if (nearDepth > NearPlane)
+		{
+			float ndcMin[2] = { 1e30f, 1e30f };
+			float ndcMax[2] = { -1e30f, -1e30f };
+			for (int corner = 0; corner < 8; corner++)
+			{
+				float x = center.x + ((corner & 1) ? radius : -radius);
+				float y = center.y + ((corner & 2) ? radius : -radius);
+				float depth = (corner & 4) ? farDepth : nearDepth;
+				float ndcX = projection[0] * x / depth;
+				float ndcY = projection[5] * y / depth;
+				ndcMin[0] = std::min(ndcMin[0], ndcX);
+				ndcMax[0] = std::max(ndcMax[0], ndcX);
+				ndcMin[1] = std::min(ndcMin[1], ndcY);
+				ndcMax[1] = std::max(ndcMax[1], ndcY);
+			}
+			tileX0 = std::max(0, (int)floorf((ndcMin[0] + 1) * 0.5f * LIGHT_CLUSTER_GRID_X));
+			tileX1 = std::min(LIGHT_CLUSTER_GRID_X - 1, (int)floorf((ndcMax[0] + 1) * 0.5f * LIGHT_CLUSTER_GRID_X));
+			tileY0 = std::max(0, (int)floorf((ndcMin[1] + 1) * 0.5f * LIGHT_CLUSTER_GRID_Y));
+			tileY1 = std::min(LIGHT_CLUSTER_GRID_Y - 1, (int)floorf((ndcMax[1] + 1) * 0.5f * LIGHT_CLUSTER_GRID_Y));
+		}
+
+		float radiusSquared = radius * radius;
+		for (int z = slice0; z <= slice1; z++)
+		{
+			for (int y = tileY0; y <= tileY1; y++)
+			{
+				for (int x = tileX0; x <= tileX1; x++)
+				{
+					//Sphere against the froxel's box: distance from the center to the nearest point of the box
+					int cluster = (z * LIGHT_CLUSTER_GRID_Y + y) * LIGHT_CLUSTER_GRID_X + x;
+					const cyVec3f& boundMin = ClusterMin[cluster];
+					const cyVec3f& boundMax = ClusterMax[cluster];
+					cyVec3f nearest(std::min(std::max(center.x, boundMin.x), boundMax.x), std::min(std::max(center.y, boundMin.y), boundMax.y),
+						std::min(std::max(center.z, boundMin.z), boundMax.z));
+					if ((nearest - center).LengthSquared() <= radiusSquared)
+					{
+						ClusterEntry entry = { (unsigned int)(cluster - z * LIGHT_CLUSTER_SLICE_SIZE), i };
+						SliceEntries[z].push_back(entry);
+					}
+				}
+			}
+		}
+	}
+
+	for (unsigned int slice = firstSlice; slice < endSlice; slice++)
+	{
+		SortSlice(slice);
+	}
+}
+
+void LightClusterGrid::SortSlice(unsigned int slice)
+{
+	//Counting sort by froxel; entries were added in light order, which the stable scatter keeps within each froxel
+	unsigned int* ranges = &ClusterRanges[slice * LIGHT_CLUSTER_SLICE_SIZE * 2];
+	for (int cluster = 0; cluster < LIGHT_CLUSTER_SLICE_SIZE; cluster++)
+	{
+		ranges[cluster * 2 + 1] = 0;
+	}
+	const std::vector<ClusterEntry>& entries = SliceEntries[slice];
+	for (const ClusterEntry& entry : entries)
+	{
+		ranges[entry.Cluster * 2 + 1]++;
+	}
+	unsigned int offset = 0;
+	for (int cluster = 0; cluster < LIGHT_CLUSTER_SLICE_SIZE; cluster++)
+	{
+		ranges[cluster * 2] = offset;
+		offset += ranges[cluster * 2 + 1];
+	}
+
+	std::vector<unsigned int>& lights = SliceLights[slice];
+	lights.resize(entries.size());
+	for (const ClusterEntry& entry : entries)
+	{
+		//The offset walks to the froxel's end while filling and is set back once every entry is placed
+		lights[ranges[entry.Cluster * 2]++] = entry.Light;
+	}
+	for (int cluster = 0; cluster < LIGHT_CLUSTER_SLICE_SIZE; cluster++)
+	{
+		ranges[cluster * 2] -= ranges[cluster * 2 + 1];
+	}
+}
+
+void LightClusterGrid::Bind() const
+{
+	for (int i = 0; i < 3; i++)
+	{
+		GLStateCache::BindTexture(LIGHT_CLUSTER_LIGHTS_TEXTURE_UNIT + i, GL_TEXTURE_BUFFER, Textures[i]);
+	}
+}
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "GL/glew.h"
+#include "cyMatrix.h"
+#include "PointLight.h"
+
+//Froxel grid dimensions: screen tiles across and down, and exponentially spaced depth slices.
+#define LIGHT_CLUSTER_GRID_X 16
+#define LIGHT_CLUSTER_GRID_Y 9
+#define LIGHT_CLUSTER_GRID_Z 24
+#define LIGHT_CLUSTER_COUNT (LIGHT_CLUSTER_GRID_X * LIGHT_CLUSTER_GRID_Y * LIGHT_CLUSTER_GRID_Z)
+
+//Texture units of the cluster buffer textures in lighting.glsl.
+#define LIGHT_CLUSTER_LIGHTS_TEXTURE_UNIT 0
+#define LIGHT_CLUSTER_RANGES_TEXTURE_UNIT 1
+#define LIGHT_CLUSTER_INDICES_TEXTURE_UNIT 2
+
+//Below this many lights the cluster lists are built on the calling thread alone.
+#define LIGHT_CLUSTER_PARALLEL_LIGHTS 256
+
+//Clustered forward shading: splits the view frustum into a grid of froxels and lists, per froxel, the point lights
+//whose spheres reach into it. Fragments then loop over their own froxel's list instead of every light.
+//The lists are rebuilt on the CPU each frame, split by depth slice across a pool of worker threads started with the grid,
+//and uploaded as buffer textures.
+class LightClusterGrid
+{
+public:
+	LightClusterGrid();
+	~LightClusterGrid();
+
+	//Bins the lights for the given camera. viewport is the size in pixels the frame is drawn at.
+	void Build(const PointLight* lights, unsigned int lightCount, const cyMatrix4f& view, const cyMatrix4f& projection,
+		unsigned int viewportWidth, unsigned int viewportHeight);
+
+	//Binds the buffer textures to the LIGHT_CLUSTER_*_TEXTURE_UNIT units.
+	void Bind() const;
+
+	unsigned int GetLightCount() const { return LightCount; }
+	float GetTileWidth() const { return TileWidth; }
+	float GetTileHeight() const { return TileHeight; }
+
+	//Slice of a view space depth d is floor(log(d) * SliceScale + SliceBias).
+	float GetSliceScale() const { return SliceScale; }
+	float GetSliceBias() const { return SliceBias; }
+
+	unsigned int GetListedLightCount() const { return (unsigned int)LightIndices.size(); }
+	unsigned int GetMaxClusterLightCount() const { return MaxClusterLightCount; }
+	double GetBuildTime() const { return BuildTime; } //milliseconds
+
+private:
+	//A light reaching into a froxel; Cluster counts from the first froxel of its slice.
+	struct ClusterEntry
+	{
+		unsigned int Cluster;
+		unsigned int Light;
+	};
+
+	void UpdateClusterBounds(const cyMatrix4f& projection);
+	void BinSlices(unsigned int firstSlice, unsigned int endSlice);
+	void SortSlice(unsigned int slice);
+	void WorkerLoop(unsigned int worker);
+
+	//View space bounds of every froxel, recomputed when the projection changes
+	std::vector<cyVec3f> ClusterMin;
+	std::vector<cyVec3f> ClusterMax;
+	cyMatrix4f ClusterProjection;
+	float NearPlane;
+	float FarPlane;
+	float SliceScale;
+	float SliceBias;
+	float TileWidth;
+	float TileHeight;
+
+	//This frame's lights: view space position and radius, then color times intensity
+	std::vector<cyVec4f> LightData;
+	unsigned int LightCount;
+
+	//Per slice, filled by the thread binning it: its entries in light order, then their lights sorted by froxel.
+	//ClusterRanges holds offsets into the slice's list until Build concatenates the lists into LightIndices.
+	std::vector<ClusterEntry> SliceEntries[LIGHT_CLUSTER_GRID_Z];
+	std::vector<unsigned int> SliceLights[LIGHT_CLUSTER_GRID_Z];
+	std::vector<unsigned int> ClusterRanges; //offset and count into LightIndices per froxel
+	std::vector<unsigned int> LightIndices;
+	unsigned int MaxClusterLightCount;
+	double BuildTime;
+
+	GLuint Buffers[3]; //lights, ranges and indices
+	GLuint Textures[3];
+
+	//Workers wait for WorkGeneration to change, bin their share of the slices ActiveThreads split, and count down
+	//PendingWorkers. The calling thread takes the first share itself.
+	std::vector<std::thread> Workers;
+	std::mutex WorkMutex;
+	std::condition_variable WorkReady;
+	std::condition_variable WorkDone;
+	unsigned int WorkGeneration;
+	unsigned int ActiveThreads;
+	unsigned int SlicesPerThread;
+	unsigned int PendingWorkers;
+	bool StopWorkers;
+};
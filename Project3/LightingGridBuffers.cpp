@@ -0,0 +1,135 @@
+#include "LightingGridBuffers.h"
+
+#include <stdio.h>
+#include <math.h>
+#include <string.h>
+#include "GLStateCache.h"
+
+//Must match lightingGridBucket in lighting.glsl.
+static unsigned int bucketOf(const cyVec3f& position, float cellSize, unsigned int mask)
+{
+	unsigned int x = (unsigned int)(int)floorf(position.x / cellSize);
+	unsigned int y = (unsigned int)(int)floorf(position.y / cellSize);
+	unsigned int z = (unsigned int)(int)floorf(position.z / cellSize);
+	return ((x * 73856093u) ^ (y * 19349663u) ^ (z * 83492791u)) & mask;
+}
+
+LightingGridBuffers::LightingGridBuffers()
+{
+	memset(&Uniforms, 0, sizeof(Uniforms));
+	MaxAlpha = 0;
+
+	glGenBuffers(1, &LightBuffer);
+	glGenBuffers(1, &BucketBuffer);
+	glGenBuffers(1, &UniformBuffer);
+	glGenTextures(2, Textures);
+	glBindBuffer(GL_TEXTURE_BUFFER, LightBuffer);
+	glBufferData(GL_TEXTURE_BUFFER, 16, NULL, GL_STATIC_DRAW);
+	GLStateCache::BindTexture(LIGHTING_GRID_LIGHTS_TEXTURE_UNIT, GL_TEXTURE_BUFFER, Textures[0]);
+	glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, LightBuffer);
+	glBindBuffer(GL_TEXTURE_BUFFER, BucketBuffer);
+	glBufferData(GL_TEXTURE_BUFFER, 16, NULL, GL_STATIC_DRAW);
+	GLStateCache::BindTexture(LIGHTING_GRID_BUCKETS_TEXTURE_UNIT, GL_TEXTURE_BUFFER, Textures[1]);
+	glTexBuffer(GL_TEXTURE_BUFFER, GL_RG32UI, BucketBuffer);
+	glBindBuffer(GL_UNIFORM_BUFFER, UniformBuffer);
+	glBufferData(GL_UNIFORM_BUFFER, sizeof(LightingGridUniformBlock), &Uniforms, GL_DYNAMIC_DRAW);
+}
+
+LightingGridBuffers::~LightingGridBuffers()
+{
+	glDeleteTextures(2, Textures);
+	GLuint buffers[] = { LightBuffer, BucketBuffer, UniformBuffer };
+	glDeleteBuffers(3, buffers);
+	GLStateCache::Invalidate();
+}
+
+bool LightingGridBuffers::Export(const cy::LightingGridHierarchy& hierarchy, float maxAlpha)
+{
+	int levelCount = hierarchy.GetNumLevels();
+	if (levelCount > LIGHTING_GRID_MAX_LEVELS)
+	{
+		fprintf(stderr, "Lighting grid hierarchy has %d levels, the shaders take at most %d\n", levelCount, LIGHTING_GRID_MAX_LEVELS);
+		return false;
+	}
+
+	memset(&Uniforms, 0, sizeof(Uniforms));
+	MaxAlpha = maxAlpha;
+	Uniforms.LevelCount = levelCount;
+	Uniforms.CellSize = hierarchy.GetCellSize();
+	Uniforms.Alpha = maxAlpha;
+	LightData.clear();
+	Buckets.clear();
+
+	std::vector<unsigned int> lightBuckets;
+	std::vector<unsigned int> order;
+	for (int level = 0; level < levelCount; level++)
+	{
+		unsigned int lightCount = (unsigned int)hierarchy.GetNumLights(level);
+		//Level l gathers lights within 2 * alpha * cellSize * 2^l; the coarsest level, or a lone one, takes every light
+		bool searched = level < levelCount - 1;
+		float cellSize = 4 * maxAlpha * hierarchy.GetCellSize() * (float)(1 << level);
+		unsigned int bucketCount = 1;
+		while (searched && bucketCount < lightCount)
+		{
+			bucketCount *= 2;
+		}
+		unsigned int mask = bucketCount - 1;
+
+		//Counting sort of the level's lights by bucket
+		unsigned int firstBucket = (unsigned int)Buckets.size() / 2;
+		unsigned int firstLight = (unsigned int)LightData.size() / 2;
+		lightBuckets.resize(lightCount);
+		std::vector<unsigned int> counts(bucketCount + 1, 0);
+		for (unsigned int i = 0; i < lightCount; i++)
+		{
+			lightBuckets[i] = bucketOf(hierarchy.GetLightPos(level, i), cellSize, mask);
+			counts[lightBuckets[i] + 1]++;
+		}
+		for (unsigned int bucket = 0; bucket < bucketCount; bucket++)
+		{
+			Buckets.push_back(firstLight + counts[bucket]);
+			Buckets.push_back(counts[bucket + 1]);
+			counts[bucket + 1] += counts[bucket];
+		}
+		order.resize(lightCount);
+		for (unsigned int i = 0; i < lightCount; i++)
+		{
+			order[counts[lightBuckets[i]]++] = i;
+		}
+		for (unsigned int i : order)
+		{
+			const cy::Color& intensity = hierarchy.GetLightIntens(level, hierarchy.GetLightIndex(level, i));
+			LightData.push_back(cyVec4f(hierarchy.GetLightPos(level, i), 1));
+			LightData.push_back(cyVec4f(intensity.r, intensity.g, intensity.b, 0));
+		}
+
+		Uniforms.Levels[level][0] = (int)firstLight;
+		Uniforms.Levels[level][1] = (int)lightCount;
+		Uniforms.Levels[level][2] = (int)firstBucket;
+		Uniforms.Levels[level][3] = (int)mask;
+		Uniforms.BucketCellSizes[level][0] = cellSize;
+	}
+
+	glBindBuffer(GL_TEXTURE_BUFFER, LightBuffer);
+	glBufferData(GL_TEXTURE_BUFFER, LightData.size() * sizeof(cyVec4f), LightData.data(), GL_STATIC_DRAW);
+	glBindBuffer(GL_TEXTURE_BUFFER, BucketBuffer);
+	glBufferData(GL_TEXTURE_BUFFER, Buckets.size() * sizeof(unsigned int), Buckets.data(), GL_STATIC_DRAW);
+	glBindBuffer(GL_UNIFORM_BUFFER, UniformBuffer);
+	glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(LightingGridUniformBlock), &Uniforms);
+	return true;
+}
+
+void LightingGridBuffers::SetAlpha(float alpha)
+{
+	//Larger values would search past the 8 hash cells around a fragment
+	Uniforms.Alpha = fminf(fmaxf(alpha, 1.0f), MaxAlpha);
+	glBindBuffer(GL_UNIFORM_BUFFER, UniformBuffer);
+	glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(LightingGridUniformBlock), &Uniforms);
+}
+
+void LightingGridBuffers::Bind() const
+{
+	GLStateCache::BindTexture(LIGHTING_GRID_LIGHTS_TEXTURE_UNIT, GL_TEXTURE_BUFFER, Textures[0]);
+	GLStateCache::BindTexture(LIGHTING_GRID_BUCKETS_TEXTURE_UNIT, GL_TEXTURE_BUFFER, Textures[1]);
+	GLStateCache::BindBufferBase(GL_UNIFORM_BUFFER, LIGHTING_GRID_UNIFORM_BINDING, UniformBuffer);
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <vector>
+#include "GL/glew.h"
+#include "cyVector.h"
+#include "cyLightingGrid.h"
+
+//Most hierarchy levels the shaders loop over; deeper hierarchies are not exported.
+#define LIGHTING_GRID_MAX_LEVELS 16
+
+//Texture units of the hierarchy's buffer textures, after the light cluster units.
+#define LIGHTING_GRID_LIGHTS_TEXTURE_UNIT 3
+#define LIGHTING_GRID_BUCKETS_TEXTURE_UNIT 4
+
+//Uniform block binding of LightingGridUniforms in lighting.glsl.
+#define LIGHTING_GRID_UNIFORM_BINDING 2
+
+//std140 mirror of the LightingGridUniforms block.
+struct LightingGridUniformBlock
+{
+	int Levels[LIGHTING_GRID_MAX_LEVELS][4]; //first light, light count, first bucket, bucket mask
+	float BucketCellSizes[LIGHTING_GRID_MAX_LEVELS][4]; //only x is used
+	int LevelCount;
+	float CellSize; //finest level cell size of the hierarchy
+	float Alpha;
+	float Padding;
+};
+
+//Copies a cy::LightingGridHierarchy to the GPU so fragments can be lit by it the way LightingGridHierarchy::Light does.
+//Every level's lights are hashed into a grid whose cells are twice the level's search radius, so a fragment finds
+//its neighbours at each level in the 8 cells around it and the cost grows with the number of levels, not lights.
+//The lights are stored sorted by hash bucket: two texels per light, world position and then intensity.
+class LightingGridBuffers
+{
+public:
+	LightingGridBuffers();
+	~LightingGridBuffers();
+
+	//Uploads the hierarchy. maxAlpha sizes the hash cells; SetAlpha can lower the accuracy later but not raise it past this.
+	bool Export(const cy::LightingGridHierarchy& hierarchy, float maxAlpha);
+
+	void SetAlpha(float alpha);
+	float GetAlpha() const { return Uniforms.Alpha; }
+
+	//Binds the buffer textures and the uniform block.
+	void Bind() const;
+
+	unsigned int GetLevelCount() const { return (unsigned int)Uniforms.LevelCount; }
+	unsigned int GetExportedLightCount() const { return (unsigned int)LightData.size() / 2; }
+
+private:
+	LightingGridUniformBlock Uniforms;
+	float MaxAlpha;
+
+	std::vector<cyVec4f> LightData;
+	std::vector<unsigned int> Buckets; //offset and count into the light texels per bucket
+
+	GLuint LightBuffer;
+	GLuint BucketBuffer;
+	GLuint UniformBuffer;
+	GLuint Textures[2];
+};
@@ -0,0 +1,111 @@
+#include "LoaderBenchmark.h"
+
+#include "MeshWelder.h"
+#include "MeshOptimizer.h"
+#include "cyTriMesh.h"
+#include "cyTimer.h"
+#include <map>
+#include <vector>
+#include <stdio.h>
+
+//The per-position std::map weld RenderableObject used before MeshWelder, kept as the benchmark baseline.
+static void weldWithPositionMap(const cyTriMesh& mesh, std::vector<ObjFileIndexData>& objIndices, std::vector<int>& elementBufferVector)
+{
+	std::map<int, std::vector<ObjFileIndexData>> indicesForObjPositionIndex;
+	bool hasUVs = mesh.HasTextureVertices();
+
+	for (unsigned int i = 0; i < mesh.NF(); i++)
+	{
+		cy::TriMesh::TriFace face = mesh.F(i);
+		cy::TriMesh::TriFace faceNormal = mesh.FN(i);
+
+		for (int j = 0; j < 3; j++)
+		{
+			int vertexObjIndex = face.v[j];
+			int normalIndex = faceNormal.v[j];
+			int uvIndex = hasUVs ? (int)mesh.FT(i).v[j] : 0;
+			std::vector<ObjFileIndexData> indicesForVertex = indicesForObjPositionIndex[vertexObjIndex];
+			bool found = false;
+			for (ObjFileIndexData indexData : indicesForVertex)
+			{
+				if (indexData.NormalPositionIndex == normalIndex && indexData.UVPositionIndex == uvIndex)
+				{
+					found = true;
+					elementBufferVector.push_back(indexData.BuffersIndex);
+					break;
+				}
+			}
+			if (!found)
+			{
+				ObjFileIndexData indexData;
+				indexData.BuffersIndex = objIndices.size();
+				indexData.NormalPositionIndex = normalIndex;
+				indexData.UVPositionIndex = uvIndex;
+				indexData.VertexPositionIndex = vertexObjIndex;
+				indicesForObjPositionIndex[vertexObjIndex].push_back(indexData);
+				objIndices.push_back(indexData);
+				elementBufferVector.push_back(indexData.BuffersIndex);
+			}
+		}
+	}
+}
+
+static void printRate(const char* label, unsigned int triangleCount, double seconds)
+{
+	double trianglesPerSecond = seconds > 0 ? triangleCount / seconds : 0;
+	fprintf(stdout, "%-24s %10.2f ms %14.0f triangles/sec\n", label, seconds * 1000.0, trianglesPerSecond);
+}
+
+int RunLoaderBenchmark(char* objFilename)
+{
+	cyTriMesh mesh;
+	cy::Timer timer;
+
+	timer.Start();
+	bool loadObjSuccess = mesh.LoadFromFileObj(objFilename);
+	double parseSeconds = timer.Stop();
+	if (!loadObjSuccess)
+	{
+		fprintf(stderr, "Could not load obj file\n");
+		return -1;
+	}
+	if (!mesh.HasNormals())
+	{
+		mesh.ComputeNormals();
+	}
+
+	fprintf(stdout, "%s: %u triangles, %u positions, %u normals, %u uvs\n",
+		objFilename, mesh.NF(), mesh.NV(), mesh.NVN(), mesh.NVT());
+	printRate("obj parse", mesh.NF(), parseSeconds);
+
+	cyTriMesh parallelMesh;
+	timer.Start();
+	parallelMesh.LoadFromFileObjParallel(objFilename);
+	printRate("obj parse (parallel)", parallelMesh.NF(), timer.Stop());
+
+	std::vector<ObjFileIndexData> mapVertices;
+	std::vector<int> mapIndices;
+	timer.Start();
+	weldWithPositionMap(mesh, mapVertices, mapIndices);
+	printRate("weld (std::map)", mesh.NF(), timer.Stop());
+
+	std::vector<ObjFileIndexData> hashVertices;
+	std::vector<int> hashIndices;
+	timer.Start();
+	WeldObjMesh(mesh, hashVertices, hashIndices);
+	printRate("weld (hash table)", mesh.NF(), timer.Stop());
+
+	if (mapVertices.size() != hashVertices.size() || mapIndices != hashIndices)
+	{
+		fprintf(stderr, "Weld results differ: %zu vs %zu vertices\n", mapVertices.size(), hashVertices.size());
+		return -1;
+	}
+	fprintf(stdout, "%zu welded vertices\n", hashVertices.size());
+
+	MeshData meshData;
+	BuildMeshData(mesh, meshData);
+	timer.Start();
+	OptimizeMeshData(meshData, true);
+	printRate("vertex cache optimize", mesh.NF(), timer.Stop());
+	return 0;
+}
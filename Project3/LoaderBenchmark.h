@@ -0,0 +1,6 @@
+#pragma once
+
+//Loads the obj file without opening a window and prints triangles/sec for the
+//serial and parallel obj parsers and for the vertex welding, comparing the original
+//std::map based weld against the hash table weld in MeshWelder.
+int RunLoaderBenchmark(char* objFilename);
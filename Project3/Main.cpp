@@ -15,6 +15,23 @@
 #include "PointLight.h"
 #include "Shader.h"
 #include "Camera.h"
+#include "LoaderBenchmark.h"
+#include "InstanceBuffer.h"
+#include "SceneRenderer.h"
+#include "SceneGraph.h"
+#include "RenderQueue.h"
+#include "GLStateCache.h"
+#include "LightClusterGrid.h"
+#include "LightingGridBuffers.h"
+#include "PointLightShadow.h"
+#include "HeadlessBenchmark.h"
+#include "FrameProfiler.h"
+#include "TraceProfiler.h"
+#include "ProgramBinaryCache.h"
+#include "cyLightingGrid.h"
+#include "cyTimer.h"
+#include <vector>
+#include <algorithm>
 
 #define WINDOW_WIDTH 1024
 #define WINDOW_HEIGHT 768
@@ -52,9 +69,18 @@ static double lastLMBPositionY;
 static PointLight light;
 static Camera camera;
 
+//On demand drawing: input and loading set this, and the main loop sleeps in glfwWaitEventsTimeout while it is clear.
+//The timeout bounds one sleep, so state changed without an event is still picked up.
+#define IDLE_EVENT_TIMEOUT 0.25
+static bool redrawRequested = true;
+
+//Frame scopes, printed with the P key when -profile is given.
+static FrameProfiler* profiler = NULL;
+
 
 static void keyCallback(GLFWwindow* window, int key, int scancode, int action, int mods)
 {
+    redrawRequested = true;
     if ((key == GLFW_KEY_RIGHT_CONTROL || key == GLFW_KEY_LEFT_CONTROL)
         && (action == GLFW_PRESS || action == GLFW_RELEASE))
     {
@@ -64,6 +90,10 @@ static void keyCallback(GLFWwindow* window, int key, int scancode, int action, i
     {
         glfwSetWindowShouldClose(window, GLFW_TRUE);
     }
+    else if (key == GLFW_KEY_P && action == GLFW_RELEASE && profiler)
+    {
+        profiler->Dump(stdout);
+    }
 }
 
 static cyMatrix4f calculateOffsetAndAnglesTransform(float angleX, float angleY, float distance)
@@ -73,6 +103,20 @@ static cyMatrix4f calculateOffsetAndAnglesTransform(float angleX, float angleY,
         cyMatrix4f::Translation(cyVec3f(0, 0, distance));
 }
 
+static void updateCamera()
+{
+    cyMatrix4f cameraToWorldTransform = calculateOffsetAndAnglesTransform(cameraAngleX, cameraAngleY, cameraDistance);
+    camera.Position = cameraToWorldTransform * cyVec4f(0, 0, 0, 1);
+    camera.Forward = -camera.Position; //Origin - position
+    camera.Forward.Normalize();
+    camera.Up = cameraToWorldTransform * cyVec4f(0, 1, 0, 0);
+}
+
+static void updateLight()
+{
+    light.LightPosition = calculateOffsetAndAnglesTransform(lightAngleX, lightAngleY, lightDistanceFromOrigin) * cyVec4f(0,0,0,1);
+}
+
 static void mouseButtonCallback(GLFWwindow* window, int button, int action, int mods)
 {
     double xpos, ypos;
@@ -100,6 +144,7 @@ static void mousePosCallback(GLFWwindow* window, double xpos, double ypos)
 {
     if (draggingMouseWithLMB)
     {
+        redrawRequested = true;
         double xDifference = xpos - lastLMBPositionX;
         lastLMBPositionX = xpos;
 
@@ -110,22 +155,19 @@ static void mousePosCallback(GLFWwindow* window, double xpos, double ypos)
         {
             lightAngleY += xDifference * angleChangePerPixel;
             lightAngleX += yDifference * angleChangePerPixel;
-            light.LightPosition = calculateOffsetAndAnglesTransform(lightAngleX, lightAngleY, lightDistanceFromOrigin) * cyVec4f(0,0,0,1);
+            updateLight();
         }
         else
         {
             cameraAngleY -= xDifference * angleChangePerPixel;
             cameraAngleX -= yDifference * angleChangePerPixel;
-            cyMatrix4f cameraToWorldTransform = calculateOffsetAndAnglesTransform(cameraAngleX, cameraAngleY, cameraDistance);
-            camera.Position = cameraToWorldTransform * cyVec4f(0, 0, 0, 1);
-            camera.Forward = -camera.Position; //Origin - position
-            camera.Forward.Normalize();
-            camera.Up = cameraToWorldTransform * cyVec4f(0, 1, 0, 0);
+            updateCamera();
         }
     }
 
     if (draggingMouseWithRMB)
     {
+        redrawRequested = true;
         double yDifference = ypos - lastRMBPositionY;
         lastRMBPositionY = ypos;
         cameraDistance += yDifference * distancePerPixel;
@@ -140,6 +182,144 @@ static void mousePosCallback(GLFWwindow* window, double xpos, double ypos)
     }
 }
 
+//Lays instances out on a square grid in the xz plane around the origin, each with its own color.
+static void fillInstanceField(InstanceBuffer& instances, unsigned int count, float spacing)
+{
+    instances.Resize(count);
+    unsigned int side = (unsigned int)ceil(sqrt((double)count));
+    float start = -0.5f * spacing * (side - 1);
+    for (unsigned int i = 0; i < count; i++)
+    {
+        float x = start + spacing * (i % side);
+        float z = start + spacing * (i / side);
+        instances.SetTransform(i, cyMatrix4f::Translation(cyVec3f(x, 0, z)) * cyMatrix4f::RotationY(i * 0.7f));
+        unsigned int hash = i * 2654435761u;
+        instances.SetColor(i, cyVec4f(0.5f + (hash & 0xFF) / 510.0f, 0.5f + ((hash >> 8) & 0xFF) / 510.0f, 0.5f + ((hash >> 16) & 0xFF) / 510.0f, 1));
+    }
+}
+
+//Places count objects on the same grid, cycling through the meshes and giving each its own material color.
+//Every object is a child of one root node, so turning the whole field only touches the root's local transform.
+static void fillScene(SceneRenderer& scene, SceneGraph& graph, std::vector<RenderableObject*>& meshes, std::vector<Material>& materials, unsigned int count)
+{
+    unsigned int root = graph.AddNode();
+    float spacing = 0;
+    for (RenderableObject* mesh : meshes)
+    {
+        spacing = fmaxf(spacing, 2.5f * mesh->GetBoundingRadius());
+    }
+    materials.resize(count, *meshes[0]->ObjectMaterial);
+    unsigned int side = (unsigned int)ceil(sqrt((double)count));
+    float start = -0.5f * spacing * (side - 1);
+    for (unsigned int i = 0; i < count; i++)
+    {
+        unsigned int hash = i * 2654435761u;
+        materials[i].AmbientDiffuseColor = cyVec4f((hash & 0xFF) / 255.0f, ((hash >> 8) & 0xFF) / 255.0f, ((hash >> 16) & 0xFF) / 255.0f, 1);
+        RenderableObject* mesh = meshes[i % meshes.size()];
+        unsigned int node = graph.AddNode(root);
+        graph.SetLocalTransform(node, cyMatrix4f::Translation(cyVec3f(start + spacing * (i % side), 0, start + spacing * (i / side))) * mesh->CalculateModelTransform());
+        scene.Add(mesh, node, &materials[i]);
+    }
+}
+
+//Lines the objects up along x once their sizes are known.
+static void placeInRow(std::vector<RenderableObject*>& objects)
+{
+    float spacing = 0;
+    for (RenderableObject* object : objects)
+    {
+        spacing = fmaxf(spacing, 2.5f * object->GetBoundingRadius());
+    }
+    for (size_t i = 0; i < objects.size(); i++)
+    {
+        objects[i]->Position = cyVec3f(spacing * (i - 0.5f * (objects.size() - 1)), 0, 0);
+    }
+}
+
+//Scatters colored point lights over a disc of the given radius, a little above the objects, each reaching a few of them.
+static void fillLights(std::vector<PointLight>& lights, std::vector<cyVec3f>& basePositions, unsigned int count, float fieldRadius, float lightRadius)
+{
+    lights.resize(count);
+    basePositions.resize(count);
+    for (unsigned int i = 0; i < count; i++)
+    {
+        unsigned int hash = i * 2654435761u;
+        float angle = (float)(2.0 * M_PI * (hash & 0xFFFF) / 65536.0);
+        float distance = fieldRadius * sqrtf(((hash >> 16) & 0xFFFF) / 65536.0f);
+        basePositions[i] = cyVec3f(distance * cosf(angle), 0.25f * lightRadius, distance * sinf(angle));
+        unsigned int colorHash = hash ^ (hash >> 13);
+        lights[i].Color = cyVec3f((colorHash & 0xFF) / 255.0f, ((colorHash >> 8) & 0xFF) / 255.0f, ((colorHash >> 16) & 0xFF) / 255.0f);
+        lights[i].LightIntensity = 1.0f;
+        lights[i].Radius = lightRadius * (0.5f + ((colorHash >> 24) & 0xFF) / 255.0f);
+    }
+}
+
+//Builds a lighting grid hierarchy over many dim virtual lights spread like fillLights, with about unit irradiance overall.
+static bool buildVirtualLights(cy::LightingGridHierarchy& hierarchy, unsigned int count, float fieldRadius, float height)
+{
+    std::vector<cy::Vec3f> positions(count);
+    std::vector<cy::Color> intensities(count);
+    float intensity = fieldRadius * fieldRadius / (8.0f * count);
+    for (unsigned int i = 0; i < count; i++)
+    {
+        unsigned int hash = i * 2654435761u;
+        float angle = (float)(2.0 * M_PI * (hash & 0xFFFF) / 65536.0);
+        float distance = fieldRadius * sqrtf(((hash >> 16) & 0xFFFF) / 65536.0f);
+        unsigned int colorHash = hash ^ (hash >> 13);
+        positions[i] = cy::Vec3f(distance * cosf(angle), height * (colorHash >> 24) / 255.0f, distance * sinf(angle));
+        intensities[i] = cy::Color((colorHash & 0xFF) / 255.0f, ((colorHash >> 8) & 0xFF) / 255.0f, ((colorHash >> 16) & 0xFF) / 255.0f) * intensity;
+    }
+    return hierarchy.BuildParallel(positions.data(), intensities.data(), (int)count, 8);
+}
+
+//Turns the light field slowly around y so the cluster lists change every frame.
+static void moveLights(std::vector<PointLight>& lights, const std::vector<cyVec3f>& basePositions, float time)
+{
+    cyMatrix4f rotation = cyMatrix4f::RotationY(0.2f * time);
+    for (size_t i = 0; i < lights.size(); i++)
+    {
+        lights[i].LightPosition = rotation * cyVec4f(basePositions[i], 1);
+    }
+}
+
+static void printStateCounters()
+{
+    const GLStateCounters& counters = GLStateCache::GetLastFrameCounters();
+    fprintf(stdout, "Status: Last frame bound %u program(s), %u vertex array(s), %u texture(s), %u buffer range(s); skipped %u, %u, %u, %u redundant binds\n",
+        counters.ProgramBinds, counters.VertexArrayBinds, counters.TextureBinds, counters.BufferBinds,
+        counters.ProgramBindsSkipped, counters.VertexArrayBindsSkipped, counters.TextureBindsSkipped, counters.BufferBindsSkipped);
+}
+
+static void printUsage()
+{
+    fprintf(stderr, "Usage: Project3 [options] <obj file> [more obj files]\n");
+    fprintf(stderr, "  -benchload                       time obj parsing and vertex welding, then exit\n");
+    fprintf(stderr, "  -vertexformat float|half|unorm16 vertex buffer layout (default unorm16)\n");
+    fprintf(stderr, "  -overdraw                        also sort triangle clusters to reduce overdraw\n");
+    fprintf(stderr, "  -index32                         always use 32 bit indices instead of 16 bit submeshes\n");
+    fprintf(stderr, "  -nolod                           draw full detail only, without a simplified LOD chain\n");
+    fprintf(stderr, "  -nocull                          draw every meshlet instead of culling backfacing and offscreen ones\n");
+    fprintf(stderr, "  -syncload                        load and upload the whole mesh up front instead of streaming it in\n");
+    fprintf(stderr, "  -instances <count>               draw a grid of instanced copies and report frame times\n");
+    fprintf(stderr, "  -scene                           draw all obj files, repeated to -instances objects, with one multi draw indirect call\n");
+    fprintf(stderr, "  -lights <count>                  add colored point lights shaded through a clustered light grid\n");
+    fprintf(stderr, "  -virtuallights <count>           add dim virtual lights shaded through a lighting grid hierarchy\n");
+    fprintf(stderr, "  -headless <frames>               render offscreen without a window, record a scripted path for <frames> frames and exit\n");
+    fprintf(stderr, "  -benchpath <file>                camera and light keyframes for -headless (default: one orbit)\n");
+    fprintf(stderr, "  -benchout <file>                 JSON file -headless writes per frame times to, - for stdout (default benchmark.json)\n");
+    fprintf(stderr, "  -profile                         time named CPU and GPU scopes of every frame; P prints their statistics\n");
+    fprintf(stderr, "  -profilecsv <file>               like -profile, and also write the statistics to a CSV file on exit\n");
+    fprintf(stderr, "  -trace <file>                    record load, upload, compile and draw scopes of every thread to a Chrome trace JSON file\n");
+    fprintf(stderr, "  -noshadercache                   always compile shaders from source instead of loading cached program binaries\n");
+    fprintf(stderr, "  -continuous                      draw every frame instead of only after input or loading (implied by benchmark options)\n");
+    fprintf(stderr, "  -shadows                         shadow the main light with a cube shadow map, drawn again only when something moves\n");
+    fprintf(stderr, "  -matte                           give the material no highlights, drawn with a shader variant that skips them\n");
+}
+
+static void refreshCallback(GLFWwindow* window)
+{
+    redrawRequested = true;
+}
 
 static void errorCallback(int error, const char* description)
 {
@@ -148,32 +328,189 @@ static void errorCallback(int error, const char* description)
 
 int main(int argc, char* argv[])
 {
-    if (argc != 2)
+    char* objFilename = NULL;
+    bool benchmarkLoad = false;
+    unsigned int instanceCount = 0;
+    bool sceneMode = false;
+    unsigned int pointLightCount = 0;
+    unsigned int virtualLightCount = 0;
+    bool shadows = false;
+    bool matte = false;
+    bool continuousRedraw = false;
+    unsigned int headlessFrames = 0;
+    const char* benchmarkPathFilename = NULL;
+    const char* benchmarkOutputFilename = "benchmark.json";
+    bool profile = false;
+    const char* profileCsvFilename = NULL;
+    const char* traceFilename = NULL;
+    bool shaderCache = true;
+    std::vector<char*> extraObjFilenames;
+    MeshLoadOptions loadOptions;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-benchload") == 0)
+        {
+            benchmarkLoad = true;
+        }
+        else if (strcmp(argv[i], "-vertexformat") == 0 && i + 1 < argc)
+        {
+            if (!ParseVertexLayout(argv[++i], loadOptions.Layout))
+            {
+                fprintf(stderr, "Unknown vertex format %s\n", argv[i]);
+                printUsage();
+                return 0;
+            }
+        }
+        else if (strcmp(argv[i], "-overdraw") == 0)
+        {
+            loadOptions.OptimizeOverdraw = true;
+        }
+        else if (strcmp(argv[i], "-index32") == 0)
+        {
+            loadOptions.ShortIndices = false;
+        }
+        else if (strcmp(argv[i], "-nolod") == 0)
+        {
+            loadOptions.GenerateLods = false;
+        }
+        else if (strcmp(argv[i], "-nocull") == 0)
+        {
+            loadOptions.ClusterCulling = false;
+        }
+        else if (strcmp(argv[i], "-syncload") == 0)
+        {
+            loadOptions.AsyncLoad = false;
+        }
+        else if (strcmp(argv[i], "-instances") == 0 && i + 1 < argc)
+        {
+            instanceCount = (unsigned int)atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-scene") == 0)
+        {
+            sceneMode = true;
+        }
+        else if (strcmp(argv[i], "-lights") == 0 && i + 1 < argc)
+        {
+            pointLightCount = (unsigned int)atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-virtuallights") == 0 && i + 1 < argc)
+        {
+            virtualLightCount = (unsigned int)atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-headless") == 0 && i + 1 < argc)
+        {
+            headlessFrames = (unsigned int)atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "-benchpath") == 0 && i + 1 < argc)
+        {
+            benchmarkPathFilename = argv[++i];
+        }
+        else if (strcmp(argv[i], "-benchout") == 0 && i + 1 < argc)
+        {
+            benchmarkOutputFilename = strcmp(argv[i + 1], "-") == 0 ? NULL : argv[i + 1];
+            i++;
+        }
+        else if (strcmp(argv[i], "-profile") == 0)
+        {
+            profile = true;
+        }
+        else if (strcmp(argv[i], "-profilecsv") == 0 && i + 1 < argc)
+        {
+            profile = true;
+            profileCsvFilename = argv[++i];
+        }
+        else if (strcmp(argv[i], "-trace") == 0 && i + 1 < argc)
+        {
+            traceFilename = argv[++i];
+        }
+        else if (strcmp(argv[i], "-noshadercache") == 0)
+        {
+            shaderCache = false;
+        }
+        else if (strcmp(argv[i], "-continuous") == 0)
+        {
+            continuousRedraw = true;
+        }
+        else if (strcmp(argv[i], "-shadows") == 0)
+        {
+            shadows = true;
+        }
+        else if (strcmp(argv[i], "-matte") == 0)
+        {
+            matte = true;
+        }
+        else if (objFilename == NULL && argv[i][0] != '-')
+        {
+            objFilename = argv[i];
+        }
+        else if (argv[i][0] != '-')
+        {
+            extraObjFilenames.push_back(argv[i]);
+        }
+        else
+        {
+            printUsage();
+            return 0;
+        }
+    }
+    if (objFilename == NULL)
     {
         fprintf(stderr, "Requires a single argument for the obj file location\n");
+        printUsage();
         return 0;
     }
+    if (benchmarkLoad)
+    {
+        return RunLoaderBenchmark(objFilename);
+    }
     std::string exePath(argv[0]);
     ExecutableDirectory = std::string(exePath.substr(0, exePath.find_last_of('\\')));
 
     glfwSetErrorCallback(errorCallback);
 
-    if (!glfwInit())
+    BenchmarkPath benchmarkPath(cameraDistance, lightAngleX);
+    if (benchmarkPathFilename && !benchmarkPath.Load(benchmarkPathFilename))
+    {
         return -1;
+    }
 
-    GLFWwindow * window = glfwCreateWindow(WINDOW_WIDTH, WINDOW_HEIGHT, "Hello World", NULL, NULL);
-    if (!window)
+    GLFWwindow* window = NULL;
+    if (headlessFrames > 0)
     {
-        glfwTerminate();
-        return -1;
+        window = CreateHeadlessWindow(WINDOW_WIDTH, WINDOW_HEIGHT);
+        if (!window)
+        {
+            fprintf(stderr, "Could not create an offscreen OpenGL context\n");
+            return -1;
+        }
+    }
+    else
+    {
+        if (!glfwInit())
+            return -1;
+
+        window = glfwCreateWindow(WINDOW_WIDTH, WINDOW_HEIGHT, "Hello World", NULL, NULL);
+        if (!window)
+        {
+            glfwTerminate();
+            return -1;
+        }
     }
 
     glfwMakeContextCurrent(window);
     glfwSetKeyCallback(window, keyCallback);
     glfwSetMouseButtonCallback(window, mouseButtonCallback);
     glfwSetCursorPosCallback(window, mousePosCallback);
+    glfwSetWindowRefreshCallback(window, refreshCallback);
 
     GLenum err = glewInit();
+#ifdef GLEW_ERROR_NO_GLX_DISPLAY
+    //GLEW built for GLX still loads the GL entry points of EGL and OSMesa contexts before failing on the missing display
+    if (headlessFrames > 0 && err == GLEW_ERROR_NO_GLX_DISPLAY)
+    {
+        err = GLEW_OK;
+    }
+#endif
     if (GLEW_OK != err)
     {
         fprintf(stderr, "GLEW Error: %s\n", glewGetErrorString(err));
@@ -183,37 +520,73 @@ int main(int argc, char* argv[])
 
 
     glViewport(0, 0, WINDOW_WIDTH, WINDOW_HEIGHT);
+    if (profile)
+    {
+        profiler = new FrameProfiler();
+    }
+    if (traceFilename)
+    {
+        TraceProfiler::Enable();
+        TRACE_THREAD_NAME("main");
+    }
 
     glClearColor(0, 0, 0, 1);
 
+    if (shaderCache)
+    {
+        ProgramBinaryCache::SetDirectory(ExecutableDirectory);
+    }
+
     std::string fragShaderPath(ExecutableDirectory);
     fragShaderPath.append("\\shader.frag");
 
     std::string vertexShaderPath(ExecutableDirectory);
     vertexShaderPath.append("\\shader.vert");
 
-    light.LightPosition = calculateOffsetAndAnglesTransform(0.0f, 0.0f, lightDistanceFromOrigin) * cyVec4f(0,0,0,1);
+    updateLight();
     light.LightIntensity = 1.0f;
-
-    cyMatrix4f cameraToWorldTransform = calculateOffsetAndAnglesTransform(cameraAngleX, cameraAngleY, cameraDistance);
-    camera.Position = cameraToWorldTransform * cyVec4f(0, 0, 0, 1);
-    camera.Forward = -camera.Position; //Origin - position
-    camera.Forward.Normalize();
-    camera.Up = cameraToWorldTransform * cyVec4f(0, 1, 0, 0);
+    updateCamera();
 
     Material material;
 
     material.AmbientDiffuseColor = cyVec4f(0, 0.5, 0, 1.0);
     float ambientIntensity = 0.1f;
     material.SpecularShininess = 10;
-    material.SpecularColor = cyVec4f(1.0, 1.0, 1.0, 1.0);
+    material.SpecularColor = matte ? cyVec4f(0.0, 0.0, 0.0, 1.0) : cyVec4f(1.0, 1.0, 1.0, 1.0);
 
-    RenderableObject renderable(argv[1], &material);
+    RenderableObject renderable(objFilename, &material, loadOptions);
     renderable.RotationAngles = cyVec3f( -1.570796326f,0, 0);
     renderable.CenterOnBoundingBox = true;
 
     Shader shader(vertexShaderPath, fragShaderPath);
 
+    //Every other obj file streams in like the main one. They are drawn through the render queue,
+    //or packed into the multi draw indirect scene once all are on the GPU
+    std::vector<RenderableObject*> meshes(1, &renderable);
+    for (char* filename : extraObjFilenames)
+    {
+        RenderableObject* mesh = new RenderableObject(filename, &material, loadOptions);
+        mesh->RotationAngles = renderable.RotationAngles;
+        mesh->CenterOnBoundingBox = true;
+        meshes.push_back(mesh);
+    }
+    bool meshesPlaced = false;
+    RenderQueue renderQueue;
+
+    SceneGraph sceneGraph;
+    SceneRenderer scene(&sceneGraph);
+    Shader* sceneShader = NULL;
+    std::vector<Material> sceneMaterials;
+    if (sceneMode && !SceneRenderer::IsSupported())
+    {
+        fprintf(stderr, "Multi draw indirect needs OpenGL 4.3, drawing objects one by one instead\n");
+        sceneMode = false;
+    }
+    if (sceneMode)
+    {
+        sceneShader = new Shader(ExecutableDirectory + "\\scene.vert", ExecutableDirectory + "\\scene.frag", SceneRenderer::ShaderDefines());
+    }
+
     float fov = 1.570796326f; //pi/2 radians
     float aspectRatio = (float)WINDOW_WIDTH / (float)WINDOW_HEIGHT;
     cyMatrix4f perspectiveTransform = cyMatrix4f::Perspective(fov, aspectRatio, 1, 1000.0);
@@ -221,17 +594,272 @@ int main(int argc, char* argv[])
     glEnable(GL_DEPTH_TEST);
     glEnable(GL_CULL_FACE);
 
+    //Benchmark modes: frame times are measured without vsync and reported every couple of seconds
+    InstanceBuffer instances;
+    bool instancesPlaced = false;
+    bool benchmarkMode = instanceCount > 0 || sceneMode || meshes.size() > 1 || pointLightCount > 0 || virtualLightCount > 0 || headlessFrames > 0;
+    if (benchmarkMode)
+    {
+        glfwSwapInterval(0);
+    }
+    //Frame times need every frame drawn, and moving point lights change every frame
+    continuousRedraw = continuousRedraw || benchmarkMode;
+
+    //Point lights are spread over the objects once their size is known
+    LightClusterGrid* lightClusters = pointLightCount > 0 ? new LightClusterGrid() : NULL;
+    std::vector<PointLight> pointLights;
+    std::vector<cyVec3f> pointLightBases;
+    LightingGridBuffers* lightingGrid = virtualLightCount > 0 ? new LightingGridBuffers() : NULL;
+    bool virtualLightsBuilt = false;
+
+    //Only objects drawn one by one cast shadows; instances and the packed scene do not
+    PointLightShadow* pointShadow = NULL;
+    if (shadows && (sceneMode || instanceCount > 0))
+    {
+        fprintf(stderr, "Shadows are only drawn for objects drawn one by one, ignoring -shadows\n");
+    }
+    else if (shadows)
+    {
+        pointShadow = new PointLightShadow(ExecutableDirectory);
+        if (!pointShadow->IsValid())
+        {
+            delete pointShadow;
+            pointShadow = NULL;
+        }
+    }
+    if (ProgramBinaryCache::IsEnabled())
+    {
+        fprintf(stdout, "Status: Loaded %u of %u programs from the program binary cache\n", ProgramBinaryCache::GetHitCount(),
+            ProgramBinaryCache::GetHitCount() + ProgramBinaryCache::GetMissCount());
+    }
+    //Headless runs draw into an offscreen target throughout; the path is recorded once every mesh is loaded
+    cy::GLRenderTexture2D offscreenTarget;
+    BenchmarkRecorder* recorder = NULL;
+    bool recording = false;
+    if (headlessFrames > 0)
+    {
+        offscreenTarget.Initialize(true, 4, WINDOW_WIDTH, WINDOW_HEIGHT);
+        offscreenTarget.Bind();
+        GLStateCache::Invalidate();
+        recorder = new BenchmarkRecorder(headlessFrames);
+    }
+
+    double reportStartTime = glfwGetTime();
+    unsigned int reportFrames = 0;
+
     while (!glfwWindowShouldClose(window))
     {
+        if (!continuousRedraw && !redrawRequested)
+        {
+            glfwWaitEventsTimeout(IDLE_EVENT_TIMEOUT);
+            continue;
+        }
+        redrawRequested = false;
+        TRACE_SCOPE("frame");
+
+        if (recording)
+        {
+            float pathTime = headlessFrames > 1 ? (float)recorder->GetRecordedFrameCount() / (headlessFrames - 1) : 0.0f;
+            BenchmarkKeyframe keyframe = benchmarkPath.Evaluate(pathTime);
+            cameraAngleX = keyframe.CameraAngleX;
+            cameraAngleY = keyframe.CameraAngleY;
+            cameraDistance = keyframe.CameraDistance;
+            lightAngleX = keyframe.LightAngleX;
+            lightAngleY = keyframe.LightAngleY;
+            updateCamera();
+            updateLight();
+            recorder->BeginFrame();
+        }
+        if (profiler)
+        {
+            profiler->BeginFrame();
+            profiler->BeginScope("frame", PROFILE_CPU_GPU);
+        }
+
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-        shader.Draw(&renderable, &light, &camera, perspectiveTransform, ambientIntensity);
+        bool loaded;
+        bool allLoaded;
+        {
+            ProfileScope uploadScope(profiler, "upload", PROFILE_CPU_GPU);
+            TRACE_SCOPE("upload");
+            loaded = renderable.ContinueLoading();
+            allLoaded = loaded;
+            for (size_t i = 1; i < meshes.size(); i++)
+            {
+                allLoaded = meshes[i]->ContinueLoading() && allLoaded;
+            }
+        }
+        //Streaming uploads a part per frame, so frames keep coming until every mesh is on the GPU
+        if (!allLoaded)
+        {
+            redrawRequested = true;
+        }
+        float objectSpacing = 2.5f * renderable.GetBoundingRadius();
+        float lightFieldRadius = 0.5f * objectSpacing * sqrtf((float)std::max((size_t)instanceCount, meshes.size())) + objectSpacing;
+        if (lightingGrid && allLoaded && !virtualLightsBuilt)
+        {
+            cy::Timer timer;
+            timer.Start();
+            cy::LightingGridHierarchy hierarchy;
+            if (buildVirtualLights(hierarchy, virtualLightCount, lightFieldRadius, objectSpacing) && lightingGrid->Export(hierarchy, 2.0f))
+            {
+                fprintf(stdout, "Status: Built a %u level lighting grid hierarchy of %u lights (%u exported) in %.1f ms\n",
+                    lightingGrid->GetLevelCount(), virtualLightCount, lightingGrid->GetExportedLightCount(), timer.Stop() * 1000.0);
+            }
+            virtualLightsBuilt = true;
+        }
+        if (lightClusters)
+        {
+            ProfileScope clusterScope(profiler, "light clusters", PROFILE_CPU_GPU);
+            TRACE_SCOPE("light clusters");
+            if (allLoaded && pointLights.empty())
+            {
+                fillLights(pointLights, pointLightBases, pointLightCount, lightFieldRadius, objectSpacing);
+            }
+            moveLights(pointLights, pointLightBases, (float)glfwGetTime());
+            lightClusters->Build(pointLights.data(), (unsigned int)pointLights.size(), camera.GetCameraTransform(), perspectiveTransform, WINDOW_WIDTH, WINDOW_HEIGHT);
+        }
+        if (sceneMode)
+        {
+            if (allLoaded && !scene.IsBuilt())
+            {
+                fillScene(scene, sceneGraph, meshes, sceneMaterials, instanceCount > 0 ? instanceCount : (unsigned int)meshes.size());
+                scene.Build();
+            }
+            sceneGraph.Update(true);
+            ProfileScope opaqueScope(profiler, "opaque pass", PROFILE_CPU_GPU);
+            TRACE_SCOPE("opaque pass");
+            sceneShader->BeginFrame(&light, &camera, perspectiveTransform, ambientIntensity, lightClusters, lightingGrid);
+            sceneShader->DrawScene(&scene);
+            sceneShader->EndFrame();
+        }
+        else
+        {
+            if (instanceCount == 0 && allLoaded && !meshesPlaced)
+            {
+                placeInRow(meshes);
+                meshesPlaced = true;
+            }
+            if (pointShadow)
+            {
+                ProfileScope shadowScope(profiler, "shadow pass", PROFILE_CPU_GPU);
+                TRACE_SCOPE("shadow pass");
+                pointShadow->Update(light, meshes);
+            }
+            ProfileScope opaqueScope(profiler, "opaque pass", PROFILE_CPU_GPU);
+            TRACE_SCOPE("opaque pass");
+            shader.BeginFrame(&light, &camera, perspectiveTransform, ambientIntensity, lightClusters, lightingGrid, pointShadow);
+            if (instanceCount > 0)
+            {
+                if (loaded && !instancesPlaced)
+                {
+                    fillInstanceField(instances, instanceCount, 2.5f * renderable.GetBoundingRadius());
+                    instancesPlaced = true;
+                }
+                shader.DrawInstanced(&renderable, &instances);
+            }
+            else
+            {
+                renderQueue.Clear();
+                for (RenderableObject* mesh : meshes)
+                {
+                    renderQueue.Add(&shader, mesh, camera.GetCameraTransform());
+                }
+                renderQueue.Sort();
+                renderQueue.Submit();
+            }
+            shader.EndFrame();
+        }
+
+        if (profiler)
+        {
+            profiler->EndScope();
+            profiler->EndFrame();
+        }
+        if (recorder)
+        {
+            if (recording)
+            {
+                recorder->EndFrame();
+                if (recorder->IsComplete())
+                {
+                    const char* mode = sceneMode ? "scene" : instanceCount > 0 ? "instances" : "queue";
+                    if (recorder->WriteJson(benchmarkOutputFilename, objFilename, mode, WINDOW_WIDTH, WINDOW_HEIGHT) && benchmarkOutputFilename)
+                    {
+                        fprintf(stdout, "Status: Wrote %u benchmark frames to %s\n", recorder->GetRecordedFrameCount(), benchmarkOutputFilename);
+                    }
+                    glfwSetWindowShouldClose(window, GLFW_TRUE);
+                }
+            }
+            //Meshes are placed and lights built on the frame loading completes, so the path starts on the next one
+            recording = allLoaded;
+        }
+        else
+        {
+            glfwSwapBuffers(window);
+        }
+        GLStateCache::EndFrame();
 
-        glfwSwapBuffers(window);
+        reportFrames++;
+        double reportTime = glfwGetTime() - reportStartTime;
+        if (reportTime >= 2.0 && benchmarkMode)
+        {
+            double frameTime = 1000.0 * reportTime / reportFrames;
+            if (sceneMode)
+            {
+                const SceneCullingStats& culling = scene.GetCullingStats();
+                fprintf(stdout, "Status: %u scene objects in %u indirect draws, %.3f ms per frame, %u triangles drawn\n",
+                    scene.GetObjectCount(), scene.GetDrawCount(), frameTime, scene.GetDrawnTriangleCount());
+                fprintf(stdout, "Status: Culling tested %u BVH nodes (%u visible) and %u objects, %u objects visible\n",
+                    culling.TestedNodes, culling.VisibleNodes, culling.TestedObjects, culling.VisibleObjects);
+            }
+            else if (instanceCount > 0)
+            {
+                fprintf(stdout, "Status: %u instances, %.3f ms per frame, %u triangles drawn\n",
+                    instanceCount, frameTime, renderable.GetDrawnTriangleCount());
+            }
+            else
+            {
+                fprintf(stdout, "Status: %u queued objects, %.3f ms per frame\n", renderQueue.Count(), frameTime);
+            }
+            fprintf(stdout, "Status: %u shader variant(s) compiled\n", sceneMode ? sceneShader->GetReadyVariantCount() : shader.GetReadyVariantCount());
+            if (lightClusters)
+            {
+                fprintf(stdout, "Status: %u point lights binned in %.3f ms, %u cluster list entries, at most %u lights per cluster\n",
+                    lightClusters->GetLightCount(), lightClusters->GetBuildTime(), lightClusters->GetListedLightCount(), lightClusters->GetMaxClusterLightCount());
+            }
+            if (pointShadow)
+            {
+                fprintf(stdout, "Status: Shadow cube map drawn %u times so far, far plane %.1f\n", pointShadow->GetRenderCount(), pointShadow->GetFarPlane());
+            }
+            printStateCounters();
+            reportStartTime += reportTime;
+            reportFrames = 0;
+        }
 
         glfwPollEvents();
     }
 
+    for (size_t i = 1; i < meshes.size(); i++)
+    {
+        delete meshes[i];
+    }
+    delete sceneShader;
+    delete lightClusters;
+    delete lightingGrid;
+    delete pointShadow;
+    delete recorder;
+    if (profiler && profileCsvFilename && profiler->WriteCsv(profileCsvFilename))
+    {
+        fprintf(stdout, "Status: Wrote profile to %s\n", profileCsvFilename);
+    }
+    delete profiler;
+    if (traceFilename && TraceProfiler::WriteChromeTrace(traceFilename))
+    {
+        fprintf(stdout, "Status: Wrote trace to %s\n", traceFilename);
+    }
+
     glfwDestroyWindow(window);
 
     glfwTerminate();
@@ -0,0 +1,113 @@
+#include "MappedFile.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+MappedFile::MappedFile()
+{
+	FileData = NULL;
+	FileSize = 0;
+#ifdef _WIN32
+	FileHandle = INVALID_HANDLE_VALUE;
+	MappingHandle = NULL;
+#endif
+}
+
+MappedFile::~MappedFile()
+{
+	Close();
+}
+
+bool MappedFile::Open(const char* filename)
+{
+	Close();
+#ifdef _WIN32
+	FileHandle = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (FileHandle == INVALID_HANDLE_VALUE)
+	{
+		return false;
+	}
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(FileHandle, &size))
+	{
+		Close();
+		return false;
+	}
+	if (size.QuadPart == 0)
+	{
+		return true;
+	}
+	MappingHandle = CreateFileMappingA(FileHandle, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (MappingHandle == NULL)
+	{
+		Close();
+		return false;
+	}
+	FileData = (const char*)MapViewOfFile(MappingHandle, FILE_MAP_READ, 0, 0, 0);
+	FileSize = (size_t)size.QuadPart;
+#else
+	int fd = open(filename, O_RDONLY);
+	if (fd < 0)
+	{
+		return false;
+	}
+	struct stat st;
+	if (fstat(fd, &st) != 0)
+	{
+		close(fd);
+		return false;
+	}
+	if (st.st_size == 0)
+	{
+		close(fd);
+		return true;
+	}
+	void* data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (data != MAP_FAILED)
+	{
+		madvise(data, (size_t)st.st_size, MADV_SEQUENTIAL);
+		FileData = (const char*)data;
+		FileSize = (size_t)st.st_size;
+	}
+#endif
+	if (FileData == NULL)
+	{
+		Close();
+		return false;
+	}
+	return true;
+}
+
+void MappedFile::Close()
+{
+#ifdef _WIN32
+	if (FileData != NULL)
+	{
+		UnmapViewOfFile(FileData);
+	}
+	if (MappingHandle != NULL)
+	{
+		CloseHandle(MappingHandle);
+	}
+	if (FileHandle != INVALID_HANDLE_VALUE)
+	{
+		CloseHandle(FileHandle);
+	}
+	MappingHandle = NULL;
+	FileHandle = INVALID_HANDLE_VALUE;
+#else
+	if (FileData != NULL)
+	{
+		munmap((void*)FileData, FileSize);
+	}
+#endif
+	FileData = NULL;
+	FileSize = 0;
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <stddef.h>
+
+//Read only memory mapping of a whole file. Empty files open successfully with a NULL Data.
+class MappedFile
+{
+public:
+	MappedFile();
+	~MappedFile();
+
+	bool Open(const char* filename);
+	void Close();
+
+	const char* Data() const { return FileData; }
+	size_t Size() const { return FileSize; }
+
+private:
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+
+	const char* FileData;
+	size_t FileSize;
+#ifdef _WIN32
+	//HANDLEs, kept as void* so windows.h stays inside MappedFile.cpp
+	void* FileHandle;
+	void* MappingHandle;
+#endif
+};
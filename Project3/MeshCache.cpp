@@ -0,0 +1,299 @@
+#include "MeshCache.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+static const char MeshCacheMagic[8] = { 'C', 'Y', 'M', 'E', 'S', 'H', 0, 0 };
+
+//Arrays following the header, in file order. Streams the mesh does not use are stored empty.
+enum MeshCacheSection
+{
+	MeshCachePositions,
+	MeshCacheNormals,
+	MeshCacheTexCoords,
+	MeshCachePackedVertices,
+	MeshCacheShortIndices,
+	MeshCacheWideIndices,
+	MeshCacheSubmeshes,
+	MeshCacheLods,
+	MeshCacheMeshlets,
+	MeshCacheMeshletVertexEnds,
+	MeshCacheSectionCount
+};
+
+struct MeshCacheHeader
+{
+	char Magic[8];
+	unsigned int Version;
+	unsigned int HeaderSize;
+	unsigned int Flags;
+	unsigned int HasBaseVertices;
+	unsigned long long ObjFileSize;
+	long long ObjModifiedTime;
+	unsigned int VertexCount;
+	unsigned int IndexCount;
+	unsigned int SubmeshCount;
+	unsigned int LodCount;
+	unsigned int MeshletCount;
+	float BoundMin[3];
+	float BoundMax[3];
+	unsigned long long SectionOffsets[MeshCacheSectionCount];
+	unsigned long long SectionSizes[MeshCacheSectionCount];
+	unsigned long long FileSize;
+};
+
+static bool getObjFileStamp(const char* objFilename, unsigned long long& size, long long& modifiedTime)
+{
+#ifdef _WIN32
+	struct _stat64 st;
+	if (_stat64(objFilename, &st) != 0)
+	{
+		return false;
+	}
+#else
+	struct stat st;
+	if (stat(objFilename, &st) != 0)
+	{
+		return false;
+	}
+#endif
+	size = (unsigned long long)st.st_size;
+	modifiedTime = (long long)st.st_mtime;
+	return true;
+}
+
+//Bytes a section takes when it is not empty.
+static unsigned long long sectionElementSize(const MeshCacheHeader& header, int section)
+{
+	switch (section)
+	{
+	case MeshCachePositions: return header.VertexCount * (unsigned long long)sizeof(cyVec3f);
+	case MeshCacheNormals: return header.VertexCount * (unsigned long long)sizeof(cyVec3f);
+	case MeshCacheTexCoords: return header.VertexCount * (unsigned long long)sizeof(cyVec2f);
+	case MeshCachePackedVertices: return header.VertexCount * (unsigned long long)sizeof(PackedVertex);
+	case MeshCacheShortIndices: return header.IndexCount * (unsigned long long)sizeof(unsigned short);
+	case MeshCacheWideIndices: return header.IndexCount * (unsigned long long)sizeof(int);
+	case MeshCacheSubmeshes: return header.SubmeshCount * (unsigned long long)sizeof(Submesh);
+	case MeshCacheLods: return header.LodCount * (unsigned long long)sizeof(RenderLod);
+	case MeshCacheMeshlets: return header.MeshletCount * (unsigned long long)sizeof(Meshlet);
+	default: return header.MeshletCount * (unsigned long long)sizeof(unsigned int);
+	}
+}
+
+static unsigned long long alignOffset(unsigned long long offset)
+{
+	return (offset + 15) & ~15ull;
+}
+
+//Writes zero padding up to targetOffset, then the data. offset tracks the current end of the file.
+static bool writeAtOffset(FILE* file, unsigned long long& offset, unsigned long long targetOffset, const void* data, size_t size)
+{
+	static const char padding[16] = { 0 };
+	while (offset < targetOffset)
+	{
+		size_t paddingSize = (size_t)(targetOffset - offset < sizeof(padding) ? targetOffset - offset : sizeof(padding));
+		if (fwrite(padding, 1, paddingSize, file) != paddingSize)
+		{
+			return false;
+		}
+		offset += paddingSize;
+	}
+	if (size > 0 && fwrite(data, 1, size, file) != size)
+	{
+		return false;
+	}
+	offset += size;
+	return true;
+}
+
+MeshCache::MeshCache()
+{
+	Header = NULL;
+}
+
+std::string MeshCache::CacheFilenameForObj(const char* objFilename)
+{
+	std::string cacheFilename(objFilename);
+	size_t extensionStart = cacheFilename.find_last_of('.');
+	size_t directoryEnd = cacheFilename.find_last_of("\\/");
+	if (extensionStart != std::string::npos && (directoryEnd == std::string::npos || extensionStart > directoryEnd))
+	{
+		cacheFilename.erase(extensionStart);
+	}
+	cacheFilename.append(".cymesh");
+	return cacheFilename;
+}
+
+bool MeshCache::Write(const char* cacheFilename, const char* objFilename, unsigned int flags, const PreparedMeshView& mesh)
+{
+	MeshCacheHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.Magic, MeshCacheMagic, sizeof(header.Magic));
+	header.Version = MESH_CACHE_VERSION;
+	header.HeaderSize = sizeof(MeshCacheHeader);
+	header.Flags = flags;
+	if (!getObjFileStamp(objFilename, header.ObjFileSize, header.ObjModifiedTime))
+	{
+		return false;
+	}
+	header.HasBaseVertices = mesh.HasBaseVertices ? 1 : 0;
+	header.VertexCount = mesh.VertexCount;
+	header.IndexCount = mesh.IndexCount;
+	header.SubmeshCount = mesh.SubmeshCount;
+	header.LodCount = mesh.LodCount;
+	header.MeshletCount = mesh.MeshletCount;
+	for (int i = 0; i < 3; i++)
+	{
+		header.BoundMin[i] = (&mesh.BoundMin.x)[i];
+		header.BoundMax[i] = (&mesh.BoundMax.x)[i];
+	}
+
+	const void* sections[MeshCacheSectionCount] = { mesh.Positions, mesh.Normals, mesh.TexCoords, mesh.PackedVertices,
+		mesh.ShortIndices, mesh.WideIndices, mesh.Submeshes, mesh.Lods, mesh.Meshlets, mesh.MeshletVertexEnds };
+	unsigned long long sectionEnd = sizeof(MeshCacheHeader);
+	for (int i = 0; i < MeshCacheSectionCount; i++)
+	{
+		header.SectionOffsets[i] = alignOffset(sectionEnd);
+		header.SectionSizes[i] = sections[i] ? sectionElementSize(header, i) : 0;
+		sectionEnd = header.SectionOffsets[i] + header.SectionSizes[i];
+	}
+	header.FileSize = sectionEnd;
+
+	//Write to a temporary file first so an interrupted write never leaves a truncated cache behind.
+	std::string temporaryFilename(cacheFilename);
+	temporaryFilename.append(".tmp");
+	FILE* file = fopen(temporaryFilename.c_str(), "wb");
+	if (!file)
+	{
+		return false;
+	}
+
+	unsigned long long offset = 0;
+	bool success = writeAtOffset(file, offset, 0, &header, sizeof(header));
+	for (int i = 0; i < MeshCacheSectionCount; i++)
+	{
+		success = success && writeAtOffset(file, offset, header.SectionOffsets[i], sections[i], (size_t)header.SectionSizes[i]);
+	}
+	success = (fclose(file) == 0) && success;
+
+	if (success)
+	{
+		remove(cacheFilename);
+		success = rename(temporaryFilename.c_str(), cacheFilename) == 0;
+	}
+	if (!success)
+	{
+		remove(temporaryFilename.c_str());
+	}
+	return success;
+}
+
+bool MeshCache::Open(const char* cacheFilename, const char* objFilename, unsigned int flags)
+{
+	Header = NULL;
+	unsigned long long objFileSize;
+	long long objModifiedTime;
+	if (!getObjFileStamp(objFilename, objFileSize, objModifiedTime) || !File.Open(cacheFilename))
+	{
+		return false;
+	}
+
+	const MeshCacheHeader* header = (const MeshCacheHeader*)File.Data();
+	if (File.Size() < sizeof(MeshCacheHeader) ||
+		memcmp(header->Magic, MeshCacheMagic, sizeof(header->Magic)) != 0 ||
+		header->Version != MESH_CACHE_VERSION || header->HeaderSize != sizeof(MeshCacheHeader) ||
+		header->Flags != flags ||
+		header->FileSize != File.Size() ||
+		header->ObjFileSize != objFileSize || header->ObjModifiedTime != objModifiedTime ||
+		header->LodCount == 0)
+	{
+		File.Close();
+		return false;
+	}
+
+	//Every section either holds exactly its elements or is empty, and ends before the next one starts
+	unsigned long long sectionEnd = sizeof(MeshCacheHeader);
+	for (int i = 0; i < MeshCacheSectionCount; i++)
+	{
+		if (header->SectionOffsets[i] < sectionEnd ||
+			(header->SectionSizes[i] != 0 && header->SectionSizes[i] != sectionElementSize(*header, i)))
+		{
+			File.Close();
+			return false;
+		}
+		sectionEnd = header->SectionOffsets[i] + header->SectionSizes[i];
+	}
+	if (sectionEnd > header->FileSize)
+	{
+		File.Close();
+		return false;
+	}
+
+	//Ranges are checked once here so drawing never reads past the buffers
+	const Submesh* submeshes = (const Submesh*)(File.Data() + header->SectionOffsets[MeshCacheSubmeshes]);
+	const RenderLod* lods = (const RenderLod*)(File.Data() + header->SectionOffsets[MeshCacheLods]);
+	const Meshlet* meshlets = (const Meshlet*)(File.Data() + header->SectionOffsets[MeshCacheMeshlets]);
+	const unsigned int* meshletVertexEnds = (const unsigned int*)(File.Data() + header->SectionOffsets[MeshCacheMeshletVertexEnds]);
+	bool valid = header->SectionSizes[MeshCacheSubmeshes] != 0 && header->SectionSizes[MeshCacheLods] != 0 &&
+		(header->MeshletCount == 0 || (header->SectionSizes[MeshCacheMeshlets] != 0 && header->SectionSizes[MeshCacheMeshletVertexEnds] != 0));
+	for (unsigned int i = 0; valid && i < header->LodCount; i++)
+	{
+		valid = (unsigned long long)lods[i].FirstSubmesh + lods[i].SubmeshCount <= header->SubmeshCount &&
+			(unsigned long long)lods[i].FirstMeshlet + lods[i].MeshletCount <= header->MeshletCount;
+	}
+	for (unsigned int i = 0; valid && i < header->SubmeshCount; i++)
+	{
+		valid = (unsigned long long)submeshes[i].FirstIndex + submeshes[i].IndexCount <= header->IndexCount;
+	}
+	for (unsigned int i = 0; valid && i < header->MeshletCount; i++)
+	{
+		valid = (unsigned long long)meshlets[i].FirstIndex + meshlets[i].IndexCount <= header->IndexCount &&
+			meshletVertexEnds[i] <= header->VertexCount;
+	}
+	if (!valid)
+	{
+		File.Close();
+		return false;
+	}
+
+	Header = header;
+	return true;
+}
+
+void MeshCache::Close()
+{
+	File.Close();
+	Header = NULL;
+}
+
+PreparedMeshView MeshCache::View() const
+{
+	const void* sections[MeshCacheSectionCount];
+	for (int i = 0; i < MeshCacheSectionCount; i++)
+	{
+		sections[i] = Header->SectionSizes[i] != 0 ? File.Data() + Header->SectionOffsets[i] : NULL;
+	}
+
+	PreparedMeshView view;
+	view.Positions = (const cyVec3f*)sections[MeshCachePositions];
+	view.Normals = (const cyVec3f*)sections[MeshCacheNormals];
+	view.TexCoords = (const cyVec2f*)sections[MeshCacheTexCoords];
+	view.PackedVertices = (const PackedVertex*)sections[MeshCachePackedVertices];
+	view.VertexCount = Header->VertexCount;
+	view.ShortIndices = (const unsigned short*)sections[MeshCacheShortIndices];
+	view.WideIndices = (const int*)sections[MeshCacheWideIndices];
+	view.IndexCount = Header->IndexCount;
+	view.Submeshes = (const Submesh*)sections[MeshCacheSubmeshes];
+	view.SubmeshCount = Header->SubmeshCount;
+	view.Lods = (const RenderLod*)sections[MeshCacheLods];
+	view.LodCount = Header->LodCount;
+	view.Meshlets = (const Meshlet*)sections[MeshCacheMeshlets];
+	view.MeshletVertexEnds = (const unsigned int*)sections[MeshCacheMeshletVertexEnds];
+	view.MeshletCount = Header->MeshletCount;
+	view.HasBaseVertices = Header->HasBaseVertices != 0;
+	view.BoundMin = cyVec3f(Header->BoundMin[0], Header->BoundMin[1], Header->BoundMin[2]);
+	view.BoundMax = cyVec3f(Header->BoundMax[0], Header->BoundMax[1], Header->BoundMax[2]);
+	return view;
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <string>
+#include "cyVector.h"
+#include "MappedFile.h"
+#include "PreparedMesh.h"
+
+//Bump whenever the layout of the cache file or the way RenderableObject prepares meshes changes.
+#define MESH_CACHE_VERSION 7
+
+//Flags recording the load options the cached mesh was prepared with.
+#define MESH_CACHE_OVERDRAW_OPTIMIZED 1
+#define MESH_CACHE_SHORT_INDICES 2
+#define MESH_CACHE_LODS 4
+#define MESH_CACHE_LAYOUT_SHIFT 8 //the VertexLayout goes in the bits from here up
+
+struct MeshCacheHeader;
+
+//Versioned binary cache (.cymesh) of an obj file as RenderableObject uploads it: the vertex streams in the chosen
+//layout, the index buffer of every LOD with its submeshes, the meshlets and the bounding box. Opened caches are memory
+//mapped so the streams can be handed straight to glBufferSubData without preparing the mesh again.
+class MeshCache
+{
+public:
+	MeshCache();
+
+	static std::string CacheFilenameForObj(const char* objFilename);
+
+	//Writes mesh stamped with the obj file's size and modification time.
+	static bool Write(const char* cacheFilename, const char* objFilename, unsigned int flags, const PreparedMeshView& mesh);
+
+	//Maps the cache. Fails if it is missing, has another version or flags, or no longer matches the obj file.
+	bool Open(const char* cacheFilename, const char* objFilename, unsigned int flags);
+	void Close();
+
+	//Pointers into the mapped file, valid while this MeshCache is open.
+	PreparedMeshView View() const;
+
+private:
+	MappedFile File;
+	const MeshCacheHeader* Header;
+};
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <vector>
+#include "cyVector.h"
+
+//Simplified level of detail: a range of the LOD index buffer drawn with the full detail vertex streams.
+struct MeshLod
+{
+	unsigned int FirstIndex;
+	unsigned int IndexCount;
+	float Error; //object space distance the surface may move compared to full detail
+};
+
+//Read only pointers to the streams of a MeshData.
+struct MeshDataView
+{
+	const cyVec3f* Positions;
+	const cyVec3f* Normals;
+	const cyVec2f* TexCoords;
+	unsigned int VertexCount;
+	const int* Indices;
+	unsigned int IndexCount;
+	const int* LodIndices;
+	const MeshLod* Lods;
+	unsigned int LodCount;
+
+	cyVec3f BoundMin;
+	cyVec3f BoundMax;
+};
+
+//GPU ready mesh: one entry per welded vertex in each vertex stream and three indices per triangle.
+struct MeshData
+{
+	std::vector<cyVec3f> Positions;
+	std::vector<cyVec3f> Normals;
+	std::vector<cyVec2f> TexCoords;
+	std::vector<int> Indices;
+	std::vector<int> LodIndices; //index buffers of all simplified levels, coarser levels last
+	std::vector<MeshLod> Lods;
+
+	cyVec3f BoundMin;
+	cyVec3f BoundMax;
+
+	unsigned int VertexCount() const { return (unsigned int)Positions.size(); }
+	unsigned int IndexCount() const { return (unsigned int)Indices.size(); }
+
+	MeshDataView View() const
+	{
+		MeshDataView view;
+		view.Positions = Positions.data();
+		view.Normals = Normals.data();
+		view.TexCoords = TexCoords.data();
+		view.VertexCount = VertexCount();
+		view.Indices = Indices.data();
+		view.IndexCount = IndexCount();
+		view.LodIndices = LodIndices.data();
+		view.Lods = Lods.data();
+		view.LodCount = (unsigned int)Lods.size();
+		view.BoundMin = BoundMin;
+		view.BoundMax = BoundMax;
+		return view;
+	}
+};
@@ -0,0 +1,451 @@
+#include "MeshOptimizer.h"
+
+#include <algorithm>
+#include <stdio.h>
+
+VertexCacheStatistics AnalyzeVertexCache(const int* indices, unsigned int indexCount, unsigned int vertexCount, unsigned int cacheSize)
+{
+	//A vertex is in the FIFO if it entered less than cacheSize misses ago
+	std::vector<unsigned int> cacheEntryTime(vertexCount, 0);
+	unsigned int misses = 0;
+	for (unsigned int i = 0; i < indexCount; i++)
+	{
+		unsigned int vertex = indices[i];
+		if (cacheEntryTime[vertex] == 0 || misses - cacheEntryTime[vertex] >= cacheSize)
+		{
+			misses++;
+			cacheEntryTime[vertex] = misses;
+		}
+	}
+
+	VertexCacheStatistics statistics;
+	statistics.TransformedVertices = misses;
+	statistics.ACMR = indexCount > 0 ? misses / (indexCount / 3.0f) : 0.0f;
+	statistics.ATVR = vertexCount > 0 ? misses / (float)vertexCount : 0.0f;
+	return statistics;
+}
+
+static int skipDeadEnd(std::vector<int>& deadEndStack, const std::vector<unsigned int>& liveTriangles, unsigned int& cursor, unsigned int vertexCount)
+{
+	while (!deadEndStack.empty())
+	{
+		int vertex = deadEndStack.back();
+		deadEndStack.pop_back();
+		if (liveTriangles[vertex] > 0)
+		{
+			return vertex;
+		}
+	}
+	while (cursor < vertexCount)
+	{
+		if (liveTriangles[cursor] > 0)
+		{
+			return cursor;
+		}
+		cursor++;
+	}
+	return -1;
+}
+
+void OptimizeVertexCache(std::vector<int>& indices, unsigned int vertexCount, std::vector<unsigned int>& clusterStarts, unsigned int cacheSize)
+{
+	unsigned int triangleCount = (unsigned int)indices.size() / 3;
+	clusterStarts.clear();
+	if (triangleCount == 0)
+	{
+		return;
+	}
+
+	//Triangles adjacent to each vertex, in compressed row form
+	std::vector<unsigned int> liveTriangles(vertexCount, 0);
+	for (size_t i = 0; i < indices.size(); i++)
+	{
+		liveTriangles[indices[i]]++;
+	}
+	std::vector<unsigned int> adjacencyOffsets(vertexCount + 1, 0);
+	for (unsigned int v = 0; v < vertexCount; v++)
+	{
+		adjacencyOffsets[v + 1] = adjacencyOffsets[v] + liveTriangles[v];
+	}
+	std::vector<unsigned int> adjacency(indices.size());
+	std::vector<unsigned int> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+	for (unsigned int t = 0; t < triangleCount; t++)
+	{
+		for (int j = 0; j < 3; j++)
+		{
+			adjacency[fill[indices[t * 3 + j]]++] = t;
+		}
+	}
+
+	std::vector<unsigned int> cacheTime(vertexCount, 0);
+	std::vector<bool> emitted(triangleCount, false);
+	std::vector<int> deadEndStack;
+	std::vector<int> candidates;
+	std::vector<int> output;
+	output.reserve(indices.size());
+
+	unsigned int timeStamp = cacheSize + 1;
+	unsigned int cursor = 0;
+	int fanningVertex = skipDeadEnd(deadEndStack, liveTriangles, cursor, vertexCount);
+	clusterStarts.push_back(0);
+
+	while (fanningVertex >= 0)
+	{
+		candidates.clear();
+		for (unsigned int a = adjacencyOffsets[fanningVertex]; a < adjacencyOffsets[fanningVertex + 1]; a++)
+		{
+			unsigned int t = adjacency[a];
+			if (emitted[t])
+			{
+				continue;
+			}
+			for (int j = 0; j < 3; j++)
+			{
+				int vertex = indices[t * 3 + j];
+				output.push_back(vertex);
+				deadEndStack.push_back(vertex);
+				candidates.push_back(vertex);
+				liveTriangles[vertex]--;
+				if (timeStamp - cacheTime[vertex] > cacheSize)
+				{
+					cacheTime[vertex] = timeStamp;
+					timeStamp++;
+				}
+			}
+			emitted[t] = true;
+		}
+
+		//Prefer the candidate that stays in the cache longest while all its triangles are emitted
+		int nextVertex = -1;
+		int bestPriority = -1;
+		for (int vertex : candidates)
+		{
+			if (liveTriangles[vertex] == 0)
+			{
+				continue;
+			}
+			int priority = 0;
+			if (timeStamp - cacheTime[vertex] + 2 * liveTriangles[vertex] <= cacheSize)
+			{
+				priority = timeStamp - cacheTime[vertex];
+			}
+			if (priority > bestPriority)
+			{
+				bestPriority = priority;
+				nextVertex = vertex;
+			}
+		}
+		if (nextVertex < 0)
+		{
+			nextVertex = skipDeadEnd(deadEndStack, liveTriangles, cursor, vertexCount);
+			//A vertex that has left the cache starts a new cluster for the overdraw pass
+			if (nextVertex >= 0 && timeStamp - cacheTime[nextVertex] > cacheSize && output.size() / 3 > clusterStarts.back())
+			{
+				clusterStarts.push_back((unsigned int)(output.size() / 3));
+			}
+		}
+		fanningVertex = nextVertex;
+	}
+
+	indices.swap(output);
+}
+
+struct OverdrawCluster
+{
+	unsigned int FirstTriangle;
+	unsigned int TriangleCount;
+	float SortKey;
+};
+
+void OptimizeOverdraw(std::vector<int>& indices, const std::vector<cyVec3f>& positions, const std::vector<unsigned int>& clusterStarts)
+{
+	unsigned int triangleCount = (unsigned int)indices.size() / 3;
+	if (clusterStarts.size() < 2)
+	{
+		return;
+	}
+
+	cyVec3f meshCentroid(0, 0, 0);
+	float meshArea = 0;
+	std::vector<OverdrawCluster> clusters(clusterStarts.size());
+	std::vector<cyVec3f> clusterCentroids(clusters.size());
+	std::vector<cyVec3f> clusterNormals(clusters.size());
+	for (size_t c = 0; c < clusters.size(); c++)
+	{
+		unsigned int first = clusterStarts[c];
+		unsigned int end = c + 1 < clusterStarts.size() ? clusterStarts[c + 1] : triangleCount;
+		clusters[c].FirstTriangle = first;
+		clusters[c].TriangleCount = end - first;
+
+		cyVec3f centroid(0, 0, 0);
+		cyVec3f normal(0, 0, 0);
+		float area = 0;
+		for (unsigned int t = first; t < end; t++)
+		{
+			const cyVec3f& p0 = positions[indices[t * 3]];
+			const cyVec3f& p1 = positions[indices[t * 3 + 1]];
+			const cyVec3f& p2 = positions[indices[t * 3 + 2]];
+			cyVec3f areaNormal = (p1 - p0).Cross(p2 - p0);
+			float triangleArea = areaNormal.Length();
+			centroid += (p0 + p1 + p2) * (triangleArea / 3.0f);
+			normal += areaNormal;
+			area += triangleArea;
+		}
+		meshCentroid += centroid;
+		meshArea += area;
+		clusterCentroids[c] = area > 0 ? centroid / area : positions[indices[first * 3]];
+		clusterNormals[c] = normal;
+	}
+	if (meshArea > 0)
+	{
+		meshCentroid /= meshArea;
+	}
+
+	//Clusters far out along their own normal tend to occlude the rest of the mesh
+	for (size_t c = 0; c < clusters.size(); c++)
+	{
+		float normalLength = clusterNormals[c].Length();
+		clusters[c].SortKey = normalLength > 0 ? (clusterCentroids[c] - meshCentroid).Dot(clusterNormals[c] / normalLength) : 0.0f;
+	}
+	std::stable_sort(clusters.begin(), clusters.end(), [](const OverdrawCluster& a, const OverdrawCluster& b)
+	{
+		return a.SortKey > b.SortKey;
+	});
+
+	std::vector<int> output;
+	output.reserve(indices.size());
+	for (const OverdrawCluster& cluster : clusters)
+	{
+		output.insert(output.end(), indices.begin() + cluster.FirstTriangle * 3, indices.begin() + (cluster.FirstTriangle + cluster.TriangleCount) * 3);
+	}
+	indices.swap(output);
+}
+
+void OptimizeVertexFetch(MeshData& meshData)
+{
+	unsigned int vertexCount = meshData.VertexCount();
+	std::vector<int> remap(vertexCount, -1);
+	int nextVertex = 0;
+	for (size_t i = 0; i < meshData.Indices.size(); i++)
+	{
+		int& index = meshData.Indices[i];
+		if (remap[index] < 0)
+		{
+			remap[index] = nextVertex++;
+		}
+		index = remap[index];
+	}
+
+	//Vertices no index refers to are dropped
+	std::vector<cyVec3f> positions(nextVertex);
+	std::vector<cyVec3f> normals(nextVertex);
+	std::vector<cyVec2f> texCoords(nextVertex);
+	for (unsigned int v = 0; v < vertexCount; v++)
+	{
+		if (remap[v] >= 0)
+		{
+			positions[remap[v]] = meshData.Positions[v];
+			normals[remap[v]] = meshData.Normals[v];
+			texCoords[remap[v]] = meshData.TexCoords[v];
+		}
+	}
+	meshData.Positions.swap(positions);
+	meshData.Normals.swap(normals);
+	meshData.TexCoords.swap(texCoords);
+}
+
+void SplitForShortIndices(const int* indices, unsigned int indexCount, unsigned int vertexCount,
+	std::vector<unsigned short>& shortIndices, std::vector<unsigned int>& vertexSources, std::vector<Submesh>& submeshes)
+{
+	shortIndices.resize(indexCount);
+	vertexSources.clear();
+	submeshes.clear();
+
+	if (vertexCount <= MAX_SHORT_INDEX_VERTICES)
+	{
+		for (unsigned int i = 0; i < indexCount; i++)
+		{
+			shortIndices[i] = (unsigned short)indices[i];
+		}
+		Submesh submesh = { 0, indexCount, 0 };
+		submeshes.push_back(submesh);
+		return;
+	}
+
+	//localIndex is only valid for vertices whose submeshStamp matches the current submesh
+	std::vector<unsigned int> submeshStamp(vertexCount, 0);
+	std::vector<unsigned short> localIndex(vertexCount, 0);
+	Submesh current = { 0, 0, 0 };
+	unsigned int currentStamp = 1;
+	for (unsigned int t = 0; t + 2 < indexCount; t += 3)
+	{
+		unsigned int newVertices = 0;
+		for (int j = 0; j < 3; j++)
+		{
+			int vertex = indices[t + j];
+			bool seenInTriangle = (j > 0 && indices[t] == vertex) || (j > 1 && indices[t + 1] == vertex);
+			if (submeshStamp[vertex] != currentStamp && !seenInTriangle)
+			{
+				newVertices++;
+			}
+		}
+		if (vertexSources.size() - current.BaseVertex + newVertices > MAX_SHORT_INDEX_VERTICES)
+		{
+			submeshes.push_back(current);
+			current.FirstIndex = t;
+			current.IndexCount = 0;
+			current.BaseVertex = (int)vertexSources.size();
+			currentStamp++;
+		}
+		for (int j = 0; j < 3; j++)
+		{
+			int vertex = indices[t + j];
+			if (submeshStamp[vertex] != currentStamp)
+			{
+				submeshStamp[vertex] = currentStamp;
+				localIndex[vertex] = (unsigned short)(vertexSources.size() - current.BaseVertex);
+				vertexSources.push_back(vertex);
+			}
+			shortIndices[t + j] = localIndex[vertex];
+		}
+		current.IndexCount += 3;
+	}
+	submeshes.push_back(current);
+}
+
+void SplitLodForShortIndices(const int* indices, unsigned int indexCount, unsigned int vertexCount,
+	const std::vector<Submesh>& fullDetailSubmeshes, unsigned int fullDetailVertexCount, std::vector<unsigned int>& vertexSources,
+	std::vector<unsigned short>& shortIndices, std::vector<int>& orderedIndices, std::vector<Submesh>& submeshes)
+{
+	shortIndices.clear();
+	orderedIndices.clear();
+	submeshes.clear();
+
+	//Copies of each source vertex, as (submesh, local index) pairs listed from copyStart[vertex] to copyStart[vertex + 1].
+	//A vertex only has several where full detail submeshes meet.
+	std::vector<unsigned int> copyStart(vertexCount + 1, 0);
+	for (unsigned int i = 0; i < fullDetailVertexCount; i++)
+	{
+		copyStart[vertexSources[i] + 1]++;
+	}
+	for (unsigned int v = 0; v < vertexCount; v++)
+	{
+		copyStart[v + 1] += copyStart[v];
+	}
+	std::vector<unsigned int> copySubmeshes(fullDetailVertexCount);
+	std::vector<unsigned short> copyIndices(fullDetailVertexCount);
+	std::vector<unsigned int> copyNext(copyStart.begin(), copyStart.end() - 1);
+	for (unsigned int submesh = 0; submesh < fullDetailSubmeshes.size(); submesh++)
+	{
+		unsigned int vertexEnd = submesh + 1 < fullDetailSubmeshes.size() ? fullDetailSubmeshes[submesh + 1].BaseVertex : fullDetailVertexCount;
+		for (unsigned int i = fullDetailSubmeshes[submesh].BaseVertex; i < vertexEnd; i++)
+		{
+			unsigned int slot = copyNext[vertexSources[i]]++;
+			copySubmeshes[slot] = submesh;
+			copyIndices[slot] = (unsigned short)(i - fullDetailSubmeshes[submesh].BaseVertex);
+		}
+	}
+
+	//Local index of vertex in submesh, or -1 when the submesh has no copy of it
+	auto localIndex = [&](int vertex, unsigned int submesh) -> int
+	{
+		for (unsigned int slot = copyStart[vertex]; slot < copyStart[vertex + 1]; slot++)
+		{
+			if (copySubmeshes[slot] == submesh)
+			{
+				return copyIndices[slot];
+			}
+		}
+		return -1;
+	};
+
+	const unsigned int noSubmesh = (unsigned int)-1;
+	unsigned int triangleCount = indexCount / 3;
+	std::vector<unsigned int> triangleSubmeshes(triangleCount, noSubmesh);
+	std::vector<unsigned int> submeshTriangleCounts(fullDetailSubmeshes.size(), 0);
+	std::vector<int> straddling;
+	for (unsigned int t = 0; t < triangleCount; t++)
+	{
+		const int* triangle = indices + t * 3;
+		for (unsigned int slot = copyStart[triangle[0]]; slot < copyStart[triangle[0] + 1]; slot++)
+		{
+			unsigned int submesh = copySubmeshes[slot];
+			if (localIndex(triangle[1], submesh) >= 0 && localIndex(triangle[2], submesh) >= 0)
+			{
+				triangleSubmeshes[t] = submesh;
+				submeshTriangleCounts[submesh]++;
+				break;
+			}
+		}
+		if (triangleSubmeshes[t] == noSubmesh)
+		{
+			straddling.insert(straddling.end(), triangle, triangle + 3);
+		}
+	}
+
+	std::vector<unsigned int> submeshNext(fullDetailSubmeshes.size());
+	unsigned int groupedIndexCount = 0;
+	for (unsigned int submesh = 0; submesh < fullDetailSubmeshes.size(); submesh++)
+	{
+		submeshNext[submesh] = groupedIndexCount;
+		if (submeshTriangleCounts[submesh] > 0)
+		{
+			Submesh group = { groupedIndexCount, submeshTriangleCounts[submesh] * 3, fullDetailSubmeshes[submesh].BaseVertex };
+			submeshes.push_back(group);
+			groupedIndexCount += group.IndexCount;
+		}
+	}
+	shortIndices.resize(groupedIndexCount);
+	orderedIndices.resize(groupedIndexCount);
+	for (unsigned int t = 0; t < triangleCount; t++)
+	{
+		unsigned int submesh = triangleSubmeshes[t];
+		if (submesh == noSubmesh)
+		{
+			continue;
+		}
+		unsigned int first = submeshNext[submesh];
+		submeshNext[submesh] += 3;
+		for (int j = 0; j < 3; j++)
+		{
+			orderedIndices[first + j] = indices[t * 3 + j];
+			shortIndices[first + j] = (unsigned short)localIndex(indices[t * 3 + j], submesh);
+		}
+	}
+
+	if (straddling.empty())
+	{
+		return;
+	}
+	std::vector<unsigned short> straddlingShortIndices;
+	std::vector<unsigned int> straddlingSources;
+	std::vector<Submesh> straddlingSubmeshes;
+	SplitForShortIndices(straddling.data(), (unsigned int)straddling.size(), vertexCount, straddlingShortIndices, straddlingSources, straddlingSubmeshes);
+	for (Submesh submesh : straddlingSubmeshes)
+	{
+		submesh.FirstIndex += groupedIndexCount;
+		submesh.BaseVertex += (int)vertexSources.size();
+		submeshes.push_back(submesh);
+	}
+	shortIndices.insert(shortIndices.end(), straddlingShortIndices.begin(), straddlingShortIndices.end());
+	orderedIndices.insert(orderedIndices.end(), straddling.begin(), straddling.end());
+	vertexSources.insert(vertexSources.end(), straddlingSources.begin(), straddlingSources.end());
+}
+
+void OptimizeMeshData(MeshData& meshData, bool optimizeOverdraw)
+{
+	VertexCacheStatistics before = AnalyzeVertexCache(meshData.Indices.data(), meshData.IndexCount(), meshData.VertexCount());
+
+	std::vector<unsigned int> clusterStarts;
+	OptimizeVertexCache(meshData.Indices, meshData.VertexCount(), clusterStarts);
+	if (optimizeOverdraw)
+	{
+		OptimizeOverdraw(meshData.Indices, meshData.Positions, clusterStarts);
+	}
+	OptimizeVertexFetch(meshData);
+
+	VertexCacheStatistics after = AnalyzeVertexCache(meshData.Indices.data(), meshData.IndexCount(), meshData.VertexCount());
+	fprintf(stdout, "Status: Vertex cache (%d entries) ACMR %.3f -> %.3f, ATVR %.3f -> %.3f%s\n",
+		VERTEX_CACHE_SIZE, before.ACMR, after.ACMR, before.ATVR, after.ATVR,
+		optimizeOverdraw ? ", overdraw clusters sorted" : "");
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include <vector>
+#include "MeshData.h"
+
+//Post-transform vertex cache size the optimizer targets and the statistics simulate.
+#define VERTEX_CACHE_SIZE 16
+
+//Largest vertex count a submesh drawn with 16 bit indices may reference.
+#define MAX_SHORT_INDEX_VERTICES 65535
+
+struct VertexCacheStatistics
+{
+	unsigned int TransformedVertices;
+	float ACMR; //average cache miss ratio: transformed vertices per triangle
+	float ATVR; //average transform to vertex ratio: transformed vertices per unique vertex
+};
+
+//Simulates a FIFO post-transform cache of the given size over the index buffer.
+VertexCacheStatistics AnalyzeVertexCache(const int* indices, unsigned int indexCount, unsigned int vertexCount, unsigned int cacheSize = VERTEX_CACHE_SIZE);
+
+//Reorders triangles for post-transform cache locality with Tipsify (Sander et al. 2007).
+//Fills clusterStarts with the first triangle of every run that begins after a cache flush.
+void OptimizeVertexCache(std::vector<int>& indices, unsigned int vertexCount, std::vector<unsigned int>& clusterStarts, unsigned int cacheSize = VERTEX_CACHE_SIZE);
+
+//Sorts the clusters found by OptimizeVertexCache so that outward facing ones are drawn first and
+//occlude the rest, which cuts overdraw from most view directions without changing cache behavior inside clusters.
+void OptimizeOverdraw(std::vector<int>& indices, const std::vector<cyVec3f>& positions, const std::vector<unsigned int>& clusterStarts);
+
+//Renumbers vertices in the order the index buffer first uses them so vertex fetches stream through memory.
+void OptimizeVertexFetch(MeshData& meshData);
+
+//Range of an index buffer drawn with its own base vertex.
+struct Submesh
+{
+	unsigned int FirstIndex;
+	unsigned int IndexCount;
+	int BaseVertex;
+};
+
+//Converts the index buffer to 16 bit indices. Meshes with more than MAX_SHORT_INDEX_VERTICES vertices are split
+//into consecutive runs of triangles, each with its own copy of the vertices it uses, to be drawn with base vertex offsets.
+//vertexSources maps every output vertex to its source vertex and is left empty when no split was needed.
+void SplitForShortIndices(const int* indices, unsigned int indexCount, unsigned int vertexCount,
+	std::vector<unsigned short>& shortIndices, std::vector<unsigned int>& vertexSources, std::vector<Submesh>& submeshes);
+
+//Converts a simplified level over the same vertices as a full detail mesh that SplitForShortIndices had to split, reusing
+//that split's vertex copies, the first fullDetailVertexCount entries of vertexSources, instead of making its own.
+//Triangles are grouped by the full detail submesh holding all three of their vertices, in their original order within
+//each group; the few that straddle submeshes are split again and get copies of their vertices appended to vertexSources.
+//orderedIndices receives the level's indices in the new order.
+void SplitLodForShortIndices(const int* indices, unsigned int indexCount, unsigned int vertexCount,
+	const std::vector<Submesh>& fullDetailSubmeshes, unsigned int fullDetailVertexCount, std::vector<unsigned int>& vertexSources,
+	std::vector<unsigned short>& shortIndices, std::vector<int>& orderedIndices, std::vector<Submesh>& submeshes);
+
+//Runs the stages above on a welded mesh and prints cache statistics before and after.
+void OptimizeMeshData(MeshData& meshData, bool optimizeOverdraw);
@@ -0,0 +1,390 @@
+#include "MeshSimplifier.h"
+
+#include <algorithm>
+#include <float.h>
+#include <math.h>
+#include <stdio.h>
+#include "cyHeap.h"
+#include "MeshOptimizer.h"
+
+//Symmetric 4x4 matrix summing the squared distances to a set of planes.
+struct Quadric
+{
+	double A2, AB, AC, AD, B2, BC, BD, C2, CD, D2;
+};
+
+static void addPlane(Quadric& q, double a, double b, double c, double d)
+{
+	q.A2 += a * a; q.AB += a * b; q.AC += a * c; q.AD += a * d;
+	q.B2 += b * b; q.BC += b * c; q.BD += b * d;
+	q.C2 += c * c; q.CD += c * d;
+	q.D2 += d * d;
+}
+
+static void addQuadric(Quadric& q, const Quadric& other)
+{
+	q.A2 += other.A2; q.AB += other.AB; q.AC += other.AC; q.AD += other.AD;
+	q.B2 += other.B2; q.BC += other.BC; q.BD += other.BD;
+	q.C2 += other.C2; q.CD += other.CD;
+	q.D2 += other.D2;
+}
+
+static double evaluateQuadric(const Quadric& q, const Quadric& other, const cyVec3f& p)
+{
+	double x = p.x, y = p.y, z = p.z;
+	double a2 = q.A2 + other.A2, ab = q.AB + other.AB, ac = q.AC + other.AC, ad = q.AD + other.AD;
+	double b2 = q.B2 + other.B2, bc = q.BC + other.BC, bd = q.BD + other.BD;
+	double c2 = q.C2 + other.C2, cd = q.CD + other.CD;
+	double d2 = q.D2 + other.D2;
+	double error = x * x * a2 + y * y * b2 + z * z * c2 + 2 * (x * y * ab + x * z * ac + y * z * bc + x * ad + y * bd + z * cd) + d2;
+	return error > 0 ? error : 0;
+}
+
+static bool positionLess(const cyVec3f& a, const cyVec3f& b)
+{
+	if (a.x != b.x) return a.x < b.x;
+	if (a.y != b.y) return a.y < b.y;
+	return a.z < b.z;
+}
+
+//Edge collapse state shared by the helpers below. Triangles and edges are never erased from the
+//per vertex lists; dead ones are skipped and the lists of the surviving vertex are compacted after each collapse.
+struct Simplifier
+{
+	const std::vector<cyVec3f>& Positions;
+	std::vector<int> Triangles;
+	std::vector<bool> TriangleAlive;
+	std::vector<std::vector<unsigned int>> VertexTriangles;
+	std::vector<std::vector<unsigned int>> VertexEdges;
+	std::vector<Quadric> Quadrics;
+	std::vector<bool> Locked;
+
+	std::vector<int> EdgeFrom; //the vertex removed by the cheapest collapse of the edge
+	std::vector<int> EdgeTo;
+	std::vector<bool> EdgeAlive;
+	std::vector<float> EdgeCosts;
+	cy::MinHeap<float, unsigned int> Heap;
+
+	std::vector<unsigned int> NeighbourStamp;
+	unsigned int Stamp;
+
+	Simplifier(const std::vector<cyVec3f>& positions) : Positions(positions), Stamp(0) {}
+
+	int OtherEnd(unsigned int edge, int vertex) const { return EdgeFrom[edge] == vertex ? EdgeTo[edge] : EdgeFrom[edge]; }
+
+	void UpdateEdgeCost(unsigned int edge)
+	{
+		int a = EdgeFrom[edge];
+		int b = EdgeTo[edge];
+		double costAToB = Locked[a] ? DBL_MAX : evaluateQuadric(Quadrics[a], Quadrics[b], Positions[b]);
+		double costBToA = Locked[b] ? DBL_MAX : evaluateQuadric(Quadrics[a], Quadrics[b], Positions[a]);
+		if (costBToA < costAToB)
+		{
+			EdgeFrom[edge] = b;
+			EdgeTo[edge] = a;
+			costAToB = costBToA;
+		}
+		EdgeCosts[edge] = costAToB < FLT_MAX ? (float)costAToB : FLT_MAX;
+	}
+
+	//Rejects collapses that would make the surface non-manifold or flip a triangle.
+	bool CanCollapse(int from, int to)
+	{
+		Stamp++;
+		for (unsigned int edge : VertexEdges[from])
+		{
+			if (EdgeAlive[edge])
+			{
+				NeighbourStamp[OtherEnd(edge, from)] = Stamp;
+			}
+		}
+		int sharedNeighbours = 0;
+		for (unsigned int edge : VertexEdges[to])
+		{
+			if (EdgeAlive[edge] && NeighbourStamp[OtherEnd(edge, to)] == Stamp)
+			{
+				sharedNeighbours++;
+			}
+		}
+		if (sharedNeighbours > 2)
+		{
+			return false;
+		}
+
+		for (unsigned int triangle : VertexTriangles[from])
+		{
+			if (!TriangleAlive[triangle])
+			{
+				continue;
+			}
+			const int* t = &Triangles[triangle * 3];
+			if (t[0] == to || t[1] == to || t[2] == to)
+			{
+				continue;
+			}
+			cyVec3f p[3], moved[3];
+			for (int j = 0; j < 3; j++)
+			{
+				p[j] = Positions[t[j]];
+				moved[j] = t[j] == from ? Positions[to] : p[j];
+			}
+			cyVec3f normal = (p[1] - p[0]).Cross(p[2] - p[0]);
+			cyVec3f movedNormal = (moved[1] - moved[0]).Cross(moved[2] - moved[0]);
+			if (normal.Dot(movedNormal) <= 0)
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
+	//Moves everything attached to from onto to. Returns the number of triangles that collapsed.
+	unsigned int Collapse(int from, int to)
+	{
+		addQuadric(Quadrics[to], Quadrics[from]);
+
+		unsigned int removedTriangles = 0;
+		for (unsigned int triangle : VertexTriangles[from])
+		{
+			if (!TriangleAlive[triangle])
+			{
+				continue;
+			}
+			int* t = &Triangles[triangle * 3];
+			if (t[0] == to || t[1] == to || t[2] == to)
+			{
+				TriangleAlive[triangle] = false;
+				removedTriangles++;
+				continue;
+			}
+			for (int j = 0; j < 3; j++)
+			{
+				if (t[j] == from)
+				{
+					t[j] = to;
+				}
+			}
+			VertexTriangles[to].push_back(triangle);
+		}
+		VertexTriangles[from].clear();
+
+		Stamp++;
+		for (unsigned int edge : VertexEdges[to])
+		{
+			if (EdgeAlive[edge])
+			{
+				NeighbourStamp[OtherEnd(edge, to)] = Stamp;
+			}
+		}
+		for (unsigned int edge : VertexEdges[from])
+		{
+			if (!EdgeAlive[edge])
+			{
+				continue;
+			}
+			int other = OtherEnd(edge, from);
+			if (other == to || NeighbourStamp[other] == Stamp)
+			{
+				//The collapsed edge itself, or an edge that now duplicates one of to's edges
+				EdgeAlive[edge] = false;
+				Heap.RemoveItem(edge);
+				continue;
+			}
+			EdgeFrom[edge] = other;
+			EdgeTo[edge] = to;
+			NeighbourStamp[other] = Stamp;
+			VertexEdges[to].push_back(edge);
+		}
+		VertexEdges[from].clear();
+
+		std::vector<unsigned int>& triangles = VertexTriangles[to];
+		triangles.erase(std::remove_if(triangles.begin(), triangles.end(),
+			[this](unsigned int triangle) { return !TriangleAlive[triangle]; }), triangles.end());
+		std::vector<unsigned int>& edges = VertexEdges[to];
+		edges.erase(std::remove_if(edges.begin(), edges.end(),
+			[this](unsigned int edge) { return !EdgeAlive[edge]; }), edges.end());
+		for (unsigned int edge : edges)
+		{
+			UpdateEdgeCost(edge);
+			Heap.MoveItem(edge);
+		}
+		return removedTriangles;
+	}
+};
+
+void SimplifyMesh(const std::vector<cyVec3f>& positions, const std::vector<int>& indices,
+	const std::vector<unsigned int>& targetTriangleCounts, std::vector<int>& lodIndices, std::vector<MeshLod>& lods)
+{
+	unsigned int vertexCount = (unsigned int)positions.size();
+	unsigned int triangleCount = (unsigned int)indices.size() / 3;
+	if (targetTriangleCounts.empty() || triangleCount == 0)
+	{
+		return;
+	}
+
+	Simplifier simplifier(positions);
+	simplifier.Triangles.assign(indices.begin(), indices.begin() + triangleCount * 3);
+	simplifier.TriangleAlive.assign(triangleCount, true);
+	simplifier.VertexTriangles.resize(vertexCount);
+	simplifier.VertexEdges.resize(vertexCount);
+	simplifier.Quadrics.assign(vertexCount, Quadric());
+	simplifier.Locked.assign(vertexCount, false);
+	simplifier.NeighbourStamp.assign(vertexCount, 0);
+
+	//Every vertex starts with the planes of its triangles
+	std::vector<unsigned long long> edgeKeys;
+	edgeKeys.reserve(indices.size());
+	for (unsigned int i = 0; i < triangleCount; i++)
+	{
+		const int* t = &indices[i * 3];
+		cyVec3f normal = (positions[t[1]] - positions[t[0]]).Cross(positions[t[2]] - positions[t[0]]);
+		float length = normal.Length();
+		if (length > 0)
+		{
+			normal /= length;
+		}
+		double d = -normal.Dot(positions[t[0]]);
+		for (int j = 0; j < 3; j++)
+		{
+			addPlane(simplifier.Quadrics[t[j]], normal.x, normal.y, normal.z, d);
+			simplifier.VertexTriangles[t[j]].push_back(i);
+			unsigned int a = (unsigned int)t[j];
+			unsigned int b = (unsigned int)t[(j + 1) % 3];
+			edgeKeys.push_back(a < b ? ((unsigned long long)a << 32 | b) : ((unsigned long long)b << 32 | a));
+		}
+	}
+
+	//Edges used by a single triangle lie on the border
+	std::sort(edgeKeys.begin(), edgeKeys.end());
+	for (size_t i = 0; i < edgeKeys.size(); )
+	{
+		size_t run = i + 1;
+		while (run < edgeKeys.size() && edgeKeys[run] == edgeKeys[i])
+		{
+			run++;
+		}
+		int a = (int)(edgeKeys[i] >> 32);
+		int b = (int)(edgeKeys[i] & 0xFFFFFFFFu);
+		if (run - i == 1)
+		{
+			simplifier.Locked[a] = true;
+			simplifier.Locked[b] = true;
+		}
+		if (a != b)
+		{
+			unsigned int edge = (unsigned int)simplifier.EdgeFrom.size();
+			simplifier.EdgeFrom.push_back(a);
+			simplifier.EdgeTo.push_back(b);
+			simplifier.VertexEdges[a].push_back(edge);
+			simplifier.VertexEdges[b].push_back(edge);
+		}
+		i = run;
+	}
+
+	//Welded vertices sharing a position sit on a normal or uv seam
+	std::vector<unsigned int> byPosition(vertexCount);
+	for (unsigned int i = 0; i < vertexCount; i++)
+	{
+		byPosition[i] = i;
+	}
+	std::sort(byPosition.begin(), byPosition.end(),
+		[&positions](unsigned int a, unsigned int b) { return positionLess(positions[a], positions[b]); });
+	for (unsigned int i = 1; i < vertexCount; i++)
+	{
+		if (!positionLess(positions[byPosition[i - 1]], positions[byPosition[i]]))
+		{
+			simplifier.Locked[byPosition[i - 1]] = true;
+			simplifier.Locked[byPosition[i]] = true;
+		}
+	}
+
+	unsigned int edgeCount = (unsigned int)simplifier.EdgeFrom.size();
+	simplifier.EdgeAlive.assign(edgeCount, true);
+	simplifier.EdgeCosts.resize(edgeCount);
+	for (unsigned int edge = 0; edge < edgeCount; edge++)
+	{
+		simplifier.UpdateEdgeCost(edge);
+	}
+	simplifier.Heap.SetDataPointer(simplifier.EdgeCosts.data(), edgeCount);
+	simplifier.Heap.Build();
+
+	unsigned int aliveTriangles = triangleCount;
+	unsigned int previousLevelTriangles = triangleCount;
+	float maxError = 0;
+	size_t level = 0;
+	while (level < targetTriangleCounts.size())
+	{
+		bool exhausted = simplifier.Heap.IsEmpty() || simplifier.Heap.GetTopItem() >= FLT_MAX;
+		if (!exhausted)
+		{
+			unsigned int edge = simplifier.Heap.GetTopItemID();
+			float cost = simplifier.Heap.GetTopItem();
+			int from = simplifier.EdgeFrom[edge];
+			int to = simplifier.EdgeTo[edge];
+			if (!simplifier.CanCollapse(from, to))
+			{
+				//Parked until a collapse next to it recomputes its cost
+				simplifier.Heap.SetItem(edge, FLT_MAX);
+				continue;
+			}
+			simplifier.Heap.Pop();
+			simplifier.EdgeAlive[edge] = false;
+			aliveTriangles -= simplifier.Collapse(from, to);
+			maxError = std::max(maxError, sqrtf(cost));
+			if (aliveTriangles > targetTriangleCounts[level])
+			{
+				continue;
+			}
+		}
+		else if (aliveTriangles * 10 > previousLevelTriangles * 9)
+		{
+			//Not worth another level when the mesh could barely be reduced
+			break;
+		}
+
+		MeshLod lod;
+		lod.FirstIndex = (unsigned int)lodIndices.size();
+		lod.IndexCount = aliveTriangles * 3;
+		lod.Error = maxError;
+		for (unsigned int i = 0; i < triangleCount; i++)
+		{
+			if (simplifier.TriangleAlive[i])
+			{
+				lodIndices.insert(lodIndices.end(), &simplifier.Triangles[i * 3], &simplifier.Triangles[i * 3] + 3);
+			}
+		}
+		lods.push_back(lod);
+		previousLevelTriangles = aliveTriangles;
+		level++;
+		if (exhausted)
+		{
+			break;
+		}
+	}
+}
+
+void BuildMeshLods(MeshData& meshData)
+{
+	std::vector<unsigned int> targetTriangleCounts;
+	float target = (float)(meshData.IndexCount() / 3);
+	for (int i = 0; i < MESH_LOD_LEVELS; i++)
+	{
+		target *= MESH_LOD_REDUCTION;
+		targetTriangleCounts.push_back((unsigned int)target);
+	}
+
+	meshData.LodIndices.clear();
+	meshData.Lods.clear();
+	SimplifyMesh(meshData.Positions, meshData.Indices, targetTriangleCounts, meshData.LodIndices, meshData.Lods);
+
+	fprintf(stdout, "Status: LOD triangles %u", meshData.IndexCount() / 3);
+	for (const MeshLod& lod : meshData.Lods)
+	{
+		std::vector<int> levelIndices(meshData.LodIndices.begin() + lod.FirstIndex, meshData.LodIndices.begin() + lod.FirstIndex + lod.IndexCount);
+		std::vector<unsigned int> clusterStarts;
+		OptimizeVertexCache(levelIndices, meshData.VertexCount(), clusterStarts);
+		std::copy(levelIndices.begin(), levelIndices.end(), meshData.LodIndices.begin() + lod.FirstIndex);
+		fprintf(stdout, " / %u (error %g)", lod.IndexCount / 3, lod.Error);
+	}
+	fprintf(stdout, "\n");
+}
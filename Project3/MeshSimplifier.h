@@ -0,0 +1,20 @@
+#pragma once
+
+#include <vector>
+#include "MeshData.h"
+
+//Number of simplified levels generated below full detail.
+#define MESH_LOD_LEVELS 3
+
+//Fraction of the previous level's triangles each simplified level keeps.
+#define MESH_LOD_REDUCTION 0.5f
+
+//Simplifies the triangle list with quadric error metrics (Garland and Heckbert 1997) by collapsing edges
+//onto one of their vertices, so every level keeps using the original vertex streams.
+//Border vertices and vertices split by normal or uv seams are never moved, which keeps the outline and seams crack free.
+//Appends one MeshLod to lods for each entry of targetTriangleCounts (in decreasing order) the collapses reach.
+void SimplifyMesh(const std::vector<cyVec3f>& positions, const std::vector<int>& indices,
+	const std::vector<unsigned int>& targetTriangleCounts, std::vector<int>& lodIndices, std::vector<MeshLod>& lods);
+
+//Fills the LOD chain of a welded mesh and optimizes each level for the vertex cache.
+void BuildMeshLods(MeshData& meshData);
@@ -0,0 +1,145 @@
+#include "MeshWelder.h"
+
+#include "TraceProfiler.h"
+
+//Keep the table at most 70% full so probe sequences stay short.
+#define WELD_TABLE_MAX_LOAD_NUMERATOR 7
+#define WELD_TABLE_MAX_LOAD_DENOMINATOR 10
+
+static unsigned int capacityForCount(unsigned int count)
+{
+	unsigned long long required = (unsigned long long)count * WELD_TABLE_MAX_LOAD_DENOMINATOR / WELD_TABLE_MAX_LOAD_NUMERATOR + 1;
+	unsigned int capacity = 16;
+	while (capacity < required)
+	{
+		capacity <<= 1;
+	}
+	return capacity;
+}
+
+VertexWeldTable::VertexWeldTable(unsigned int expectedVertexCount)
+{
+	Slot emptySlot = { 0, 0, 0, -1 };
+	Slots.assign(capacityForCount(expectedVertexCount), emptySlot);
+	Mask = (unsigned int)Slots.size() - 1;
+	Count = 0;
+}
+
+unsigned int VertexWeldTable::Hash(int positionIndex, int normalIndex, int uvIndex)
+{
+	//Mix the packed triple with large odd multipliers, then fold the high bits down.
+	unsigned long long h = (unsigned long long)(unsigned int)positionIndex * 0x9E3779B97F4A7C15ull;
+	h ^= (unsigned long long)(unsigned int)normalIndex * 0xC2B2AE3D27D4EB4Full;
+	h ^= (unsigned long long)(unsigned int)uvIndex * 0x165667B19E3779F9ull;
+	h ^= h >> 29;
+	return (unsigned int)(h ^ (h >> 32));
+}
+
+int VertexWeldTable::FindOrInsert(int positionIndex, int normalIndex, int uvIndex, int newBuffersIndex)
+{
+	if ((unsigned long long)(Count + 1) * WELD_TABLE_MAX_LOAD_DENOMINATOR > (unsigned long long)Slots.size() * WELD_TABLE_MAX_LOAD_NUMERATOR)
+	{
+		Grow();
+	}
+
+	unsigned int slotIndex = Hash(positionIndex, normalIndex, uvIndex) & Mask;
+	while (true)
+	{
+		Slot& slot = Slots[slotIndex];
+		if (slot.BuffersIndex < 0)
+		{
+			slot.VertexPositionIndex = positionIndex;
+			slot.NormalPositionIndex = normalIndex;
+			slot.UVPositionIndex = uvIndex;
+			slot.BuffersIndex = newBuffersIndex;
+			Count++;
+			return newBuffersIndex;
+		}
+		if (slot.VertexPositionIndex == positionIndex && slot.NormalPositionIndex == normalIndex && slot.UVPositionIndex == uvIndex)
+		{
+			return slot.BuffersIndex;
+		}
+		slotIndex = (slotIndex + 1) & Mask;
+	}
+}
+
+void VertexWeldTable::Grow()
+{
+	std::vector<Slot> oldSlots;
+	oldSlots.swap(Slots);
+	Slot emptySlot = { 0, 0, 0, -1 };
+	Slots.assign(oldSlots.size() * 2, emptySlot);
+	Mask = (unsigned int)Slots.size() - 1;
+
+	for (const Slot& oldSlot : oldSlots)
+	{
+		if (oldSlot.BuffersIndex < 0)
+		{
+			continue;
+		}
+		unsigned int slotIndex = Hash(oldSlot.VertexPositionIndex, oldSlot.NormalPositionIndex, oldSlot.UVPositionIndex) & Mask;
+		while (Slots[slotIndex].BuffersIndex >= 0)
+		{
+			slotIndex = (slotIndex + 1) & Mask;
+		}
+		Slots[slotIndex] = oldSlot;
+	}
+}
+
+void WeldObjMesh(const cyTriMesh& mesh, std::vector<ObjFileIndexData>& vertices, std::vector<int>& indices)
+{
+	TRACE_SCOPE("weld vertices");
+	//Closed meshes have roughly half as many vertices as faces; the table grows if that guess is low.
+	VertexWeldTable weldTable(mesh.NF() / 2);
+	bool hasUVs = mesh.HasTextureVertices();
+
+	vertices.clear();
+	vertices.reserve(mesh.NF() / 2 + 1);
+	indices.resize((size_t)mesh.NF() * 3);
+
+	for (unsigned int i = 0; i < mesh.NF(); i++)
+	{
+		const cy::TriMesh::TriFace& face = mesh.F(i);
+		const cy::TriMesh::TriFace& faceNormal = mesh.FN(i);
+
+		for (int j = 0; j < 3; j++)
+		{
+			int vertexObjIndex = face.v[j];
+			int normalIndex = faceNormal.v[j];
+			int uvIndex = hasUVs ? (int)mesh.FT(i).v[j] : 0;
+
+			int newIndex = (int)vertices.size();
+			int buffersIndex = weldTable.FindOrInsert(vertexObjIndex, normalIndex, uvIndex, newIndex);
+			if (buffersIndex == newIndex)
+			{
+				ObjFileIndexData indexData;
+				indexData.BuffersIndex = newIndex;
+				indexData.VertexPositionIndex = vertexObjIndex;
+				indexData.NormalPositionIndex = normalIndex;
+				indexData.UVPositionIndex = uvIndex;
+				vertices.push_back(indexData);
+			}
+			indices[(size_t)i * 3 + j] = buffersIndex;
+		}
+	}
+}
+
+void BuildMeshData(const cyTriMesh& mesh, MeshData& meshData)
+{
+	std::vector<ObjFileIndexData> objIndices;
+	WeldObjMesh(mesh, objIndices, meshData.Indices);
+
+	meshData.Positions.resize(objIndices.size());
+	meshData.Normals.resize(objIndices.size());
+	meshData.TexCoords.resize(objIndices.size());
+	bool hasUVs = mesh.HasTextureVertices();
+	for (size_t i = 0; i < objIndices.size(); i++)
+	{
+		meshData.Positions[i] = mesh.V(objIndices[i].VertexPositionIndex);
+		meshData.Normals[i] = mesh.VN(objIndices[i].NormalPositionIndex);
+		meshData.TexCoords[i] = hasUVs ? mesh.VT(objIndices[i].UVPositionIndex).XY() : cyVec2f(0, 0);
+	}
+
+	meshData.BoundMin = mesh.GetBoundMin();
+	meshData.BoundMax = mesh.GetBoundMax();
+}
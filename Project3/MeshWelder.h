@@ -0,0 +1,48 @@
+#pragma once
+
+#include <vector>
+#include "cyTriMesh.h"
+#include "MeshData.h"
+
+struct ObjFileIndexData
+{
+	int BuffersIndex;
+	int VertexPositionIndex;
+	int NormalPositionIndex;
+	int UVPositionIndex;
+};
+
+//Open addressing hash table mapping an obj (position, normal, uv) index triple to its welded vertex index.
+class VertexWeldTable
+{
+public:
+	VertexWeldTable(unsigned int expectedVertexCount);
+
+	//Returns the welded index already stored for the triple, or stores and returns newBuffersIndex.
+	int FindOrInsert(int positionIndex, int normalIndex, int uvIndex, int newBuffersIndex);
+
+	unsigned int Size() const { return Count; }
+
+private:
+	struct Slot
+	{
+		int VertexPositionIndex;
+		int NormalPositionIndex;
+		int UVPositionIndex;
+		int BuffersIndex; //-1 when the slot is empty
+	};
+
+	static unsigned int Hash(int positionIndex, int normalIndex, int uvIndex);
+	void Grow();
+
+	std::vector<Slot> Slots;
+	unsigned int Mask;
+	unsigned int Count;
+};
+
+//Builds the deduplicated vertex list and the triangle index buffer for an obj mesh.
+//The mesh must have normals; missing texture coordinates are welded as uv index 0.
+void WeldObjMesh(const cyTriMesh& mesh, std::vector<ObjFileIndexData>& vertices, std::vector<int>& indices);
+
+//Welds the mesh and fills the vertex streams, index buffer and bounding box of meshData.
+void BuildMeshData(const cyTriMesh& mesh, MeshData& meshData);
@@ -0,0 +1,193 @@
+#include "Meshlet.h"
+
+#include <math.h>
+
+static void finishMeshlet(Meshlet& meshlet, const int* indices, const cyVec3f* positions)
+{
+	const int* triangles = indices + meshlet.FirstIndex;
+
+	//Sphere around the bounding box center is cheap and tight enough for clusters this small
+	cyVec3f boundMin = positions[triangles[0]];
+	cyVec3f boundMax = boundMin;
+	for (unsigned int i = 1; i < meshlet.IndexCount; i++)
+	{
+		boundMin = cyVec3f(fminf(boundMin.x, positions[triangles[i]].x), fminf(boundMin.y, positions[triangles[i]].y), fminf(boundMin.z, positions[triangles[i]].z));
+		boundMax = cyVec3f(fmaxf(boundMax.x, positions[triangles[i]].x), fmaxf(boundMax.y, positions[triangles[i]].y), fmaxf(boundMax.z, positions[triangles[i]].z));
+	}
+	meshlet.Center = (boundMin + boundMax) / 2;
+	float radiusSquared = 0;
+	for (unsigned int i = 0; i < meshlet.IndexCount; i++)
+	{
+		radiusSquared = fmaxf(radiusSquared, (positions[triangles[i]] - meshlet.Center).LengthSquared());
+	}
+	meshlet.Radius = sqrtf(radiusSquared);
+
+	std::vector<cyVec3f> normals;
+	cyVec3f normalSum(0, 0, 0);
+	for (unsigned int i = 0; i < meshlet.IndexCount; i += 3)
+	{
+		const cyVec3f& p0 = positions[triangles[i]];
+		cyVec3f normal = (positions[triangles[i + 1]] - p0).Cross(positions[triangles[i + 2]] - p0);
+		float length = normal.Length();
+		if (length > 0)
+		{
+			normals.push_back(normal / length);
+			normalSum += normals.back();
+		}
+	}
+
+	meshlet.ConeAxis = cyVec3f(0, 0, 0);
+	meshlet.ConeCutoff = 1;
+	float axisLength = normalSum.Length();
+	if (axisLength <= 0)
+	{
+		return;
+	}
+	meshlet.ConeAxis = normalSum / axisLength;
+	float minDot = 1;
+	for (const cyVec3f& normal : normals)
+	{
+		minDot = fminf(minDot, normal.Dot(meshlet.ConeAxis));
+	}
+	if (minDot > 0)
+	{
+		meshlet.ConeCutoff = sqrtf(1 - minDot * minDot);
+	}
+}
+
+void BuildMeshlets(const int* indices, unsigned int firstIndex, unsigned int indexCount, const cyVec3f* positions,
+	std::vector<Meshlet>& meshlets)
+{
+	//Small list of the current meshlet's vertices; a linear search beats hashing at 64 entries
+	int vertices[MESHLET_MAX_VERTICES];
+	int vertexCount = 0;
+
+	Meshlet meshlet;
+	meshlet.FirstIndex = firstIndex;
+	meshlet.IndexCount = 0;
+	meshlet.BaseVertex = 0;
+	for (unsigned int t = firstIndex; t + 2 < firstIndex + indexCount; t += 3)
+	{
+		int newVertices[3];
+		int newVertexCount = 0;
+		for (int j = 0; j < 3; j++)
+		{
+			int vertex = indices[t + j];
+			bool found = false;
+			for (int k = 0; k < vertexCount && !found; k++)
+			{
+				found = vertices[k] == vertex;
+			}
+			for (int k = 0; k < newVertexCount && !found; k++)
+			{
+				found = newVertices[k] == vertex;
+			}
+			if (!found)
+			{
+				newVertices[newVertexCount++] = vertex;
+			}
+		}
+
+		if (vertexCount + newVertexCount > MESHLET_MAX_VERTICES || meshlet.IndexCount / 3 == MESHLET_MAX_TRIANGLES)
+		{
+			finishMeshlet(meshlet, indices, positions);
+			meshlets.push_back(meshlet);
+			meshlet.FirstIndex = t;
+			meshlet.IndexCount = 0;
+			vertexCount = 0;
+			newVertexCount = 0;
+			for (int j = 0; j < 3; j++)
+			{
+				int vertex = indices[t + j];
+				if ((j < 1 || indices[t] != vertex) && (j < 2 || indices[t + 1] != vertex))
+				{
+					newVertices[newVertexCount++] = vertex;
+				}
+			}
+		}
+
+		for (int k = 0; k < newVertexCount; k++)
+		{
+			vertices[vertexCount++] = newVertices[k];
+		}
+		meshlet.IndexCount += 3;
+	}
+
+	if (meshlet.IndexCount > 0)
+	{
+		finishMeshlet(meshlet, indices, positions);
+		meshlets.push_back(meshlet);
+	}
+}
+
+void MeshletCuller::Set(const cyMatrix4f& modelView, const cyMatrix4f& projection)
+{
+	//Gribb and Hartmann: the planes are sums and differences of the rows of the object to clip space matrix
+	cyMatrix4f mvp = projection * modelView;
+	cyVec4f rows[4];
+	for (int r = 0; r < 4; r++)
+	{
+		rows[r] = cyVec4f(mvp.cell[r], mvp.cell[4 + r], mvp.cell[8 + r], mvp.cell[12 + r]);
+	}
+	for (int i = 0; i < 3; i++)
+	{
+		Planes[i * 2] = rows[3] + rows[i];
+		Planes[i * 2 + 1] = rows[3] - rows[i];
+	}
+	for (int i = 0; i < 6; i++)
+	{
+		float length = Planes[i].XYZ().Length();
+		if (length > 0)
+		{
+			Planes[i] /= length;
+		}
+	}
+
+	cyMatrix4f viewToObject = modelView.GetInverse();
+	CameraPosition = (viewToObject * cyVec4f(0, 0, 0, 1)).XYZ();
+}
+
+bool MeshletCuller::IsSphereVisible(const cyVec3f& center, float radius) const
+{
+	for (int i = 0; i < 6; i++)
+	{
+		if (Planes[i].XYZ().Dot(center) + Planes[i].w < -radius)
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+FrustumOverlap MeshletCuller::TestBox(const float box[6]) const
+{
+	FrustumOverlap overlap = FrustumInside;
+	for (int i = 0; i < 6; i++)
+	{
+		//Corners furthest along and against the plane normal
+		const cyVec4f& plane = Planes[i];
+		cyVec3f farCorner(plane.x >= 0 ? box[3] : box[0], plane.y >= 0 ? box[4] : box[1], plane.z >= 0 ? box[5] : box[2]);
+		cyVec3f nearCorner(plane.x >= 0 ? box[0] : box[3], plane.y >= 0 ? box[1] : box[4], plane.z >= 0 ? box[2] : box[5]);
+		if (plane.XYZ().Dot(farCorner) + plane.w < 0)
+		{
+			return FrustumOutside;
+		}
+		if (plane.XYZ().Dot(nearCorner) + plane.w < 0)
+		{
+			overlap = FrustumIntersecting;
+		}
+	}
+	return overlap;
+}
+
+bool MeshletCuller::IsVisible(const Meshlet& meshlet) const
+{
+	if (!IsSphereVisible(meshlet.Center, meshlet.Radius))
+	{
+		return false;
+	}
+
+	//Every triangle faces away when the camera lies outside the cone's dual around the bounding sphere
+	cyVec3f toCenter = meshlet.Center - CameraPosition;
+	return toCenter.Dot(meshlet.ConeAxis) < meshlet.ConeCutoff * toCenter.Length() + meshlet.Radius;
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <vector>
+#include "cyVector.h"
+#include "cyMatrix.h"
+
+//Cluster size limits; 124 triangles keeps a cluster's index count a multiple of 4 after 64 vertices fill up.
+#define MESHLET_MAX_VERTICES 64
+#define MESHLET_MAX_TRIANGLES 124
+
+//Run of consecutive triangles in the index buffer with the bounds used to cull it as a whole.
+struct Meshlet
+{
+	unsigned int FirstIndex;
+	unsigned int IndexCount;
+	int BaseVertex;
+
+	cyVec3f Center; //bounding sphere
+	float Radius;
+	cyVec3f ConeAxis; //average facing direction of the triangles
+	float ConeCutoff; //sine of the normal cone's half angle, 1 when the triangles face too many ways to cull
+};
+
+//Splits triangles [firstIndex, firstIndex + indexCount) into meshlets without reordering them, so the index buffer
+//should already be optimized for the vertex cache. indices are looked up in positions directly.
+void BuildMeshlets(const int* indices, unsigned int firstIndex, unsigned int indexCount, const cyVec3f* positions,
+	std::vector<Meshlet>& meshlets);
+
+//Result of testing a box against the frustum.
+enum FrustumOverlap
+{
+	FrustumOutside,
+	FrustumIntersecting,
+	FrustumInside       //every point of the box is inside, so nothing in it needs testing again
+};
+
+//Object space culling volume: the six frustum planes and the camera position.
+struct MeshletCuller
+{
+	cyVec4f Planes[6]; //xyz points inside, scaled to unit length
+	cyVec3f CameraPosition;
+
+	void Set(const cyMatrix4f& modelView, const cyMatrix4f& projection);
+
+	bool IsSphereVisible(const cyVec3f& center, float radius) const;
+
+	//box holds the minimum then the maximum corner, like cy::BVH node bounds.
+	FrustumOverlap TestBox(const float box[6]) const;
+
+	//False when the meshlet is outside the frustum or all of its triangles face away from the camera.
+	bool IsVisible(const Meshlet& meshlet) const;
+};
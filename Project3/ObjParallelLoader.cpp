@@ -0,0 +1,218 @@
+#include "cyTriMesh.h"
+
+#include "MappedFile.h"
+#include <thread>
+
+//cy::TriMesh::LoadFromFileObjParallel lives here rather than in cyTriMesh.h so the memory mapping and thread
+//headers stay out of every file that includes the mesh class.
+
+namespace cy {
+
+void TriMesh::ParseObjChunk( ObjChunk &chunk, bool loadMtl )
+{
+	Buffer buffer;
+	bool hasTextures=false, hasNormals=false;
+	chunk.firstTextureFace = chunk.firstNormalFace = (unsigned int)-1;
+	int currentUseMtl = -1;
+
+	char const *p = chunk.begin;
+	while ( p < chunk.end ) {
+		int rb = buffer.ReadLine(p,chunk.end);
+		if ( rb == 0 ) continue;
+		if ( buffer.IsCommand("v") ) {
+			Vec3f vertex;
+			buffer.ReadVertexFast(vertex);
+			chunk.v.push_back(vertex);
+		}
+		else if ( buffer.IsCommand("vt") ) {
+			Vec3f texVert;
+			buffer.ReadVertexFast(texVert);
+			chunk.vt.push_back(texVert);
+			if ( !hasTextures ) { hasTextures = true; chunk.firstTextureFace = (unsigned int)chunk.f.size(); }
+		}
+		else if ( buffer.IsCommand("vn") ) {
+			Vec3f normal;
+			buffer.ReadVertexFast(normal);
+			chunk.vn.push_back(normal);
+			if ( !hasNormals ) { hasNormals = true; chunk.firstNormalFace = (unsigned int)chunk.f.size(); }
+		}
+		else if ( buffer.IsCommand("f") ) {
+			int facevert = -1;
+			bool inspace = true;
+			bool negative = false;
+			int type = 0;
+			unsigned int index;
+			TriFace face, textureFace, normalFace;
+			unsigned short relative = 0;
+			for ( int i=2; i<rb; i++ ) {
+				if ( buffer[i] == ' ' ) inspace = true;
+				else {
+					if ( inspace ) {
+						inspace=false;
+						negative = false;
+						type=0;
+						index=0;
+						switch ( facevert ) {
+							case -1:
+								// initialize face
+								face.v[0] = face.v[1] = face.v[2] = 0;
+								textureFace.v[0] = textureFace.v[1] = textureFace.v[2] = 0;
+								normalFace. v[0] = normalFace. v[1] = normalFace. v[2] = 0;
+							case 0:
+							case 1:
+								facevert++;
+								break;
+							case 2:
+								// copy the first two vertices from the previous face
+								if ( relative ) { chunk.relativeFaces.push_back((unsigned int)chunk.f.size()); chunk.relativeMasks.push_back(relative); }
+								chunk.f.push_back(face);
+								chunk.ft.push_back(textureFace);
+								chunk.fn.push_back(normalFace);
+								chunk.faceUseMtl.push_back(currentUseMtl);
+								face.v[1] = face.v[2];
+								textureFace.v[1] = textureFace.v[2];
+								normalFace.v[1] = normalFace.v[2];
+								relative = ( relative & ~0x92 ) | ( ( relative & 0x124 ) >> 1 );
+								break;
+						}
+					}
+					if ( buffer[i] == '/' ) { type++; index=0; }
+					if ( buffer[i] == '-' ) negative = true;
+					if ( buffer[i] >= '0' && buffer[i] <= '9' ) {
+						index = index*10 + (buffer[i]-'0');
+						unsigned short bit = (unsigned short)( 1 << ( type*3 + facevert ) );
+						if ( negative ) relative |= bit; else relative &= ~bit;
+						switch ( type ) {
+							case 0: face.v       [facevert] = negative ? (unsigned int)chunk.v. size()-index : index-1; break;
+							case 1: textureFace.v[facevert] = negative ? (unsigned int)chunk.vt.size()-index : index-1; if ( !hasTextures ) { hasTextures = true; chunk.firstTextureFace = (unsigned int)chunk.f.size(); } break;
+							case 2: normalFace.v [facevert] = negative ? (unsigned int)chunk.vn.size()-index : index-1; if ( !hasNormals  ) { hasNormals  = true; chunk.firstNormalFace  = (unsigned int)chunk.f.size(); } break;
+						}
+					}
+				}
+			}
+			if ( relative ) { chunk.relativeFaces.push_back((unsigned int)chunk.f.size()); chunk.relativeMasks.push_back(relative); }
+			chunk.f.push_back(face);
+			chunk.ft.push_back(textureFace);
+			chunk.fn.push_back(normalFace);
+			chunk.faceUseMtl.push_back(currentUseMtl);
+		}
+		else if ( loadMtl ) {
+			if ( buffer.IsCommand("usemtl") ) {
+				currentUseMtl = (int)chunk.useMtlNames.size();
+				chunk.useMtlNames.push_back(buffer.Data(7));
+				chunk.useMtlFirstFace.push_back((unsigned int)chunk.f.size());
+			}
+			if ( buffer.IsCommand("mtllib") ) {
+				MtlLibName libName;
+				libName.filename = buffer.Data(7);
+				chunk.mtlFiles.push_back(libName);
+			}
+		}
+	}
+}
+
+bool TriMesh::LoadFromFileObjParallel( char const *filename, bool loadMtl, std::ostream *outStream, unsigned int numThreads )
+{
+	MappedFile file;
+	if ( !file.Open(filename) ) {
+		if ( outStream ) *outStream << "ERROR: Cannot open file " << filename << std::endl;
+		return false;
+	}
+
+	Clear();
+
+	// Split the file into newline-aligned chunks of at least 1 MB each
+	char const *fileData = file.Data();
+	size_t fileSize = file.Size();
+	if ( numThreads == 0 ) numThreads = std::thread::hardware_concurrency();
+	size_t const minChunkSize = 1 << 20;
+	size_t numChunks = fileSize / minChunkSize + 1;
+	if ( numChunks > numThreads ) numChunks = numThreads > 0 ? numThreads : 1;
+
+	std::vector<ObjChunk> chunks(numChunks);
+	char const *chunkBegin = fileData;
+	for ( size_t c=0; c<numChunks; c++ ) {
+		char const *chunkEnd = fileData + fileSize;
+		if ( c+1 < numChunks ) {
+			chunkEnd = fileData + fileSize * (c+1) / numChunks;
+			if ( chunkEnd < chunkBegin ) chunkEnd = chunkBegin;
+			while ( chunkEnd < fileData + fileSize && *chunkEnd != '\n' ) chunkEnd++;
+			if ( chunkEnd < fileData + fileSize ) chunkEnd++;
+		}
+		chunks[c].begin = chunkBegin;
+		chunks[c].end   = chunkEnd;
+		chunkBegin = chunkEnd;
+	}
+
+	std::vector<std::thread> threads;
+	for ( size_t c=1; c<numChunks; c++ ) threads.push_back( std::thread( ParseObjChunk, std::ref(chunks[c]), loadMtl ) );
+	if ( numChunks > 0 ) ParseObjChunk( chunks[0], loadMtl );
+	for ( std::thread &t : threads ) t.join();
+
+	// Stitch the chunks together, offsetting indices and resolving materials in file order
+	ObjData data;
+	MtlList mtlList;
+	size_t nv=0, nvt=0, nvn=0, nf=0;
+	for ( ObjChunk const &chunk : chunks ) { nv+=chunk.v.size(); nvt+=chunk.vt.size(); nvn+=chunk.vn.size(); nf+=chunk.f.size(); }
+	data.v .reserve(nv);
+	data.vt.reserve(nvt);
+	data.vn.reserve(nvn);
+	data.f .reserve(nf);
+	data.faceMtlIndex.reserve(nf);
+
+	int currentMtlIndex = -1;
+	bool hasTextures=false, hasNormals=false;
+	for ( ObjChunk &chunk : chunks ) {
+		unsigned int vOffset  = (unsigned int)data.v .size();
+		unsigned int vtOffset = (unsigned int)data.vt.size();
+		unsigned int vnOffset = (unsigned int)data.vn.size();
+		unsigned int fOffset  = (unsigned int)data.f .size();
+		unsigned int chunkFaces = (unsigned int)chunk.f.size();
+
+		// Positive indices are already absolute. Negative (relative) ones were counted from the chunk's own arrays,
+		// so they still need the counts of the preceding chunks.
+		for ( size_t r=0; r<chunk.relativeFaces.size(); r++ ) {
+			unsigned int i = chunk.relativeFaces[r];
+			unsigned short mask = chunk.relativeMasks[r];
+			for ( int j=0; j<3; j++ ) {
+				if ( mask & ( 1<<j) ) chunk.f [i].v[j] += vOffset;
+				if ( mask & ( 8<<j) ) chunk.ft[i].v[j] += vtOffset;
+				if ( mask & (64<<j) ) chunk.fn[i].v[j] += vnOffset;
+			}
+		}
+
+		data.v .insert( data.v .end(), chunk.v .begin(), chunk.v .end() );
+		data.vt.insert( data.vt.end(), chunk.vt.begin(), chunk.vt.end() );
+		data.vn.insert( data.vn.end(), chunk.vn.begin(), chunk.vn.end() );
+		data.f .insert( data.f .end(), chunk.f .begin(), chunk.f .end() );
+
+		// The serial loader only keeps texture/normal faces once it has seen texture/normal data
+		unsigned int firstTextureFace = hasTextures ? 0 : ( chunk.firstTextureFace < chunkFaces ? chunk.firstTextureFace : chunkFaces );
+		unsigned int firstNormalFace  = hasNormals  ? 0 : ( chunk.firstNormalFace  < chunkFaces ? chunk.firstNormalFace  : chunkFaces );
+		data.ft.insert( data.ft.end(), chunk.ft.begin() + firstTextureFace, chunk.ft.end() );
+		data.fn.insert( data.fn.end(), chunk.fn.begin() + firstNormalFace,  chunk.fn.end() );
+		if ( chunk.firstTextureFace != (unsigned int)-1 ) hasTextures = true;
+		if ( chunk.firstNormalFace  != (unsigned int)-1 ) hasNormals  = true;
+
+		std::vector<int> useMtlIndex( chunk.useMtlNames.size() );
+		for ( size_t u=0; u<chunk.useMtlNames.size(); u++ ) {
+			useMtlIndex[u] = mtlList.CreateMtl( chunk.useMtlNames[u].c_str(), fOffset + chunk.useMtlFirstFace[u] );
+		}
+		for ( unsigned int i=0; i<chunkFaces; i++ ) {
+			if ( chunk.faceUseMtl[i] >= 0 ) currentMtlIndex = useMtlIndex[ chunk.faceUseMtl[i] ];
+			data.faceMtlIndex.push_back(currentMtlIndex);
+			if ( currentMtlIndex>=0 ) mtlList.mtlData[currentMtlIndex].faceCount++;
+		}
+		if ( useMtlIndex.size() > 0 ) currentMtlIndex = useMtlIndex.back();
+		data.mtlFiles.insert( data.mtlFiles.end(), chunk.mtlFiles.begin(), chunk.mtlFiles.end() );
+
+		// release the chunk memory as soon as it is copied
+		chunk = ObjChunk();
+	}
+
+	file.Close();
+
+	return SetFromObjData( filename, loadMtl, outStream, data, mtlList );
+}
+
+} // namespace cy
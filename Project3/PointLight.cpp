@@ -1 +1,9 @@
 #include "PointLight.h"
+
+PointLight::PointLight()
+{
+	LightPosition = cyVec4f(0, 0, 0, 1);
+	LightIntensity = 1.0f;
+	Color = cyVec3f(1, 1, 1);
+	Radius = POINT_LIGHT_UNBOUNDED_RADIUS;
+}
@@ -1,10 +1,17 @@
 #pragma once
 #include "cyVector.h"
 
+//Radius of lights that reach everything, like the single scene light.
+#define POINT_LIGHT_UNBOUNDED_RADIUS 1e30f
+
 class PointLight
 {
 public:
+	PointLight();
+
 	cyVec4f LightPosition;
 	float LightIntensity;
+	cyVec3f Color;
+	float Radius; //distance at which the light's contribution has faded to zero
 };
 
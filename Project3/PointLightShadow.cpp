@@ -0,0 +1,176 @@
+#include "PointLightShadow.h"
+
+#include <stdio.h>
+#include <math.h>
+#include <algorithm>
+#include "Shader.h"
+#include "GLStateCache.h"
+#include "TraceProfiler.h"
+#include "ProgramBinaryCache.h"
+
+PointLightShadow::PointLightShadow(const std::string& shaderDirectory, int size)
+{
+	UniformRing = new UniformRingBuffer(POINT_LIGHT_SHADOW_UNIFORM_SIZE);
+	Dirty = true;
+	LastLightPosition = cyVec4f(0, 0, 0, 1);
+	FarPlane = 0;
+	RenderCount = 0;
+
+	//GLRenderDepth leaves cube maps unattached; all six faces are attached at once as a layered target instead
+	ShadowMap.Initialize(true, size, size, GL_DEPTH_COMPONENT24);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+	ShadowMap.Bind();
+	glFramebufferTexture(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, ShadowMap.GetTextureID(), 0);
+	ShadowMap.Unbind();
+	Valid = ShadowMap.IsComplete();
+	if (!Valid)
+	{
+		fprintf(stderr, "Point light shadow cube map framebuffer is incomplete\n");
+	}
+
+	TRACE_SCOPE("compile shadow shaders");
+	std::string vertexShaderPath = shaderDirectory + "\\shadow.vert";
+	std::string geometryShaderPath = shaderDirectory + "\\shadow.geom";
+	std::string fragShaderPath = shaderDirectory + "\\shadow.frag";
+	const char* shaderFiles[] = { vertexShaderPath.c_str(), geometryShaderPath.c_str(), fragShaderPath.c_str() };
+	unsigned long long cacheKey = 0;
+	bool keyed = ProgramBinaryCache::KeyForFiles(shaderFiles, 3, cacheKey);
+	bool built = keyed && ProgramBinaryCache::Load(cacheKey, Program);
+	if (!built)
+	{
+		built = Program.BuildFiles(vertexShaderPath.c_str(), fragShaderPath.c_str(), geometryShaderPath.c_str());
+		if (built && keyed)
+		{
+			ProgramBinaryCache::Save(cacheKey, Program);
+		}
+	}
+	if (!built)
+	{
+		fprintf(stderr, "Failed to build the point light shadow shaders\n");
+		Valid = false;
+	}
+	else
+	{
+		GLuint program = Program.GetID();
+		glUniformBlockBinding(program, glGetUniformBlockIndex(program, "ObjectUniforms"), OBJECT_UNIFORM_BINDING);
+		glUniformBlockBinding(program, glGetUniformBlockIndex(program, "ShadowUniforms"), SHADOW_UNIFORM_BINDING);
+	}
+
+	//cyGL bound the texture and program behind the state cache's back
+	GLStateCache::Invalidate();
+}
+
+PointLightShadow::~PointLightShadow()
+{
+	delete UniformRing;
+	GLStateCache::Invalidate();
+}
+
+bool PointLightShadow::Update(const PointLight& light, const std::vector<RenderableObject*>& casters)
+{
+	if (!Valid)
+	{
+		return false;
+	}
+
+	//cyVec4f's operator!= needs every component to differ, so changes are found with operator==
+	bool changed = Dirty || !(light.LightPosition == LastLightPosition) || casters.size() != Casters.size();
+	//New slots start with no object, so every caster is compared and recorded below
+	Casters.resize(casters.size(), CasterState());
+	for (size_t i = 0; i < casters.size(); i++)
+	{
+		RenderableObject* caster = casters[i];
+		const cyMatrix4f& model = caster->CalculateModelTransform();
+		CasterState& state = Casters[i];
+		if (state.Object != caster || state.Loaded != caster->IsLoaded() || state.Model != model)
+		{
+			changed = true;
+			state.Object = caster;
+			state.Loaded = caster->IsLoaded();
+			state.Model = model;
+		}
+	}
+	if (!changed)
+	{
+		return false;
+	}
+
+	LastLightPosition = light.LightPosition;
+	Dirty = false;
+	Render(casters);
+	return true;
+}
+
+void PointLightShadow::Render(const std::vector<RenderableObject*>& casters)
+{
+	//The far plane just encloses every caster's bounding sphere, which keeps the most depth precision
+	cyVec3f lightPosition = LastLightPosition.XYZ();
+	FarPlane = POINT_LIGHT_SHADOW_NEAR_PLANE * 2;
+	for (const CasterState& state : Casters)
+	{
+		if (!state.Loaded)
+		{
+			continue;
+		}
+		const float* c = state.Model.cell;
+		float scale = sqrtf(std::max(cyVec3f(c[0], c[1], c[2]).LengthSquared(), std::max(cyVec3f(c[4], c[5], c[6]).LengthSquared(), cyVec3f(c[8], c[9], c[10]).LengthSquared())));
+		cyVec3f center = (state.Model * cyVec4f(state.Object->GetBoundingBoxCenter(), 1)).XYZ();
+		FarPlane = std::max(FarPlane, (center - lightPosition).Length() + state.Object->GetBoundingRadius() * scale);
+	}
+
+	UniformRing->BeginFrame();
+	GLintptr shadowOffset;
+	ShadowUniformBlock* shadow = (ShadowUniformBlock*)UniformRing->Allocate(sizeof(ShadowUniformBlock), shadowOffset);
+	if (!shadow)
+	{
+		UniformRing->EndFrame();
+		return;
+	}
+	cyMatrix4f projection = cy::GLRenderDepthCube::GetProjection(POINT_LIGHT_SHADOW_NEAR_PLANE, FarPlane);
+	cyMatrix4f toLight = cyMatrix4f::Translation(-lightPosition);
+	for (int side = 0; side < 6; side++)
+	{
+		cyMatrix4f faceView(cy::GLRenderDepthCube::GetRotation((cy::GLTextureCubeMapSide)side));
+		(projection * faceView * toLight).Get(shadow->FaceViewProjections[side]);
+	}
+	for (int i = 0; i < 3; i++)
+	{
+		shadow->LightPosition[i] = lightPosition[i];
+	}
+	shadow->FarPlane = FarPlane;
+
+	ShadowMap.Bind();
+	glClear(GL_DEPTH_BUFFER_BIT);
+	//Both sides are drawn so open meshes still cast; receivers offset their lookup instead
+	glDisable(GL_CULL_FACE);
+	GLStateCache::UseProgram(Program.GetID());
+	UniformRing->Bind(SHADOW_UNIFORM_BINDING, shadowOffset, sizeof(ShadowUniformBlock));
+	for (size_t i = 0; i < casters.size(); i++)
+	{
+		if (!Casters[i].Loaded)
+		{
+			continue;
+		}
+		GLintptr offset;
+		ObjectUniformBlock* block = (ObjectUniformBlock*)UniformRing->Allocate(sizeof(ObjectUniformBlock), offset);
+		if (!block)
+		{
+			break;
+		}
+		RenderableObject* caster = casters[i];
+		FillObjectUniforms(*block, Casters[i].Model, caster->GetModelNormalTransform(), caster->ObjectMaterial, caster->GetVertexDecode());
+		UniformRing->Bind(OBJECT_UNIFORM_BINDING, offset, sizeof(ObjectUniformBlock));
+		caster->DrawLod(0);
+	}
+	glEnable(GL_CULL_FACE);
+	ShadowMap.Unbind();
+	UniformRing->EndFrame();
+	RenderCount++;
+}
+
+void PointLightShadow::Bind() const
+{
+	GLStateCache::BindTexture(POINT_LIGHT_SHADOW_TEXTURE_UNIT, GL_TEXTURE_CUBE_MAP, ShadowMap.GetTextureID());
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include "GL/glew.h"
+#include "cyMatrix.h"
+#include "cyGL.h"
+#include "PointLight.h"
+#include "RenderableObject.h"
+#include "UniformRingBuffer.h"
+
+//Texture unit of the shadow cube map, after the lighting grid units.
+#define POINT_LIGHT_SHADOW_TEXTURE_UNIT 5
+
+//Uniform block binding of ShadowUniforms in shadow.vert, shadow.geom and shadow.frag.
+#define SHADOW_UNIFORM_BINDING 3
+
+#define POINT_LIGHT_SHADOW_SIZE 1024
+#define POINT_LIGHT_SHADOW_NEAR_PLANE 0.1f
+
+//Uniform bytes one shadow pass may write: the face block and one object block per caster.
+#define POINT_LIGHT_SHADOW_UNIFORM_SIZE (64 * 1024)
+
+//std140 mirror of the ShadowUniforms block.
+struct ShadowUniformBlock
+{
+	float FaceViewProjections[6][16];
+	float LightPosition[3]; //world space
+	float FarPlane;
+};
+
+//Omnidirectional shadow map of a point light. The six faces of a depth cube map are drawn in one pass, a geometry
+//shader sending each triangle to the faces it touches with gl_Layer. Depth is the distance to the light over the
+//far plane, so receivers compare against it in world space without knowing which face they fall on.
+//The map is only drawn again when the light, a caster's transform or the set of loaded casters changes.
+class PointLightShadow
+{
+public:
+	//shaderDirectory holds shadow.vert, shadow.geom and shadow.frag.
+	PointLightShadow(const std::string& shaderDirectory, int size = POINT_LIGHT_SHADOW_SIZE);
+	~PointLightShadow();
+
+	bool IsValid() const { return Valid; }
+
+	//Draws the cube map if the light or any caster changed since the last call; returns true if it did.
+	//Casters draw their finest LOD, and only once they are fully uploaded.
+	bool Update(const PointLight& light, const std::vector<RenderableObject*>& casters);
+
+	//Forces the next Update to draw, for changes it cannot see such as new geometry.
+	void Invalidate() { Dirty = true; }
+
+	//Binds the cube map for samplerCubeShadow PointShadowMap.
+	void Bind() const;
+
+	//Distance mapped to depth 1; 0 until the map is first drawn.
+	float GetFarPlane() const { return FarPlane; }
+	unsigned int GetRenderCount() const { return RenderCount; }
+
+private:
+	struct CasterState
+	{
+		const RenderableObject* Object = NULL;
+		cyMatrix4f Model;
+		bool Loaded = false;
+	};
+
+	void Render(const std::vector<RenderableObject*>& casters);
+
+	cy::GLRenderDepthCube ShadowMap;
+	cy::GLSLProgram Program;
+	UniformRingBuffer* UniformRing;
+	bool Valid;
+
+	bool Dirty;
+	cyVec4f LastLightPosition;
+	std::vector<CasterState> Casters;
+	float FarPlane;
+	unsigned int RenderCount;
+};
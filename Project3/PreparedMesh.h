@@ -0,0 +1,90 @@
+#pragma once
+
+#include <vector>
+#include "cyVector.h"
+#include "VertexFormat.h"
+#include "MeshOptimizer.h"
+#include "Meshlet.h"
+
+//Submesh and meshlet ranges of the index buffer holding one LOD.
+struct RenderLod
+{
+	unsigned int FirstSubmesh;
+	unsigned int SubmeshCount;
+	unsigned int FirstMeshlet;
+	unsigned int MeshletCount;
+	unsigned int TriangleCount;
+	float Error;
+};
+
+//Read only pointers to a mesh exactly as RenderableObject uploads it, either owned by a PreparedMesh or mapped from a
+//MeshCache. Streams the layout or index size does not use are NULL.
+struct PreparedMeshView
+{
+	const cyVec3f* Positions; //VertexLayoutSeparateFloat streams
+	const cyVec3f* Normals;
+	const cyVec2f* TexCoords;
+	const PackedVertex* PackedVertices; //interleaved layouts
+	unsigned int VertexCount;
+
+	const unsigned short* ShortIndices;
+	const int* WideIndices;
+	unsigned int IndexCount;
+	const Submesh* Submeshes;
+	unsigned int SubmeshCount;
+	const RenderLod* Lods; //full detail first
+	unsigned int LodCount;
+	const Meshlet* Meshlets;
+	const unsigned int* MeshletVertexEnds; //one past the highest vertex each meshlet reads, base vertex included
+	unsigned int MeshletCount;
+	bool HasBaseVertices;
+
+	cyVec3f BoundMin;
+	cyVec3f BoundMax;
+};
+
+//Mesh in its GPU layout: vertex streams in the load options' layout, the index buffers of every LOD split into
+//submeshes, and the meshlets culled while drawing. Built without touching GL so it can run on a loader thread.
+struct PreparedMesh
+{
+	std::vector<cyVec3f> Positions;
+	std::vector<cyVec3f> Normals;
+	std::vector<cyVec2f> TexCoords;
+	std::vector<PackedVertex> PackedVertices;
+	unsigned int VertexCount;
+
+	std::vector<unsigned short> ShortIndices;
+	std::vector<int> WideIndices;
+	std::vector<Submesh> Submeshes;
+	std::vector<RenderLod> Lods;
+	std::vector<Meshlet> Meshlets;
+	std::vector<unsigned int> MeshletVertexEnds;
+	bool HasBaseVertices;
+
+	cyVec3f BoundMin;
+	cyVec3f BoundMax;
+
+	PreparedMeshView View() const
+	{
+		PreparedMeshView view;
+		view.Positions = Positions.empty() ? NULL : Positions.data();
+		view.Normals = Normals.empty() ? NULL : Normals.data();
+		view.TexCoords = TexCoords.empty() ? NULL : TexCoords.data();
+		view.PackedVertices = PackedVertices.empty() ? NULL : PackedVertices.data();
+		view.VertexCount = VertexCount;
+		view.ShortIndices = ShortIndices.empty() ? NULL : ShortIndices.data();
+		view.WideIndices = WideIndices.empty() ? NULL : WideIndices.data();
+		view.IndexCount = (unsigned int)(ShortIndices.empty() ? WideIndices.size() : ShortIndices.size());
+		view.Submeshes = Submeshes.data();
+		view.SubmeshCount = (unsigned int)Submeshes.size();
+		view.Lods = Lods.data();
+		view.LodCount = (unsigned int)Lods.size();
+		view.Meshlets = Meshlets.data();
+		view.MeshletVertexEnds = MeshletVertexEnds.data();
+		view.MeshletCount = (unsigned int)Meshlets.size();
+		view.HasBaseVertices = HasBaseVertices;
+		view.BoundMin = BoundMin;
+		view.BoundMax = BoundMax;
+		return view;
+	}
+};
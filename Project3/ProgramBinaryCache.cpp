@@ -0,0 +1,231 @@
+#include "ProgramBinaryCache.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <fstream>
+#include <sstream>
+
+static const char ProgramBinaryCacheMagic[8] = { 'C', 'Y', 'P', 'R', 'O', 'G', 0, 0 };
+
+struct ProgramBinaryHeader
+{
+	char Magic[8];
+	unsigned int Version;
+	unsigned int Format;
+	unsigned long long Key;
+	unsigned long long Length;
+};
+
+std::string ProgramBinaryCache::Directory;
+unsigned int ProgramBinaryCache::HitCount = 0;
+unsigned int ProgramBinaryCache::MissCount = 0;
+
+//64 bit FNV-1a, continued from hash.
+static unsigned long long hashBytes(unsigned long long hash, const void* data, size_t size)
+{
+	const unsigned char* bytes = (const unsigned char*)data;
+	for (size_t i = 0; i < size; i++)
+	{
+		hash ^= bytes[i];
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+static unsigned long long hashString(unsigned long long hash, const char* text)
+{
+	if (!text)
+	{
+		text = "";
+	}
+	//The terminator keeps "ab" + "c" apart from "a" + "bc"
+	return hashBytes(hash, text, strlen(text) + 1);
+}
+
+void ProgramBinaryCache::SetDirectory(const std::string& directory)
+{
+	Directory = directory;
+}
+
+bool ProgramBinaryCache::IsEnabled()
+{
+	if (Directory.empty() || !(GLEW_VERSION_4_1 || GLEW_ARB_get_program_binary))
+	{
+		return false;
+	}
+	//Drivers may support the extension without offering a single binary format
+	static GLint formatCount = -1;
+	if (formatCount < 0)
+	{
+		formatCount = 0;
+		glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formatCount);
+	}
+	return formatCount > 0;
+}
+
+unsigned long long ProgramBinaryCache::Key(const std::string* sources, int sourceCount)
+{
+	unsigned long long hash = 14695981039346656037ull;
+	hash = hashString(hash, (const char*)glGetString(GL_VENDOR));
+	hash = hashString(hash, (const char*)glGetString(GL_RENDERER));
+	hash = hashString(hash, (const char*)glGetString(GL_VERSION));
+	for (int i = 0; i < sourceCount; i++)
+	{
+		hash = hashString(hash, sources[i].c_str());
+	}
+	return hash;
+}
+
+bool ProgramBinaryCache::KeyForFiles(const char* const* filenames, int fileCount, unsigned long long& key)
+{
+	std::vector<std::string> sources(fileCount);
+	for (int i = 0; i < fileCount; i++)
+	{
+		std::ifstream input(filenames[i]);
+		if (!input)
+		{
+			return false;
+		}
+		std::stringstream buffer;
+		buffer << input.rdbuf();
+		sources[i] = buffer.str();
+	}
+	key = Key(sources.data(), fileCount);
+	return true;
+}
+
+std::string ProgramBinaryCache::CacheFilename(unsigned long long key)
+{
+	char name[40];
+	snprintf(name, sizeof(name), "\\program-%016llx.cyprog", key);
+	return Directory + name;
+}
+
+bool ProgramBinaryCache::Read(unsigned long long key, GLenum& format, std::vector<char>& binary)
+{
+	if (!IsEnabled())
+	{
+		return false;
+	}
+	FILE* file = fopen(CacheFilename(key).c_str(), "rb");
+	if (!file)
+	{
+		return false;
+	}
+	ProgramBinaryHeader header;
+	bool success = fread(&header, sizeof(header), 1, file) == 1 &&
+		memcmp(header.Magic, ProgramBinaryCacheMagic, sizeof(header.Magic)) == 0 &&
+		header.Version == PROGRAM_BINARY_CACHE_VERSION && header.Key == key &&
+		header.Length > 0 && header.Length < 0x7fffffff;
+	if (success)
+	{
+		binary.resize((size_t)header.Length);
+		success = fread(binary.data(), 1, binary.size(), file) == binary.size();
+		format = header.Format;
+	}
+	fclose(file);
+	return success;
+}
+
+bool ProgramBinaryCache::Write(unsigned long long key, GLenum format, const std::vector<char>& binary)
+{
+	ProgramBinaryHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.Magic, ProgramBinaryCacheMagic, sizeof(header.Magic));
+	header.Version = PROGRAM_BINARY_CACHE_VERSION;
+	header.Format = format;
+	header.Key = key;
+	header.Length = binary.size();
+
+	//Write to a temporary file first so an interrupted write never leaves a truncated cache behind.
+	std::string cacheFilename = CacheFilename(key);
+	std::string temporaryFilename = cacheFilename + ".tmp";
+	FILE* file = fopen(temporaryFilename.c_str(), "wb");
+	if (!file)
+	{
+		return false;
+	}
+	bool success = fwrite(&header, sizeof(header), 1, file) == 1 && fwrite(binary.data(), 1, binary.size(), file) == binary.size();
+	success = (fclose(file) == 0) && success;
+
+	if (success)
+	{
+		remove(cacheFilename.c_str());
+		success = rename(temporaryFilename.c_str(), cacheFilename.c_str()) == 0;
+	}
+	if (!success)
+	{
+		remove(temporaryFilename.c_str());
+	}
+	return success;
+}
+
+GLuint ProgramBinaryCache::Load(unsigned long long key)
+{
+	GLenum format;
+	std::vector<char> binary;
+	if (!Read(key, format, binary))
+	{
+		MissCount += IsEnabled() ? 1 : 0;
+		return 0;
+	}
+	GLuint program = glCreateProgram();
+	glProgramBinary(program, format, binary.data(), (GLsizei)binary.size());
+	GLint linkSuccess = GL_FALSE;
+	glGetProgramiv(program, GL_LINK_STATUS, &linkSuccess);
+	if (!linkSuccess)
+	{
+		glDeleteProgram(program);
+		MissCount++;
+		return 0;
+	}
+	HitCount++;
+	return program;
+}
+
+bool ProgramBinaryCache::Load(unsigned long long key, cy::GLSLProgram& program)
+{
+	GLenum format;
+	std::vector<char> binary;
+	if (!Read(key, format, binary) || !program.LoadBinary(format, binary.data(), (GLsizei)binary.size()))
+	{
+		MissCount += IsEnabled() ? 1 : 0;
+		return false;
+	}
+	HitCount++;
+	return true;
+}
+
+void ProgramBinaryCache::PrepareForLink(GLuint program)
+{
+	if (IsEnabled())
+	{
+		glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+	}
+}
+
+bool ProgramBinaryCache::Save(unsigned long long key, GLuint program)
+{
+	if (!IsEnabled())
+	{
+		return false;
+	}
+	GLint length = 0;
+	glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+	if (length <= 0)
+	{
+		return false;
+	}
+	std::vector<char> binary(length);
+	GLenum format = 0;
+	glGetProgramBinary(program, length, &length, &format, binary.data());
+	binary.resize(length);
+	return length > 0 && Write(key, format, binary);
+}
+
+bool ProgramBinaryCache::Save(unsigned long long key, const cy::GLSLProgram& program)
+{
+	GLenum format;
+	std::vector<char> binary;
+	return IsEnabled() && program.GetBinary(binary, format) && Write(key, format, binary);
+}
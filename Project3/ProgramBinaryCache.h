@@ -0,0 +1,48 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include "GL/glew.h"
+#include "cyGL.h"
+
+//Bump whenever the layout of the cache file changes.
+#define PROGRAM_BINARY_CACHE_VERSION 1
+
+//Cache (.cyprog) of linked program binaries from glGetProgramBinary, so later startups skip compiling and linking.
+//Entries are keyed by a hash of the program's sources, with their #defines inserted, and the driver's vendor, renderer
+//and version strings. A binary the driver no longer accepts, such as after a driver update, is silently rebuilt from
+//source and written again. The cache stays off until SetDirectory and without OpenGL 4.1 or ARB_get_program_binary.
+class ProgramBinaryCache
+{
+public:
+	//Directory the cache files go to; an empty one turns the cache off.
+	static void SetDirectory(const std::string& directory);
+	static bool IsEnabled();
+
+	//sources are the stages' texts exactly as they are compiled.
+	static unsigned long long Key(const std::string* sources, int sourceCount);
+	//Key of the files as cyGL's BuildFiles compiles them; false if one cannot be read.
+	static bool KeyForFiles(const char* const* filenames, int fileCount, unsigned long long& key);
+
+	//A linked program from the cache, or 0 when there is no entry or the driver rejects it.
+	static GLuint Load(unsigned long long key);
+	static bool Load(unsigned long long key, cy::GLSLProgram& program);
+
+	//Hints the driver to keep the binary of a program about to be linked.
+	static void PrepareForLink(GLuint program);
+	//Stores a successfully linked program.
+	static bool Save(unsigned long long key, GLuint program);
+	static bool Save(unsigned long long key, const cy::GLSLProgram& program);
+
+	static unsigned int GetHitCount() { return HitCount; }
+	static unsigned int GetMissCount() { return MissCount; }
+
+private:
+	static bool Read(unsigned long long key, GLenum& format, std::vector<char>& binary);
+	static bool Write(unsigned long long key, GLenum format, const std::vector<char>& binary);
+	static std::string CacheFilename(unsigned long long key);
+
+	static std::string Directory;
+	static unsigned int HitCount;
+	static unsigned int MissCount;
+};
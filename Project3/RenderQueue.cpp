@@ -0,0 +1,90 @@
+#include "RenderQueue.h"
+#include "TraceProfiler.h"
+
+#include <string.h>
+
+void RenderQueue::Clear()
+{
+	Items.clear();
+	Keys.clear();
+}
+
+unsigned int RenderQueue::MaterialId(const Material* material)
+{
+	for (size_t i = 0; i < Materials.size(); i++)
+	{
+		if (Materials[i] == material)
+		{
+			return (unsigned int)i;
+		}
+	}
+	Materials.push_back(material);
+	return (unsigned int)Materials.size() - 1;
+}
+
+void RenderQueue::Add(Shader* shader, RenderableObject* object, const cyMatrix4f& view)
+{
+	RenderItem item = { shader, object };
+	Items.push_back(item);
+
+	//The bits of a non negative float sort like the float itself, so their top bits make a logarithmic depth bucket
+	cyVec3f viewCenter = (view * (object->CalculateModelTransform() * cyVec4f(object->GetBoundingBoxCenter(), 1))).XYZ();
+	float depth = viewCenter.z < 0 ? -viewCenter.z : 0.0f;
+	unsigned int depthBits;
+	memcpy(&depthBits, &depth, sizeof(depthBits));
+
+	unsigned long long key = shader->GetProgram(object) & ((1u << RENDER_KEY_PROGRAM_BITS) - 1);
+	key = (key << RENDER_KEY_MATERIAL_BITS) | (MaterialId(object->ObjectMaterial) & ((1u << RENDER_KEY_MATERIAL_BITS) - 1));
+	key = (key << RENDER_KEY_VERTEX_ARRAY_BITS) | (object->GetVertexArray() & ((1u << RENDER_KEY_VERTEX_ARRAY_BITS) - 1));
+	key = (key << RENDER_KEY_DEPTH_BITS) | (depthBits >> (31 - RENDER_KEY_DEPTH_BITS));
+	Keys.push_back(key);
+}
+
+void RenderQueue::Sort()
+{
+	size_t count = Items.size();
+	Order.resize(count);
+	for (size_t i = 0; i < count; i++)
+	{
+		Order[i] = (unsigned int)i;
+	}
+	SwapKeys.resize(count);
+	SwapOrder.resize(count);
+
+	//Least significant byte first; a stable counting sort per byte leaves the keys fully sorted after the last one
+	unsigned int keyBits = RENDER_KEY_PROGRAM_BITS + RENDER_KEY_MATERIAL_BITS + RENDER_KEY_VERTEX_ARRAY_BITS + RENDER_KEY_DEPTH_BITS;
+	for (unsigned int shift = 0; shift < keyBits; shift += 8)
+	{
+		unsigned int offsets[257] = {};
+		for (size_t i = 0; i < count; i++)
+		{
+			offsets[((Keys[i] >> shift) & 0xFF) + 1]++;
+		}
+		//Every key agrees on this byte, so the pass would not move anything
+		if (count == 0 || offsets[((Keys[0] >> shift) & 0xFF) + 1] == count)
+		{
+			continue;
+		}
+		for (int bucket = 0; bucket < 256; bucket++)
+		{
+			offsets[bucket + 1] += offsets[bucket];
+		}
+		for (size_t i = 0; i < count; i++)
+		{
+			unsigned int slot = offsets[(Keys[i] >> shift) & 0xFF]++;
+			SwapKeys[slot] = Keys[i];
+			SwapOrder[slot] = Order[i];
+		}
+		Keys.swap(SwapKeys);
+		Order.swap(SwapOrder);
+	}
+}
+
+void RenderQueue::Submit()
+{
+	TRACE_SCOPE("submit render queue");
+	for (unsigned int item : Order)
+	{
+		Items[item].ItemShader->Draw(Items[item].Object);
+	}
+}
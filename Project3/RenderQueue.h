@@ -0,0 +1,51 @@
+#pragma once
+
+#include <vector>
+#include "cyMatrix.h"
+#include "Material.h"
+#include "RenderableObject.h"
+#include "Shader.h"
+
+//Widths of the sort key fields, most significant first. Items sharing a program, then a material, then a vertex
+//array end up next to each other, and within the same state they are drawn front to back.
+#define RENDER_KEY_PROGRAM_BITS 12
+#define RENDER_KEY_MATERIAL_BITS 16
+#define RENDER_KEY_VERTEX_ARRAY_BITS 16
+#define RENDER_KEY_DEPTH_BITS 20
+
+//Collects the frame's draws, sorts them by a 64 bit state key with a radix sort and submits them in that order,
+//so the GLStateCache can skip the binds shared by neighbouring items.
+class RenderQueue
+{
+public:
+	void Clear();
+
+	//Queues the object for drawing with the shader. view places it for the depth part of the key.
+	void Add(Shader* shader, RenderableObject* object, const cyMatrix4f& view);
+
+	void Sort();
+
+	//Draws the items in key order; each shader's BeginFrame must already have been called.
+	void Submit();
+
+	unsigned int Count() const { return (unsigned int)Items.size(); }
+
+private:
+	struct RenderItem
+	{
+		Shader* ItemShader;
+		RenderableObject* Object;
+	};
+
+	unsigned int MaterialId(const Material* material);
+
+	std::vector<RenderItem> Items;
+	std::vector<unsigned long long> Keys;
+	std::vector<unsigned int> Order; //item indices in key order after Sort
+
+	//Scratch of the radix sort
+	std::vector<unsigned long long> SwapKeys;
+	std::vector<unsigned int> SwapOrder;
+
+	std::vector<const Material*> Materials; //position is the material field of the key, kept across frames
+};
@@ -1,37 +1,87 @@
 #include "RenderableObject.h"
 
 #include "cyTriMesh.h"
-#include <map>
+#include "MeshWelder.h"
+#include "MeshCache.h"
+#include "MeshOptimizer.h"
+#include "MeshSimplifier.h"
+#include "Meshlet.h"
+#include "cyTimer.h"
+#include "TraceProfiler.h"
+#include <stddef.h>
 #include <stdio.h>
 #include <fstream>
 #include <sstream>
 #include <stdlib.h>
+#include <math.h>
+#include <algorithm>
 
-struct ObjFileIndexData
+RenderableObject::RenderableObject(char* objFilename, Material * material, const MeshLoadOptions& options)
+	: MeshPrepared(false)
 {
-	int BuffersIndex;
-	int VertexPositionIndex;
-	int NormalPositionIndex;
-	int UVPositionIndex;
-};
+	Options = options;
 
-RenderableObject::RenderableObject(char* objFilename, Material * material)
-{
 	Position = cyVec3f(0, 0, 0);
 	Scale = cyVec3f(1, 1, 1);
 	RotationAngles = cyVec3f(0, 0, 0);
+	CenterOnBoundingBox = false;
+	LodScreenError = DEFAULT_LOD_SCREEN_ERROR;
+	ModelTransformValid = false;
 
 	glGenVertexArrays(1, &VAO);
-	glBindVertexArray(VAO);
+	GLStateCache::BindVertexArray(VAO);
 	
 	ObjectMaterial = material;
 
-	InitializeFromObjFile(objFilename);
+	//Nothing is drawn until the first part of the mesh is uploaded
+	CurrentLod = 0;
+	DrawnTriangleCount = 0;
+	HasBaseVertices = false;
+	IndexType = GL_UNSIGNED_INT;
+	VertexCount = 0;
+	IndexCount = 0;
+	InterleavedVertexBufferObject = 0;
+	IndexBuffer = 0;
+	BoundingBoxCenter = cyVec3f(0, 0, 0);
+	BoundingRadius = 0;
+	VertexDecode = GetVertexDecodeParameters(VertexLayoutSeparateFloat, cyVec3f(0, 0, 0), cyVec3f(1, 1, 1));
+	LoadFailed = false;
+	BuffersCreated = false;
+	UploadComplete = false;
+	UploadedVertices = 0;
+	UploadedIndices = 0;
+	ReadyMeshletCount = 0;
+	UploadFrames = 0;
+
+	Pending.reset(new PendingMesh());
+	if (Options.AsyncLoad)
+	{
+		LoaderThread = std::thread(&RenderableObject::LoadOnWorkerThread, this, std::string(objFilename));
+	}
+	else
+	{
+		LoadOnWorkerThread(objFilename);
+		ContinueLoading((size_t)-1);
+	}
 
 }
 
-cyMatrix4f RenderableObject::CalculateModelTransform()
+RenderableObject::~RenderableObject()
 {
+	if (LoaderThread.joinable())
+	{
+		LoaderThread.join();
+	}
+}
+
+const cyMatrix4f& RenderableObject::CalculateModelTransform()
+{
+	if (ModelTransformValid && ModelTransformPosition == Position && ModelTransformScale == Scale &&
+		ModelTransformRotationAngles == RotationAngles && ModelTransformCentered == CenterOnBoundingBox)
+	{
+		return ModelTransform;
+	}
+
 	cyMatrix4f modelTransform = cyMatrix4f::Identity();
 	if (CenterOnBoundingBox)
 	{
@@ -40,118 +90,624 @@ cyMatrix4f RenderableObject::CalculateModelTransform()
 	modelTransform = cyMatrix4f::Translation(Position) * cyMatrix4f::Scale(Scale) *
 		cyMatrix4f::RotationX(RotationAngles.x) * cyMatrix4f::RotationY(RotationAngles.y) * 
 		cyMatrix4f::RotationZ(RotationAngles.z) * modelTransform;
-	return modelTransform;
+	ModelTransform = modelTransform;
+	ModelNormalTransform = modelTransform.GetSubMatrix3();
+	ModelNormalTransform.Invert();
+	ModelNormalTransform.Transpose();
+
+	ModelTransformPosition = Position;
+	ModelTransformScale = Scale;
+	ModelTransformRotationAngles = RotationAngles;
+	ModelTransformCentered = CenterOnBoundingBox;
+	ModelTransformValid = true;
+	return ModelTransform;
+}
+
+const cyMatrix3f& RenderableObject::GetModelNormalTransform()
+{
+	CalculateModelTransform();
+	return ModelNormalTransform;
 }
 
 void RenderableObject::Draw()
 {
-	glBindVertexArray(VAO);
+	GLStateCache::BindVertexArray(VAO);
+
+	if (Options.ClusterCulling || !UploadComplete)
+	{
+		if (VisibleIndexCounts.empty())
+		{
+			return;
+		}
+		if (HasBaseVertices)
+		{
+			glMultiDrawElementsBaseVertex(GL_TRIANGLES, VisibleIndexCounts.data(), IndexType, VisibleIndexOffsets.data(),
+				(GLsizei)VisibleIndexCounts.size(), VisibleBaseVertices.data());
+		}
+		else
+		{
+			glMultiDrawElements(GL_TRIANGLES, VisibleIndexCounts.data(), IndexType, VisibleIndexOffsets.data(), (GLsizei)VisibleIndexCounts.size());
+		}
+		return;
+	}
+
+	if (Lods.empty())
+	{
+		return;
+	}
+	DrawnTriangleCount = Lods[CurrentLod].TriangleCount;
+	DrawLod(CurrentLod);
+}
+
+void RenderableObject::DrawLod(int lodIndex)
+{
+	if (!UploadComplete || Lods.empty())
+	{
+		return;
+	}
+	GLStateCache::BindVertexArray(VAO);
+	const RenderLod& lod = Lods[lodIndex];
+	if (lod.SubmeshCount > 1)
+	{
+		glMultiDrawElementsBaseVertex(GL_TRIANGLES, &SubmeshIndexCounts[lod.FirstSubmesh], IndexType, &SubmeshIndexOffsets[lod.FirstSubmesh],
+			(GLsizei)lod.SubmeshCount, &SubmeshBaseVertices[lod.FirstSubmesh]);
+	}
+	else
+	{
+		glDrawElementsBaseVertex(GL_TRIANGLES, SubmeshIndexCounts[lod.FirstSubmesh], IndexType, SubmeshIndexOffsets[lod.FirstSubmesh],
+			SubmeshBaseVertices[lod.FirstSubmesh]);
+	}
+}
+
+void RenderableObject::SelectLod(const cyMatrix4f& modelView, const cyMatrix4f& projection)
+{
+	CurrentLod = UploadComplete ? LodForModelView(modelView, projection) : 0;
+}
+
+int RenderableObject::LodForModelView(const cyMatrix4f& modelView, const cyMatrix4f& projection) const
+{
+	//The view transform is rigid, so the longest axis of the model view matrix is the model's largest scale
+	const float* c = modelView.cell;
+	float scale = sqrtf(std::max(cyVec3f(c[0], c[1], c[2]).LengthSquared(), std::max(cyVec3f(c[4], c[5], c[6]).LengthSquared(), cyVec3f(c[8], c[9], c[10]).LengthSquared())));
+
+	//Distance from the eye to the nearest point of the bounding sphere
+	cyVec3f viewCenter = (modelView * cyVec4f(BoundingBoxCenter, 1)).XYZ();
+	float nearestDepth = -viewCenter.z - BoundingRadius * scale;
+	return LodForDepth(nearestDepth, scale, projection);
+}
+
+const Submesh* RenderableObject::GetLodSubmeshes(int lod, unsigned int& count) const
+{
+	count = Lods[lod].SubmeshCount;
+	return &Submeshes[Lods[lod].FirstSubmesh];
+}
+
+void RenderableObject::SetPackedVertexAttributes(VertexLayout layout)
+{
+	if (layout == VertexLayoutInterleavedHalf)
+	{
+		glVertexAttribPointer(0, 3, GL_HALF_FLOAT, GL_FALSE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, Position));
+	}
+	else
+	{
+		glVertexAttribPointer(0, 3, GL_UNSIGNED_SHORT, GL_TRUE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, Position));
+	}
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(1, 2, GL_SHORT, GL_TRUE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, Normal));
+	glEnableVertexAttribArray(1);
+	glVertexAttribPointer(2, 2, GL_HALF_FLOAT, GL_FALSE, sizeof(PackedVertex), (void*)offsetof(PackedVertex, TexCoord));
+	glEnableVertexAttribArray(2);
+}
+
+int RenderableObject::LodForDepth(float nearestDepth, float scale, const cyMatrix4f& projection) const
+{
+	int lod = 0;
+	if (nearestDepth <= 0)
+	{
+		return lod;
+	}
+
+	//projection.cell[5] scales view space height to normalized device coordinates, which span 2 screen heights
+	float screenErrorPerUnit = scale * projection.cell[5] / (2 * nearestDepth);
+	while (lod + 1 < (int)Lods.size() && Lods[lod + 1].Error * screenErrorPerUnit <= LodScreenError)
+	{
+		lod++;
+	}
+	return lod;
+}
+
+void RenderableObject::CullMeshlets(const cyMatrix4f& modelView, const cyMatrix4f& projection)
+{
+	VisibleIndexCounts.clear();
+	VisibleIndexOffsets.clear();
+	VisibleBaseVertices.clear();
+	DrawnTriangleCount = 0;
+	if (Lods.empty() || (UploadComplete && !Options.ClusterCulling))
+	{
+		return;
+	}
+
+	MeshletCuller culler;
+	culler.Set(modelView, projection);
+	size_t indexSize = IndexType == GL_UNSIGNED_SHORT ? sizeof(unsigned short) : sizeof(int);
+	unsigned int nextIndex = 0;
+	const RenderLod& lod = Lods[CurrentLod];
+	//While loading, only the uploaded prefix of the full detail meshlets can be drawn
+	unsigned int meshletCount = UploadComplete ? lod.MeshletCount : ReadyMeshletCount;
+	for (unsigned int i = lod.FirstMeshlet; i < lod.FirstMeshlet + meshletCount; i++)
+	{
+		const Meshlet& meshlet = Meshlets[i];
+		if (Options.ClusterCulling && !culler.IsVisible(meshlet))
+		{
+			continue;
+		}
+		DrawnTriangleCount += meshlet.IndexCount / 3;
+
+		//Neighbouring visible meshlets are merged into one draw
+		if (!VisibleIndexCounts.empty() && meshlet.FirstIndex == nextIndex && meshlet.BaseVertex == VisibleBaseVertices.back())
+		{
+			VisibleIndexCounts.back() += meshlet.IndexCount;
+		}
+		else
+		{
+			VisibleIndexCounts.push_back((GLsizei)meshlet.IndexCount);
+			VisibleIndexOffsets.push_back((const void*)(meshlet.FirstIndex * indexSize));
+			VisibleBaseVertices.push_back(meshlet.BaseVertex);
+		}
+		nextIndex = meshlet.FirstIndex + meshlet.IndexCount;
+	}
+}
+
+void RenderableObject::DrawInstanced(InstanceBuffer& instances, const cyMatrix4f& view, const cyMatrix4f& projection)
+{
+	DrawnTriangleCount = 0;
+	if (!UploadComplete || Lods.empty())
+	{
+		return;
+	}
+
+	cyMatrix4f modelTransform = CalculateModelTransform();
+	cyVec4f modelCenter = modelTransform * cyVec4f(BoundingBoxCenter, 1);
+	float modelScale = std::max(fabsf(Scale.x), std::max(fabsf(Scale.y), fabsf(Scale.z)));
+	MeshletCuller frustum;
+	frustum.Set(cyMatrix4f::Identity(), projection);
+
+	//Count the surviving instances of each LOD, then copy them into the stream grouped by LOD
+	unsigned int instanceCount = instances.Count();
+	InstanceLods.resize(instanceCount);
+	std::vector<unsigned int> lodStarts(Lods.size() + 1, 0);
+	for (unsigned int i = 0; i < instanceCount; i++)
+	{
+		cyVec4f worldCenter(instances.TransformRow0[i].Dot(modelCenter), instances.TransformRow1[i].Dot(modelCenter),
+			instances.TransformRow2[i].Dot(modelCenter), 1);
+		cyVec3f viewCenter = (view * worldCenter).XYZ();
+		float scale = modelScale * instances.MaxScales[i];
+		float radius = BoundingRadius * scale;
+		if (!frustum.IsSphereVisible(viewCenter, radius))
+		{
+			InstanceLods[i] = -1;
+			continue;
+		}
+		InstanceLods[i] = LodForDepth(-viewCenter.z - radius, scale, projection);
+		lodStarts[InstanceLods[i] + 1]++;
+	}
+	for (size_t lod = 0; lod < Lods.size(); lod++)
+	{
+		lodStarts[lod + 1] += lodStarts[lod];
+	}
+
+	unsigned int visibleCount = lodStarts[Lods.size()];
+	if (instances.StreamRow0.size() < visibleCount)
+	{
+		instances.StreamRow0.resize(visibleCount);
+		instances.StreamRow1.resize(visibleCount);
+		instances.StreamRow2.resize(visibleCount);
+		instances.StreamColors.resize(visibleCount);
+	}
+	std::vector<unsigned int> lodNext(lodStarts.begin(), lodStarts.end() - 1);
+	for (unsigned int i = 0; i < instanceCount; i++)
+	{
+		if (InstanceLods[i] < 0)
+		{
+			continue;
+		}
+		unsigned int slot = lodNext[InstanceLods[i]]++;
+		instances.StreamRow0[slot] = instances.TransformRow0[i];
+		instances.StreamRow1[slot] = instances.TransformRow1[i];
+		instances.StreamRow2[slot] = instances.TransformRow2[i];
+		instances.StreamColors[slot] = instances.Colors[i];
+	}
 
-	glDrawElements(GL_TRIANGLES, IndexBufferCount, GL_UNSIGNED_INT, 0);
+	GLStateCache::BindVertexArray(VAO);
+	instances.Upload(visibleCount);
+	for (size_t lod = 0; lod < Lods.size(); lod++)
+	{
+		unsigned int lodInstanceCount = lodStarts[lod + 1] - lodStarts[lod];
+		if (lodInstanceCount == 0)
+		{
+			continue;
+		}
+		instances.BindAttributes(lodStarts[lod]);
+		const RenderLod& renderLod = Lods[lod];
+		for (unsigned int submesh = renderLod.FirstSubmesh; submesh < renderLod.FirstSubmesh + renderLod.SubmeshCount; submesh++)
+		{
+			glDrawElementsInstancedBaseVertex(GL_TRIANGLES, SubmeshIndexCounts[submesh], IndexType, SubmeshIndexOffsets[submesh],
+				lodInstanceCount, SubmeshBaseVertices[submesh]);
+		}
+		DrawnTriangleCount += renderLod.TriangleCount * lodInstanceCount;
+	}
+	InstanceBuffer::UnbindAttributes();
+}
 
+void RenderableObject::LoadOnWorkerThread(std::string filename)
+{
+	TRACE_THREAD_NAME("mesh loader");
+	LoadFailed = LoadMesh(filename.c_str(), *Pending) != 0;
+	MeshPrepared.store(true, std::memory_order_release);
 }
 
-int RenderableObject::InitializeFromObjFile(char* filename)
+int RenderableObject::LoadMesh(const char* filename, PendingMesh& pending)
 {
+	TRACE_SCOPE("load mesh");
+	cy::Timer loadTimer;
+	loadTimer.Start();
+
+	std::string cacheFilename = MeshCache::CacheFilenameForObj(filename);
+	unsigned int cacheFlags = (Options.OptimizeOverdraw ? MESH_CACHE_OVERDRAW_OPTIMIZED : 0) | (Options.ShortIndices ? MESH_CACHE_SHORT_INDICES : 0) |
+		(Options.GenerateLods ? MESH_CACHE_LODS : 0) | ((unsigned int)Options.Layout << MESH_CACHE_LAYOUT_SHIFT);
+	if (pending.Cache.Open(cacheFilename.c_str(), filename, cacheFlags))
+	{
+		//The flags pin the layout and index size, so only a damaged file lacks the streams they call for
+		pending.View = pending.Cache.View();
+		const PreparedMeshView& cached = pending.View;
+		bool hasVertices = Options.Layout == VertexLayoutSeparateFloat ? cached.Positions && cached.Normals && cached.TexCoords : cached.PackedVertices != NULL;
+		bool hasIndices = Options.ShortIndices ? cached.ShortIndices != NULL : cached.WideIndices != NULL;
+		if (hasVertices && hasIndices)
+		{
+			fprintf(stdout, "Status: Loaded %s in %.1f ms\n", cacheFilename.c_str(), loadTimer.Stop() * 1000.0);
+			return 0;
+		}
+		pending.Cache.Close();
+	}
+
 	cyTriMesh mesh;
-	bool loadObjSuccess = mesh.LoadFromFileObj(filename);
-	if (!loadObjSuccess)
 	{
-		fprintf(stderr, "Could not load obj file\n");
-		return -1;
+		TRACE_SCOPE("parse obj");
+		bool loadObjSuccess = mesh.LoadFromFileObjParallel(filename);
+		if (!loadObjSuccess)
+		{
+			fprintf(stderr, "Could not load obj file\n");
+			return -1;
+		}
+
+		mesh.ComputeBoundingBox();
+		if (!mesh.HasNormals())
+		{
+			mesh.ComputeNormals();
+		}
+	}
+
+	MeshData meshData;
+	BuildMeshData(mesh, meshData);
+	{
+		TRACE_SCOPE("optimize mesh");
+		OptimizeMeshData(meshData, Options.OptimizeOverdraw);
+	}
+	if (Options.GenerateLods)
+	{
+		TRACE_SCOPE("build lods");
+		BuildMeshLods(meshData);
 	}
+	{
+		TRACE_SCOPE("prepare mesh");
+		PrepareMesh(meshData.View(), pending.Prepared);
+	}
+	pending.View = pending.Prepared.View();
+	fprintf(stdout, "Status: Loaded %s in %.1f ms\n", filename, loadTimer.Stop() * 1000.0);
 
-	mesh.ComputeBoundingBox();
-	BoundingBoxCenter = mesh.GetBoundMin() + (mesh.GetBoundMax() - mesh.GetBoundMin()) / 2;
+	if (!MeshCache::Write(cacheFilename.c_str(), filename, cacheFlags, pending.View))
+	{
+		fprintf(stderr, "Could not write mesh cache %s\n", cacheFilename.c_str());
+	}
 
-	std::vector<int> elementBufferVector;
-	std::vector<ObjFileIndexData> objIndices;
+	return 0;
+}
 
-	std::map<int, std::vector<ObjFileIndexData>> indicesForObjPositionIndex;
-	
-	for (unsigned int i = 0; i < mesh.NF(); i++)
-	{
-		cy::TriMesh::TriFace face = mesh.F(i);
-		cy::TriMesh::TriFace faceNormal = mesh.FN(i);
-		cy::TriMesh::TriFace faceUV = mesh.FT(i);
-		
-		for (int j = 0; j < 3; j++)
-		{
-			int vertexObjIndex = face.v[j];
-			int normalIndex = faceNormal.v[j];
-			int uvIndex = faceUV.v[j];
-			std::vector<ObjFileIndexData> indicesForVertex = indicesForObjPositionIndex[vertexObjIndex];
-			bool found = false;
-			if (indicesForVertex.size() > 0)
+void RenderableObject::PrepareMesh(const MeshDataView& sourceMesh, PreparedMesh& prepared) const
+{
+	prepared.BoundMin = sourceMesh.BoundMin;
+	prepared.BoundMax = sourceMesh.BoundMax;
+
+	//Full detail followed by the simplified levels, all stored in one index buffer
+	std::vector<MeshLod> levels(1);
+	levels[0].FirstIndex = 0;
+	levels[0].IndexCount = sourceMesh.IndexCount;
+	levels[0].Error = 0;
+	levels.insert(levels.end(), sourceMesh.Lods, sourceMesh.Lods + sourceMesh.LodCount);
+
+	//When the full detail mesh has to be split for 16 bit indices, the simplified levels draw from its submeshes' vertex
+	//copies rather than splitting on their own, which would copy nearly every vertex again per level
+	std::vector<unsigned int> vertexSources;
+	std::vector<Submesh> fullDetailSubmeshes;
+	unsigned int fullDetailVertexCount = 0;
+	for (size_t level = 0; level < levels.size(); level++)
+	{
+		const int* levelIndices = (level == 0 ? sourceMesh.Indices : sourceMesh.LodIndices) + levels[level].FirstIndex;
+		RenderLod lod;
+		lod.FirstSubmesh = (unsigned int)prepared.Submeshes.size();
+		lod.FirstMeshlet = (unsigned int)prepared.Meshlets.size();
+		lod.Error = levels[level].Error;
+		if (Options.ShortIndices)
+		{
+			std::vector<unsigned short> levelShortIndices;
+			std::vector<int> levelOrderedIndices;
+			std::vector<Submesh> levelSubmeshes;
+			if (level == 0 || vertexSources.empty())
 			{
-				for (ObjFileIndexData indexData : indicesForVertex)
+				SplitForShortIndices(levelIndices, levels[level].IndexCount, sourceMesh.VertexCount, levelShortIndices, vertexSources, levelSubmeshes);
+				fullDetailSubmeshes = levelSubmeshes;
+				fullDetailVertexCount = (unsigned int)vertexSources.size();
+			}
+			else
+			{
+				SplitLodForShortIndices(levelIndices, levels[level].IndexCount, sourceMesh.VertexCount, fullDetailSubmeshes, fullDetailVertexCount,
+					vertexSources, levelShortIndices, levelOrderedIndices, levelSubmeshes);
+				levelIndices = levelOrderedIndices.data();
+			}
+			for (Submesh submesh : levelSubmeshes)
+			{
+				size_t firstMeshlet = prepared.Meshlets.size();
+				BuildMeshlets(levelIndices, submesh.FirstIndex, submesh.IndexCount, sourceMesh.Positions, prepared.Meshlets);
+				for (size_t i = firstMeshlet; i < prepared.Meshlets.size(); i++)
 				{
-					if (indexData.NormalPositionIndex == normalIndex && indexData.UVPositionIndex == uvIndex)
+					Meshlet& meshlet = prepared.Meshlets[i];
+					unsigned int vertexEnd = 0;
+					for (unsigned int j = meshlet.FirstIndex; j < meshlet.FirstIndex + meshlet.IndexCount; j++)
 					{
-						found = true;
-						elementBufferVector.push_back(indexData.BuffersIndex);
-						break;
+						vertexEnd = std::max(vertexEnd, (unsigned int)levelShortIndices[j] + 1);
 					}
+					meshlet.FirstIndex += (unsigned int)prepared.ShortIndices.size();
+					meshlet.BaseVertex = submesh.BaseVertex;
+					prepared.MeshletVertexEnds.push_back(vertexEnd + meshlet.BaseVertex);
 				}
+				submesh.FirstIndex += (unsigned int)prepared.ShortIndices.size();
+				prepared.Submeshes.push_back(submesh);
 			}
-			if (!found)
+			prepared.ShortIndices.insert(prepared.ShortIndices.end(), levelShortIndices.begin(), levelShortIndices.end());
+		}
+		else
+		{
+			size_t firstMeshlet = prepared.Meshlets.size();
+			BuildMeshlets(levelIndices, 0, levels[level].IndexCount, sourceMesh.Positions, prepared.Meshlets);
+			for (size_t i = firstMeshlet; i < prepared.Meshlets.size(); i++)
 			{
-				ObjFileIndexData indexData;
-				indexData.BuffersIndex = objIndices.size();
-				indexData.NormalPositionIndex = normalIndex;
-				indexData.UVPositionIndex = uvIndex;
-				indexData.VertexPositionIndex = vertexObjIndex;
-				indicesForObjPositionIndex[vertexObjIndex].push_back(indexData);
-				objIndices.push_back(indexData);
-				elementBufferVector.push_back(indexData.BuffersIndex);
+				Meshlet& meshlet = prepared.Meshlets[i];
+				unsigned int vertexEnd = 0;
+				for (unsigned int j = meshlet.FirstIndex; j < meshlet.FirstIndex + meshlet.IndexCount; j++)
+				{
+					vertexEnd = std::max(vertexEnd, (unsigned int)levelIndices[j] + 1);
+				}
+				meshlet.FirstIndex += (unsigned int)prepared.WideIndices.size();
+				prepared.MeshletVertexEnds.push_back(vertexEnd);
 			}
+			Submesh wholeLevel = { (unsigned int)prepared.WideIndices.size(), levels[level].IndexCount, 0 };
+			prepared.Submeshes.push_back(wholeLevel);
+			prepared.WideIndices.insert(prepared.WideIndices.end(), levelIndices, levelIndices + levels[level].IndexCount);
+		}
+		lod.SubmeshCount = (unsigned int)prepared.Submeshes.size() - lod.FirstSubmesh;
+		lod.MeshletCount = (unsigned int)prepared.Meshlets.size() - lod.FirstMeshlet;
+		lod.TriangleCount = levels[level].IndexCount / 3;
+		prepared.Lods.push_back(lod);
+	}
+	prepared.HasBaseVertices = !vertexSources.empty();
 
+	MeshData splitMesh;
+	MeshDataView mesh = sourceMesh;
+	if (!vertexSources.empty())
+	{
+		//Submeshes got their own copies of shared vertices
+		splitMesh.Positions.resize(vertexSources.size());
+		splitMesh.Normals.resize(vertexSources.size());
+		splitMesh.TexCoords.resize(vertexSources.size());
+		for (size_t i = 0; i < vertexSources.size(); i++)
+		{
+			splitMesh.Positions[i] = sourceMesh.Positions[vertexSources[i]];
+			splitMesh.Normals[i] = sourceMesh.Normals[vertexSources[i]];
+			splitMesh.TexCoords[i] = sourceMesh.TexCoords[vertexSources[i]];
 		}
+		mesh.Positions = splitMesh.Positions.data();
+		mesh.Normals = splitMesh.Normals.data();
+		mesh.TexCoords = splitMesh.TexCoords.data();
+		mesh.VertexCount = splitMesh.VertexCount();
 	}
 
-	int bufferSize = objIndices.size() * 3 * sizeof(float);
-	glGenBuffers(1, &VertexPosElementBufferObject);
-	glBindBuffer(GL_ARRAY_BUFFER, VertexPosElementBufferObject);
-	float* vertexPositions = new float[bufferSize];
-	for (int i = 0; i < objIndices.size(); i++)
+	prepared.VertexCount = mesh.VertexCount;
+
+	if (Options.Layout == VertexLayoutSeparateFloat)
 	{
-		cyVec3f vertexPosiion = mesh.V(objIndices[i].VertexPositionIndex);
-		vertexPositions[i*3] = vertexPosiion.x;
-		vertexPositions[i*3+1] = vertexPosiion.y;
-		vertexPositions[i*3+2] = vertexPosiion.z;
+		prepared.Positions.assign(mesh.Positions, mesh.Positions + mesh.VertexCount);
+		prepared.Normals.assign(mesh.Normals, mesh.Normals + mesh.VertexCount);
+		prepared.TexCoords.assign(mesh.TexCoords, mesh.TexCoords + mesh.VertexCount);
 	}
-	glBufferData(GL_ARRAY_BUFFER, bufferSize, vertexPositions, GL_STATIC_DRAW);
-	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, NULL);
-	glEnableVertexAttribArray(0);
-	delete[] vertexPositions;
+	else
+	{
+		VertexDecodeParameters vertexDecode = GetVertexDecodeParameters(Options.Layout, sourceMesh.BoundMin, sourceMesh.BoundMax);
+		PackVertices(Options.Layout, vertexDecode, mesh.Positions, mesh.Normals, mesh.TexCoords, mesh.VertexCount, prepared.PackedVertices);
+	}
+}
+
+void RenderableObject::CreateBuffers()
+{
+	TRACE_SCOPE("create mesh buffers");
+	const PreparedMeshView& prepared = Pending->View;
+	BoundingBoxCenter = prepared.BoundMin + (prepared.BoundMax - prepared.BoundMin) / 2;
+	ModelTransformValid = false;
+	BoundingRadius = (prepared.BoundMax - prepared.BoundMin).Length() / 2;
+	VertexDecode = GetVertexDecodeParameters(Options.Layout, prepared.BoundMin, prepared.BoundMax);
+	HasBaseVertices = prepared.HasBaseVertices;
+	Lods.assign(prepared.Lods, prepared.Lods + prepared.LodCount);
+	Meshlets.assign(prepared.Meshlets, prepared.Meshlets + prepared.MeshletCount);
+
+	GLStateCache::BindVertexArray(VAO);
 
-	glGenBuffers(1, &VertexNormalElementBufferObject);
-	glBindBuffer(GL_ARRAY_BUFFER, VertexNormalElementBufferObject);
-	float* normals = new float[bufferSize];
-	for (int i = 0; i < objIndices.size(); i++)
+	//Storage is allocated up front and filled by ContinueLoading
+	size_t vertexBytes;
+	if (Options.Layout == VertexLayoutSeparateFloat)
 	{
-		cyVec3f normal = mesh.VN(objIndices[i].NormalPositionIndex);
-		normals[i * 3] = normal.x;
-		normals[i * 3 + 1] = normal.y;
-		normals[i * 3 + 2] = normal.z;
+		glGenBuffers(1, &VertexPosElementBufferObject);
+		glBindBuffer(GL_ARRAY_BUFFER, VertexPosElementBufferObject);
+		glBufferData(GL_ARRAY_BUFFER, prepared.VertexCount * sizeof(cyVec3f), NULL, GL_STATIC_DRAW);
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, NULL);
+		glEnableVertexAttribArray(0);
+
+		glGenBuffers(1, &VertexNormalElementBufferObject);
+		glBindBuffer(GL_ARRAY_BUFFER, VertexNormalElementBufferObject);
+		glBufferData(GL_ARRAY_BUFFER, prepared.VertexCount * sizeof(cyVec3f), NULL, GL_STATIC_DRAW);
+		glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, NULL);
+		glEnableVertexAttribArray(1);
+
+		glGenBuffers(1, &VertexUVElementBufferObject);
+		glBindBuffer(GL_ARRAY_BUFFER, VertexUVElementBufferObject);
+		glBufferData(GL_ARRAY_BUFFER, prepared.VertexCount * sizeof(cyVec2f), NULL, GL_STATIC_DRAW);
+		glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 0, NULL);
+		glEnableVertexAttribArray(2);
+
+		vertexBytes = prepared.VertexCount * (2 * sizeof(cyVec3f) + sizeof(cyVec2f));
 	}
-	glBufferData(GL_ARRAY_BUFFER, bufferSize, normals, GL_STATIC_DRAW);
-	glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 0, NULL);
-	glEnableVertexAttribArray(1);
-	delete[] normals;
+	else
+	{
+		glGenBuffers(1, &InterleavedVertexBufferObject);
+		glBindBuffer(GL_ARRAY_BUFFER, InterleavedVertexBufferObject);
+		glBufferData(GL_ARRAY_BUFFER, prepared.VertexCount * sizeof(PackedVertex), NULL, GL_STATIC_DRAW);
+		SetPackedVertexAttributes(Options.Layout);
 
+		vertexBytes = prepared.VertexCount * sizeof(PackedVertex);
+	}
 
 	glGenBuffers(1, &IndexBuffer);
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, IndexBuffer);
-	IndexBufferCount = elementBufferVector.size();
-	float indexBufferSize = elementBufferVector.size() * sizeof(int);
-	int* elementsBuffer = new int[indexBufferSize];
-	for (int i = 0; i < elementBufferVector.size(); i++)
+	size_t indexSize;
+	if (Options.ShortIndices)
 	{
-		elementsBuffer[i] = elementBufferVector[i];
+		IndexType = GL_UNSIGNED_SHORT;
+		indexSize = sizeof(unsigned short);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, prepared.IndexCount * indexSize, NULL, GL_STATIC_DRAW);
+	}
+	else
+	{
+		IndexType = GL_UNSIGNED_INT;
+		indexSize = sizeof(int);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, prepared.IndexCount * indexSize, NULL, GL_STATIC_DRAW);
 	}
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexBufferSize, elementsBuffer, GL_STATIC_DRAW);
-	delete[] elementsBuffer;
 
-	return 0;
+	VertexCount = prepared.VertexCount;
+	IndexCount = prepared.IndexCount;
+	Submeshes.assign(prepared.Submeshes, prepared.Submeshes + prepared.SubmeshCount);
+	SubmeshIndexCounts.clear();
+	SubmeshIndexOffsets.clear();
+	SubmeshBaseVertices.clear();
+	for (const Submesh& submesh : Submeshes)
+	{
+		SubmeshIndexCounts.push_back((GLsizei)submesh.IndexCount);
+		SubmeshIndexOffsets.push_back((const void*)(submesh.FirstIndex * indexSize));
+		SubmeshBaseVertices.push_back(submesh.BaseVertex);
+	}
+
+	fprintf(stdout, "Status: %u vertices in %s layout, %.2f MB of vertex data, %d bit indices in %zu submesh(es) over %zu LOD(s), %zu meshlets\n",
+		prepared.VertexCount, VertexLayoutName(Options.Layout), vertexBytes / (1024.0 * 1024.0),
+		(int)indexSize * 8, Submeshes.size(), Lods.size(), Meshlets.size());
+}
+
+bool RenderableObject::ContinueLoading(size_t uploadBudget)
+{
+	if (UploadComplete)
+	{
+		return true;
+	}
+	if (!BuffersCreated)
+	{
+		if (!MeshPrepared.load(std::memory_order_acquire))
+		{
+			return false;
+		}
+		if (LoaderThread.joinable())
+		{
+			LoaderThread.join();
+		}
+		if (LoadFailed)
+		{
+			Pending.reset();
+			UploadComplete = true;
+			return true;
+		}
+		CreateBuffers();
+		BuffersCreated = true;
+		UploadTimer.Start();
+	}
+
+	TRACE_SCOPE("upload mesh");
+	const PreparedMeshView& prepared = Pending->View;
+	bool separateStreams = Options.Layout == VertexLayoutSeparateFloat;
+	size_t vertexSize = separateStreams ? 2 * sizeof(cyVec3f) + sizeof(cyVec2f) : sizeof(PackedVertex);
+	size_t indexSize = Options.ShortIndices ? sizeof(unsigned short) : sizeof(int);
+	unsigned int indexCount = prepared.IndexCount;
+
+	//Grow the uploaded ranges meshlet by meshlet so the full detail mesh appears in drawable pieces,
+	//then stream whatever the simplified levels still need
+	unsigned int vertexEnd = UploadedVertices;
+	unsigned int indexEnd = UploadedIndices;
+	const RenderLod& fullDetail = Lods[0];
+	while ((vertexEnd - UploadedVertices) * vertexSize + (indexEnd - UploadedIndices) * indexSize < uploadBudget)
+	{
+		if (ReadyMeshletCount < fullDetail.MeshletCount)
+		{
+			unsigned int meshletIndex = fullDetail.FirstMeshlet + ReadyMeshletCount;
+			const Meshlet& meshlet = Meshlets[meshletIndex];
+			vertexEnd = std::max(vertexEnd, prepared.MeshletVertexEnds[meshletIndex]);
+			indexEnd = std::max(indexEnd, meshlet.FirstIndex + meshlet.IndexCount);
+			ReadyMeshletCount++;
+			continue;
+		}
+		size_t remainingBudget = uploadBudget - ((vertexEnd - UploadedVertices) * vertexSize + (indexEnd - UploadedIndices) * indexSize);
+		vertexEnd = (unsigned int)std::min<size_t>(prepared.VertexCount, vertexEnd + remainingBudget / 2 / vertexSize + 1);
+		indexEnd = (unsigned int)std::min<size_t>(indexCount, indexEnd + remainingBudget / 2 / indexSize + 1);
+		break;
+	}
+
+	if (vertexEnd > UploadedVertices)
+	{
+		unsigned int count = vertexEnd - UploadedVertices;
+		if (separateStreams)
+		{
+			glBindBuffer(GL_ARRAY_BUFFER, VertexPosElementBufferObject);
+			glBufferSubData(GL_ARRAY_BUFFER, UploadedVertices * sizeof(cyVec3f), count * sizeof(cyVec3f), prepared.Positions + UploadedVertices);
+			glBindBuffer(GL_ARRAY_BUFFER, VertexNormalElementBufferObject);
+			glBufferSubData(GL_ARRAY_BUFFER, UploadedVertices * sizeof(cyVec3f), count * sizeof(cyVec3f), prepared.Normals + UploadedVertices);
+			glBindBuffer(GL_ARRAY_BUFFER, VertexUVElementBufferObject);
+			glBufferSubData(GL_ARRAY_BUFFER, UploadedVertices * sizeof(cyVec2f), count * sizeof(cyVec2f), prepared.TexCoords + UploadedVertices);
+		}
+		else
+		{
+			glBindBuffer(GL_ARRAY_BUFFER, InterleavedVertexBufferObject);
+			glBufferSubData(GL_ARRAY_BUFFER, UploadedVertices * sizeof(PackedVertex), count * sizeof(PackedVertex), prepared.PackedVertices + UploadedVertices);
+		}
+		UploadedVertices = vertexEnd;
+	}
+	if (indexEnd > UploadedIndices)
+	{
+		const void* indices = Options.ShortIndices ? (const void*)(prepared.ShortIndices + UploadedIndices) : (const void*)(prepared.WideIndices + UploadedIndices);
+		GLStateCache::BindVertexArray(VAO);
+		glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, UploadedIndices * indexSize, (indexEnd - UploadedIndices) * indexSize, indices);
+		UploadedIndices = indexEnd;
+	}
+	UploadFrames++;
+
+	if (UploadedVertices < prepared.VertexCount || UploadedIndices < indexCount)
+	{
+		return false;
+	}
+	fprintf(stdout, "Status: Uploaded mesh over %u frame(s) in %.1f ms\n", UploadFrames, UploadTimer.Stop() * 1000.0);
+	Pending.reset();
+	UploadComplete = true;
+	return true;
 }
@@ -3,41 +3,180 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <memory>
 #include "GL/glew.h"
 #include "GLFW/glfw3.h"
 #include "cyMatrix.h"
 #include "Material.h"
+#include "MeshData.h"
+#include "PreparedMesh.h"
+#include "MeshCache.h"
+#include "VertexFormat.h"
+#include "Meshlet.h"
+#include "cyTimer.h"
+#include "InstanceBuffer.h"
+#include "GLStateCache.h"
 
 
+//Fraction of the screen height a LOD's simplification error may cover before a finer LOD is drawn.
+#define DEFAULT_LOD_SCREEN_ERROR 0.001f
+
+//Bytes of vertex and index data ContinueLoading uploads per frame while a mesh streams in.
+#define MESH_UPLOAD_BYTES_PER_FRAME (4 * 1024 * 1024)
+
+//How a RenderableObject prepares its obj file for the GPU.
+struct MeshLoadOptions
+{
+	MeshLoadOptions()
+	{
+		Layout = VertexLayoutInterleavedUnorm16;
+		OptimizeOverdraw = false;
+		ShortIndices = true;
+		GenerateLods = true;
+		ClusterCulling = true;
+		AsyncLoad = true;
+	}
+
+	VertexLayout Layout;
+	bool OptimizeOverdraw;
+	bool ShortIndices; //16 bit indices, splitting meshes with too many vertices into submeshes
+	bool GenerateLods;
+	bool ClusterCulling; //skip meshlets outside the frustum or facing away from the camera
+	bool AsyncLoad; //load on a worker thread and upload over several frames instead of blocking the constructor
+};
+
 class RenderableObject
 {
 public:
-	RenderableObject(char* objFilename, Material* material);
+	RenderableObject(char* objFilename, Material* material, const MeshLoadOptions& options = MeshLoadOptions());
+	~RenderableObject();
+
+	//Uploads the next part of a mesh loaded in the background. Call once per frame; returns true once the whole mesh is on the GPU.
+	bool ContinueLoading(size_t uploadBudget = MESH_UPLOAD_BYTES_PER_FRAME);
+	bool IsLoaded() const { return UploadComplete; }
 
 	void Draw();
 
+	//Draws every triangle of a LOD, without meshlet culling or LOD selection; for passes that do not look through the camera.
+	//Does nothing until the mesh is fully uploaded.
+	void DrawLod(int lod);
+
+	//Picks the coarsest LOD whose error projects below LodScreenError at the object's current distance.
+	void SelectLod(const cyMatrix4f& modelView, const cyMatrix4f& projection);
+	int LodForModelView(const cyMatrix4f& modelView, const cyMatrix4f& projection) const;
+
+	//Collects the meshlets of the selected LOD that the next Draw call will issue.
+	void CullMeshlets(const cyMatrix4f& modelView, const cyMatrix4f& projection);
+
+	//Draws one copy per instance with glDrawElementsInstanced. Instances outside the frustum are dropped and
+	//the rest grouped by LOD, so each LOD in use costs one instanced draw per submesh.
+	void DrawInstanced(InstanceBuffer& instances, const cyMatrix4f& view, const cyMatrix4f& projection);
+
 	cyVec3f Position;
 	cyVec3f Scale;
 	cyVec3f RotationAngles;
 	bool CenterOnBoundingBox;
+	float LodScreenError;
 
 	Material* ObjectMaterial;
 
-	cyMatrix4f CalculateModelTransform();
+	//Cached until Position, Scale, RotationAngles or CenterOnBoundingBox change.
+	const cyMatrix4f& CalculateModelTransform();
+	const cyMatrix3f& GetModelNormalTransform();
+
+	const VertexDecodeParameters& GetVertexDecode() const { return VertexDecode; }
+	int GetLodCount() const { return (int)Lods.size(); }
+	int GetCurrentLod() const { return CurrentLod; }
+	unsigned int GetDrawnTriangleCount() const { return DrawnTriangleCount; }
+	float GetBoundingRadius() const { return BoundingRadius; }
+	const cyVec3f& GetBoundingBoxCenter() const { return BoundingBoxCenter; }
+
+	//GPU buffers of a fully uploaded mesh, for renderers that copy it into shared buffers.
+	VertexLayout GetVertexLayout() const { return Options.Layout; }
+	GLuint GetVertexArray() const { return VAO; }
+	GLuint GetInterleavedVertexBuffer() const { return InterleavedVertexBufferObject; }
+	GLuint GetIndexBuffer() const { return IndexBuffer; }
+	GLenum GetIndexType() const { return IndexType; }
+	unsigned int GetVertexCount() const { return VertexCount; }
+	unsigned int GetIndexCount() const { return IndexCount; }
+	const Submesh* GetLodSubmeshes(int lod, unsigned int& count) const;
+	unsigned int GetLodTriangleCount(int lod) const { return Lods[lod].TriangleCount; }
+
+	//Points attributes 0 to 2 of the bound VAO at PackedVertex data in the bound array buffer.
+	static void SetPackedVertexAttributes(VertexLayout layout);
 
 private:
 
-	int InitializeFromObjFile(char* filename);
+	//Mesh the loader thread hands to the render thread. View points into Cache when the mesh was mapped from a .cymesh
+	//file and into Prepared when the obj file had to be processed.
+	struct PendingMesh
+	{
+		PreparedMesh Prepared;
+		MeshCache Cache;
+		PreparedMeshView View;
+	};
+
+	int LodForDepth(float nearestDepth, float scale, const cyMatrix4f& projection) const;
+	int LoadMesh(const char* filename, PendingMesh& pending);
+	void PrepareMesh(const MeshDataView& mesh, PreparedMesh& prepared) const;
+	void LoadOnWorkerThread(std::string filename);
+	void CreateBuffers();
 	int CompileShaders(std::string vertexShaderFilename, std::string fragShaderFilename);
 
 	GLuint VAO;
 	GLuint IndexBuffer;
-	int IndexBufferCount;
+	GLenum IndexType;
+	std::vector<GLsizei> SubmeshIndexCounts;
+	std::vector<const void*> SubmeshIndexOffsets;
+	std::vector<GLint> SubmeshBaseVertices;
+	std::vector<Submesh> Submeshes;
+	unsigned int VertexCount;
+	unsigned int IndexCount;
+	std::vector<RenderLod> Lods;
+	int CurrentLod;
+	bool HasBaseVertices;
+
+	std::vector<Meshlet> Meshlets;
+	std::vector<GLsizei> VisibleIndexCounts;
+	std::vector<const void*> VisibleIndexOffsets;
+	std::vector<GLint> VisibleBaseVertices;
+	unsigned int DrawnTriangleCount;
+	std::vector<int> InstanceLods; //scratch for DrawInstanced, -1 for culled instances
+
 	GLuint VertexPosElementBufferObject;
 	GLuint VertexNormalElementBufferObject;
 	GLuint VertexUVElementBufferObject;
+	GLuint InterleavedVertexBufferObject;
+
+	//Loading state. The loader thread fills Pending and then sets MeshPrepared; the render thread owns everything else.
+	std::thread LoaderThread;
+	std::unique_ptr<PendingMesh> Pending;
+	std::atomic<bool> MeshPrepared;
+	bool LoadFailed;
+	bool BuffersCreated;
+	bool UploadComplete;
+	unsigned int UploadedVertices;
+	unsigned int UploadedIndices;
+	unsigned int ReadyMeshletCount; //full detail meshlets whose vertices and indices are uploaded
+	unsigned int UploadFrames;
+	cy::Timer UploadTimer;
+
+	MeshLoadOptions Options;
+	VertexDecodeParameters VertexDecode;
+
+	cyMatrix4f ModelTransform;
+	cyMatrix3f ModelNormalTransform;
+	cyVec3f ModelTransformPosition; //inputs ModelTransform was built from
+	cyVec3f ModelTransformScale;
+	cyVec3f ModelTransformRotationAngles;
+	bool ModelTransformCentered;
+	bool ModelTransformValid;
 
 	cyVec3f BoundingBoxCenter;
+	float BoundingRadius;
 	
 };
 
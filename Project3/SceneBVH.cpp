@@ -0,0 +1,82 @@
+#include "SceneBVH.h"
+
+void SceneBVH::SetObjectBounds(unsigned int object, const cyVec3f& center, float radius)
+{
+	float* box = &ObjectBounds[object * 6];
+	for (int i = 0; i < 3; i++)
+	{
+		box[i] = center[i] - radius;
+		box[i + 3] = center[i] + radius;
+	}
+}
+
+void SceneBVH::GetElementBounds(unsigned int i, float box[6]) const
+{
+	for (int j = 0; j < 6; j++)
+	{
+		box[j] = ObjectBounds[i * 6 + j];
+	}
+}
+
+float SceneBVH::GetElementCenter(unsigned int i, int dimension) const
+{
+	return 0.5f * (ObjectBounds[i * 6 + dimension] + ObjectBounds[i * 6 + dimension + 3]);
+}
+
+void SceneBVH::Cull(const MeshletCuller& frustum, std::vector<unsigned int>& visibleObjects, SceneCullingStats& stats) const
+{
+	stats.TestedNodes = stats.VisibleNodes = stats.TestedObjects = stats.VisibleObjects = 0;
+	if (ObjectBounds.empty())
+	{
+		return;
+	}
+
+	size_t firstVisible = visibleObjects.size();
+	std::vector<unsigned int> stack(1, GetRootNodeID());
+	while (!stack.empty())
+	{
+		unsigned int node = stack.back();
+		stack.pop_back();
+		stats.TestedNodes++;
+		FrustumOverlap overlap = frustum.TestBox(GetNodeBounds(node));
+		if (overlap == FrustumOutside)
+		{
+			continue;
+		}
+		stats.VisibleNodes++;
+		if (overlap == FrustumInside)
+		{
+			AddSubtree(node, visibleObjects);
+		}
+		else if (IsLeafNode(node))
+		{
+			const unsigned int* objects = GetNodeElements(node);
+			for (unsigned int i = 0; i < GetNodeElementCount(node); i++)
+			{
+				stats.TestedObjects++;
+				if (frustum.TestBox(&ObjectBounds[objects[i] * 6]) != FrustumOutside)
+				{
+					visibleObjects.push_back(objects[i]);
+				}
+			}
+		}
+		else
+		{
+			stack.push_back(GetSecondChildNode(node));
+			stack.push_back(GetFirstChildNode(node));
+		}
+	}
+	stats.VisibleObjects = (unsigned int)(visibleObjects.size() - firstVisible);
+}
+
+void SceneBVH::AddSubtree(unsigned int node, std::vector<unsigned int>& visibleObjects) const
+{
+	if (IsLeafNode(node))
+	{
+		const unsigned int* objects = GetNodeElements(node);
+		visibleObjects.insert(visibleObjects.end(), objects, objects + GetNodeElementCount(node));
+		return;
+	}
+	AddSubtree(GetFirstChildNode(node), visibleObjects);
+	AddSubtree(GetSecondChildNode(node), visibleObjects);
+}
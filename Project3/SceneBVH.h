@@ -0,0 +1,38 @@
+#pragma once
+
+#include <vector>
+#include "cyVector.h"
+#include "cyBVH.h"
+#include "Meshlet.h"
+
+//Per frame counts of the work frustum culling did.
+struct SceneCullingStats
+{
+	unsigned int TestedNodes;
+	unsigned int VisibleNodes; //tested nodes not entirely outside the frustum
+	unsigned int TestedObjects;
+	unsigned int VisibleObjects;
+};
+
+//cy::BVH over the world space bounding boxes of scene objects.
+class SceneBVH : public cy::BVH
+{
+public:
+	void SetObjectCount(unsigned int count) { ObjectBounds.resize(count * 6); }
+	unsigned int GetObjectCount() const { return (unsigned int)(ObjectBounds.size() / 6); }
+
+	//Bounds the object's bounding sphere. Call Refit or Build afterwards.
+	void SetObjectBounds(unsigned int object, const cyVec3f& center, float radius);
+
+	//Appends the objects whose boxes overlap the frustum. Subtrees entirely inside are accepted without further tests.
+	void Cull(const MeshletCuller& frustum, std::vector<unsigned int>& visibleObjects, SceneCullingStats& stats) const;
+
+protected:
+	void GetElementBounds(unsigned int i, float box[6]) const override;
+	float GetElementCenter(unsigned int i, int dimension) const override;
+
+private:
+	void AddSubtree(unsigned int node, std::vector<unsigned int>& visibleObjects) const;
+
+	std::vector<float> ObjectBounds; //minimum then maximum corner of each object
+};
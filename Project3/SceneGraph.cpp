@@ -0,0 +1,133 @@
+#include "SceneGraph.h"
+
+#include <math.h>
+#include <algorithm>
+#include <thread>
+
+SceneGraph::SceneGraph()
+{
+	ChangedCount = 0;
+	LevelsValid = true;
+}
+
+unsigned int SceneGraph::AddNode(int parent)
+{
+	unsigned int node = (unsigned int)Parents.size();
+	Parents.push_back(parent);
+	LocalTransforms.push_back(cyMatrix4f::Identity());
+	WorldTransforms.push_back(cyMatrix4f::Identity());
+	NormalTransforms.push_back(cyMatrix3f::Identity());
+	MaxScales.push_back(1.0f);
+	Dirty.push_back(1);
+	Changed.push_back(0);
+	Depths.push_back(parent < 0 ? 0 : Depths[parent] + 1);
+	LevelsValid = false;
+	return node;
+}
+
+void SceneGraph::SetLocalTransform(unsigned int node, const cyMatrix4f& transform)
+{
+	LocalTransforms[node] = transform;
+	Dirty[node] = 1;
+}
+
+void SceneGraph::SetLocalTransform(unsigned int node, const cyVec3f& position, const cyVec3f& scale, const cyVec3f& rotationAngles)
+{
+	SetLocalTransform(node, cyMatrix4f::Translation(position) * cyMatrix4f::Scale(scale) *
+		cyMatrix4f::RotationX(rotationAngles.x) * cyMatrix4f::RotationY(rotationAngles.y) * cyMatrix4f::RotationZ(rotationAngles.z));
+}
+
+void SceneGraph::Update(bool parallel)
+{
+	//Dirtiness flows down first: parents precede children, so one pass over the flags is enough
+	ChangedCount = 0;
+	for (unsigned int node = 0; node < Parents.size(); node++)
+	{
+		int parent = Parents[node];
+		Changed[node] = Dirty[node] | (parent >= 0 ? Changed[parent] : 0);
+		Dirty[node] = 0;
+		ChangedCount += Changed[node];
+	}
+	if (ChangedCount == 0)
+	{
+		return;
+	}
+
+	if (!parallel || Parents.size() < SCENE_GRAPH_PARALLEL_LEVEL_SIZE)
+	{
+		for (unsigned int node = 0; node < Parents.size(); node++)
+		{
+			if (Changed[node])
+			{
+				UpdateNode(node);
+			}
+		}
+		return;
+	}
+
+	if (!LevelsValid)
+	{
+		BuildLevels();
+	}
+	unsigned int threadCount = std::max(1u, std::thread::hardware_concurrency());
+	for (const std::vector<unsigned int>& level : Levels)
+	{
+		if (level.size() < SCENE_GRAPH_PARALLEL_LEVEL_SIZE || threadCount == 1)
+		{
+			UpdateRange(level.data(), level.size());
+			continue;
+		}
+		size_t chunkSize = (level.size() + threadCount - 1) / threadCount;
+		std::vector<std::thread> threads;
+		for (size_t start = chunkSize; start < level.size(); start += chunkSize)
+		{
+			threads.push_back(std::thread(&SceneGraph::UpdateRange, this, level.data() + start, std::min(chunkSize, level.size() - start)));
+		}
+		UpdateRange(level.data(), chunkSize);
+		for (std::thread& thread : threads)
+		{
+			thread.join();
+		}
+	}
+}
+
+void SceneGraph::UpdateRange(const unsigned int* nodes, size_t count)
+{
+	for (size_t i = 0; i < count; i++)
+	{
+		if (Changed[nodes[i]])
+		{
+			UpdateNode(nodes[i]);
+		}
+	}
+}
+
+void SceneGraph::UpdateNode(unsigned int node)
+{
+	int parent = Parents[node];
+	cyMatrix4f& world = WorldTransforms[node];
+	world = parent >= 0 ? WorldTransforms[parent] * LocalTransforms[node] : LocalTransforms[node];
+
+	cyMatrix3f normal = world.GetSubMatrix3();
+	normal.Invert();
+	normal.Transpose();
+	NormalTransforms[node] = normal;
+
+	const float* c = world.cell;
+	MaxScales[node] = sqrtf(std::max(cyVec3f(c[0], c[1], c[2]).LengthSquared(), std::max(cyVec3f(c[4], c[5], c[6]).LengthSquared(), cyVec3f(c[8], c[9], c[10]).LengthSquared())));
+}
+
+void SceneGraph::BuildLevels()
+{
+	unsigned int depthCount = 0;
+	for (unsigned int depth : Depths)
+	{
+		depthCount = std::max(depthCount, depth + 1);
+	}
+	Levels.assign(depthCount, std::vector<unsigned int>());
+	for (unsigned int node = 0; node < Parents.size(); node++)
+	{
+		Levels[Depths[node]].push_back(node);
+	}
+	LevelsValid = true;
+}
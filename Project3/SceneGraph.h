@@ -0,0 +1,56 @@
+#pragma once
+
+#include <vector>
+#include "cyMatrix.h"
+
+//Smallest level of the hierarchy Update splits across threads; smaller levels are not worth the thread start.
+#define SCENE_GRAPH_PARALLEL_LEVEL_SIZE 4096
+
+//Parent/child transform hierarchy. Node data lives in parallel arrays indexed by node, and a parent is always
+//created before its children, so one forward sweep over the arrays brings every world matrix up to date.
+//Only nodes whose local transform changed, or whose ancestor's did, are recomputed.
+class SceneGraph
+{
+public:
+	SceneGraph();
+
+	//Adds a node under parent, or a root for -1, with an identity local transform.
+	unsigned int AddNode(int parent = -1);
+	unsigned int NodeCount() const { return (unsigned int)Parents.size(); }
+	int GetParent(unsigned int node) const { return Parents[node]; }
+
+	void SetLocalTransform(unsigned int node, const cyMatrix4f& transform);
+	void SetLocalTransform(unsigned int node, const cyVec3f& position, const cyVec3f& scale, const cyVec3f& rotationAngles);
+	const cyMatrix4f& GetLocalTransform(unsigned int node) const { return LocalTransforms[node]; }
+
+	//Recomputes the world and normal matrices of dirty subtrees. With parallel set, wide levels of the hierarchy are split across threads.
+	void Update(bool parallel = false);
+
+	//Valid after Update.
+	const cyMatrix4f& GetWorldTransform(unsigned int node) const { return WorldTransforms[node]; }
+	const cyMatrix3f& GetNormalTransform(unsigned int node) const { return NormalTransforms[node]; }
+	float GetMaxScale(unsigned int node) const { return MaxScales[node]; }
+
+	//Whether the last Update changed the node's world transform.
+	bool WasChanged(unsigned int node) const { return Changed[node] != 0; }
+	unsigned int GetChangedCount() const { return ChangedCount; }
+
+private:
+	void UpdateNode(unsigned int node);
+	void UpdateRange(const unsigned int* nodes, size_t count);
+	void BuildLevels();
+
+	std::vector<int> Parents;
+	std::vector<cyMatrix4f> LocalTransforms;
+	std::vector<cyMatrix4f> WorldTransforms;
+	std::vector<cyMatrix3f> NormalTransforms; //inverse transpose of the world matrix's upper 3x3
+	std::vector<float> MaxScales; //longest world axis, for scaling bounding spheres
+	std::vector<unsigned char> Dirty; //local transform set since the last Update
+	std::vector<unsigned char> Changed;
+	unsigned int ChangedCount;
+
+	//Node indices grouped by depth for the parallel sweep; every level only reads the one before it
+	std::vector<unsigned int> Depths;
+	std::vector<std::vector<unsigned int>> Levels;
+	bool LevelsValid;
+};
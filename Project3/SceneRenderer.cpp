@@ -0,0 +1,279 @@
+#include "SceneRenderer.h"
+#include "TraceProfiler.h"
+
+#include <stdio.h>
+#include <math.h>
+#include <algorithm>
+
+SceneRenderer::SceneRenderer(SceneGraph* graph)
+{
+	Graph = graph;
+	Built = false;
+	BvhBuilt = false;
+	CullingStats = SceneCullingStats();
+	UseDrawId = GLEW_VERSION_4_6 || GLEW_ARB_shader_draw_parameters;
+	VAO = 0;
+	VertexArena = 0;
+	IndexArena = 0;
+	IndexType = GL_UNSIGNED_SHORT;
+	DrawnTriangleCount = 0;
+	IndirectBuffer = 0;
+	DrawDataBuffer = 0;
+	DrawIndexBuffer = 0;
+	DrawIndexCapacity = 0;
+}
+
+SceneRenderer::~SceneRenderer()
+{
+	DeleteArenas();
+}
+
+void SceneRenderer::DeleteArenas()
+{
+	if (VAO == 0)
+	{
+		return;
+	}
+	glDeleteVertexArrays(1, &VAO);
+	GLuint buffers[] = { VertexArena, IndexArena, IndirectBuffer, DrawDataBuffer, DrawIndexBuffer };
+	glDeleteBuffers(5, buffers);
+	VAO = VertexArena = IndexArena = IndirectBuffer = DrawDataBuffer = DrawIndexBuffer = 0;
+	DrawIndexCapacity = 0;
+	//The names may be handed out again
+	GLStateCache::Invalidate();
+}
+
+bool SceneRenderer::IsSupported()
+{
+	return GLEW_VERSION_4_3 || (GLEW_ARB_multi_draw_indirect && GLEW_ARB_shader_storage_buffer_object);
+}
+
+std::string SceneRenderer::ShaderDefines()
+{
+	return GLEW_VERSION_4_6 || GLEW_ARB_shader_draw_parameters ? "#define USE_DRAW_ID\n" : "";
+}
+
+void SceneRenderer::Add(RenderableObject* object, unsigned int node, Material* material)
+{
+	unsigned int mesh = 0;
+	while (mesh < Meshes.size() && Meshes[mesh].Object != object)
+	{
+		mesh++;
+	}
+	if (mesh == Meshes.size())
+	{
+		ArenaMesh arenaMesh = { object, 0, 0 };
+		Meshes.push_back(arenaMesh);
+		Built = false;
+	}
+
+	SceneObject sceneObject;
+	sceneObject.Mesh = mesh;
+	sceneObject.Node = node;
+	sceneObject.ObjectMaterial = material ? material : object->ObjectMaterial;
+	Objects.push_back(sceneObject);
+	BvhBuilt = false;
+}
+
+void SceneRenderer::UpdateBounds()
+{
+	//Moving objects only loosens the tree they were built into, so a refit is enough until objects are added
+	bool moved = false;
+	Bvh.SetObjectCount((unsigned int)Objects.size());
+	for (unsigned int i = 0; i < Objects.size(); i++)
+	{
+		const SceneObject& sceneObject = Objects[i];
+		if (BvhBuilt && !Graph->WasChanged(sceneObject.Node))
+		{
+			continue;
+		}
+		const RenderableObject* object = Meshes[sceneObject.Mesh].Object;
+		const cyMatrix4f& world = Graph->GetWorldTransform(sceneObject.Node);
+		cyVec3f center = object ? (world * cyVec4f(object->GetBoundingBoxCenter(), 1)).XYZ() : world.GetTranslation();
+		float radius = object ? object->GetBoundingRadius() * Graph->GetMaxScale(sceneObject.Node) : 0;
+		Bvh.SetObjectBounds(i, center, radius);
+		moved = true;
+	}
+
+	if (!BvhBuilt)
+	{
+		Bvh.Build((unsigned int)Objects.size());
+		BvhBuilt = true;
+	}
+	else if (moved)
+	{
+		Bvh.Refit();
+	}
+}
+
+bool SceneRenderer::Build()
+{
+	if (Built)
+	{
+		return true;
+	}
+	for (const ArenaMesh& mesh : Meshes)
+	{
+		//Meshes an earlier build left out stay out
+		if (mesh.Object && !mesh.Object->IsLoaded())
+		{
+			return false;
+		}
+	}
+
+	//Every mesh has to share the arena's vertex format and index type; others are left out of the scene
+	VertexLayout layout = VertexLayoutInterleavedUnorm16;
+	bool formatChosen = false;
+	size_t vertexCount = 0;
+	size_t indexCount = 0;
+	for (ArenaMesh& mesh : Meshes)
+	{
+		RenderableObject* object = mesh.Object;
+		mesh.FirstVertex = mesh.FirstIndex = 0;
+		if (!object)
+		{
+			continue;
+		}
+		if (object->GetLodCount() == 0 || object->GetVertexLayout() == VertexLayoutSeparateFloat ||
+			(formatChosen && (object->GetVertexLayout() != layout || object->GetIndexType() != IndexType)))
+		{
+			fprintf(stderr, "Scene meshes need one interleaved vertex format and index size, skipping a mesh\n");
+			mesh.Object = NULL;
+			continue;
+		}
+		layout = object->GetVertexLayout();
+		IndexType = object->GetIndexType();
+		formatChosen = true;
+
+		mesh.FirstVertex = (unsigned int)vertexCount;
+		mesh.FirstIndex = (unsigned int)indexCount;
+		vertexCount += object->GetVertexCount();
+		indexCount += object->GetIndexCount();
+	}
+	size_t indexSize = IndexType == GL_UNSIGNED_SHORT ? sizeof(unsigned short) : sizeof(int);
+
+	//Objects added after the last build repack every mesh into new arenas
+	DeleteArenas();
+	glGenVertexArrays(1, &VAO);
+	GLStateCache::BindVertexArray(VAO);
+	glGenBuffers(1, &VertexArena);
+	glBindBuffer(GL_ARRAY_BUFFER, VertexArena);
+	glBufferData(GL_ARRAY_BUFFER, vertexCount * sizeof(PackedVertex), NULL, GL_STATIC_DRAW);
+	RenderableObject::SetPackedVertexAttributes(layout);
+	glGenBuffers(1, &IndexArena);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, IndexArena);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexCount * indexSize, NULL, GL_STATIC_DRAW);
+
+	//The meshes are already on the GPU, so the arenas are filled without a round trip through system memory
+	glBindBuffer(GL_COPY_WRITE_BUFFER, VertexArena);
+	for (const ArenaMesh& mesh : Meshes)
+	{
+		if (mesh.Object)
+		{
+			glBindBuffer(GL_COPY_READ_BUFFER, mesh.Object->GetInterleavedVertexBuffer());
+			glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, mesh.FirstVertex * sizeof(PackedVertex),
+				mesh.Object->GetVertexCount() * sizeof(PackedVertex));
+		}
+	}
+	glBindBuffer(GL_COPY_WRITE_BUFFER, IndexArena);
+	for (const ArenaMesh& mesh : Meshes)
+	{
+		if (mesh.Object)
+		{
+			glBindBuffer(GL_COPY_READ_BUFFER, mesh.Object->GetIndexBuffer());
+			glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, mesh.FirstIndex * indexSize,
+				mesh.Object->GetIndexCount() * indexSize);
+		}
+	}
+
+	glGenBuffers(1, &IndirectBuffer);
+	glGenBuffers(1, &DrawDataBuffer);
+	glGenBuffers(1, &DrawIndexBuffer);
+	GLStateCache::BindVertexArray(0);
+
+	fprintf(stdout, "Status: Packed %zu mesh(es) into %.2f MB of shared vertex and index arenas, draw index from %s\n",
+		Meshes.size(), (vertexCount * sizeof(PackedVertex) + indexCount * indexSize) / (1024.0 * 1024.0),
+		UseDrawId ? "gl_DrawID" : "base instance");
+	Built = true;
+	return true;
+}
+
+void SceneRenderer::Draw(const cyMatrix4f& view, const cyMatrix4f& projection)
+{
+	TRACE_SCOPE("draw scene");
+	Commands.clear();
+	DrawData.clear();
+	DrawnTriangleCount = 0;
+	if (!Built)
+	{
+		return;
+	}
+
+	//World space planes, so the BVH's bounds are tested as they are
+	UpdateBounds();
+	MeshletCuller frustum;
+	frustum.Set(view, projection);
+	VisibleObjects.clear();
+	Bvh.Cull(frustum, VisibleObjects, CullingStats);
+
+	for (unsigned int objectIndex : VisibleObjects)
+	{
+		const SceneObject& sceneObject = Objects[objectIndex];
+		const ArenaMesh& mesh = Meshes[sceneObject.Mesh];
+		if (!mesh.Object)
+		{
+			continue;
+		}
+		RenderableObject* object = mesh.Object;
+		const cyMatrix4f& modelTransform = Graph->GetWorldTransform(sceneObject.Node);
+		cyMatrix4f modelView = view * modelTransform;
+
+		int lod = object->LodForModelView(modelView, projection);
+		ObjectUniformBlock block;
+		FillObjectUniforms(block, modelTransform, Graph->GetNormalTransform(sceneObject.Node), sceneObject.ObjectMaterial, object->GetVertexDecode());
+		unsigned int submeshCount;
+		const Submesh* submeshes = object->GetLodSubmeshes(lod, submeshCount);
+		for (unsigned int i = 0; i < submeshCount; i++)
+		{
+			//The base instance doubles as the draw index for the attribute fallback
+			DrawElementsIndirectCommand command;
+			command.Count = submeshes[i].IndexCount;
+			command.InstanceCount = 1;
+			command.FirstIndex = mesh.FirstIndex + submeshes[i].FirstIndex;
+			command.BaseVertex = (GLint)mesh.FirstVertex + submeshes[i].BaseVertex;
+			command.BaseInstance = (GLuint)Commands.size();
+			Commands.push_back(command);
+			DrawData.push_back(block);
+		}
+		DrawnTriangleCount += object->GetLodTriangleCount(lod);
+	}
+	if (Commands.empty())
+	{
+		return;
+	}
+
+	//Both buffers are orphaned so this frame's writes never wait on last frame's draws
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, DrawDataBuffer);
+	glBufferData(GL_SHADER_STORAGE_BUFFER, DrawData.size() * sizeof(ObjectUniformBlock), DrawData.data(), GL_STREAM_DRAW);
+	GLStateCache::BindBufferBase(GL_SHADER_STORAGE_BUFFER, SCENE_DRAW_DATA_BINDING, DrawDataBuffer);
+
+	GLStateCache::BindVertexArray(VAO);
+	if (!UseDrawId && DrawIndexCapacity < Commands.size())
+	{
+		DrawIndexCapacity = std::max((unsigned int)Commands.size(), DrawIndexCapacity * 2);
+		std::vector<GLuint> drawIndices(DrawIndexCapacity);
+		for (unsigned int i = 0; i < DrawIndexCapacity; i++)
+		{
+			drawIndices[i] = i;
+		}
+		glBindBuffer(GL_ARRAY_BUFFER, DrawIndexBuffer);
+		glBufferData(GL_ARRAY_BUFFER, DrawIndexCapacity * sizeof(GLuint), drawIndices.data(), GL_STATIC_DRAW);
+		glVertexAttribIPointer(SCENE_DRAW_INDEX_ATTRIBUTE, 1, GL_UNSIGNED_INT, 0, NULL);
+		glVertexAttribDivisor(SCENE_DRAW_INDEX_ATTRIBUTE, 1);
+		glEnableVertexAttribArray(SCENE_DRAW_INDEX_ATTRIBUTE);
+	}
+
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, IndirectBuffer);
+	glBufferData(GL_DRAW_INDIRECT_BUFFER, Commands.size() * sizeof(DrawElementsIndirectCommand), Commands.data(), GL_STREAM_DRAW);
+	glMultiDrawElementsIndirect(GL_TRIANGLES, IndexType, NULL, (GLsizei)Commands.size(), 0);
+}
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include "GL/glew.h"
+#include "cyMatrix.h"
+#include "Material.h"
+#include "RenderableObject.h"
+#include "Shader.h"
+#include "SceneGraph.h"
+#include "SceneBVH.h"
+
+//Shader storage binding of the per draw ObjectUniformBlock array read by scene.vert and scene.frag.
+#define SCENE_DRAW_DATA_BINDING 0
+
+//Instanced attribute holding each draw's index when gl_DrawID is not available.
+#define SCENE_DRAW_INDEX_ATTRIBUTE 7
+
+//Draws many objects, possibly with different meshes, with one glMultiDrawElementsIndirect. Each object is placed by
+//a SceneGraph node whose world transform replaces the mesh's own model transform.
+//The meshes are copied into shared vertex and index arenas once they finish loading. Each frame a BVH over the objects'
+//world bounds is refit where the graph moved them and culled against the frustum; the visible objects
+//get one indirect command per submesh of their LOD, and the shaders find the draw's transform and material
+//through gl_DrawID, or through an instanced attribute offset by the command's base instance.
+class SceneRenderer
+{
+public:
+	SceneRenderer(SceneGraph* graph);
+	~SceneRenderer();
+
+	//Needs GL 4.3 or the multi draw indirect and storage buffer extensions.
+	static bool IsSupported();
+
+	//Defines the scene shaders are compiled with.
+	static std::string ShaderDefines();
+
+	//Adds a copy of the object's mesh drawn with the node's world transform.
+	//A NULL material uses the object's. Meshes shared by several objects are packed once.
+	void Add(RenderableObject* object, unsigned int node, Material* material = NULL);
+
+	//Packs the meshes into the arenas once they are all uploaded. Returns true when the scene can be drawn.
+	bool Build();
+	bool IsBuilt() const { return Built; }
+
+	//Culls and picks LODs on the CPU, then submits everything visible with the bound program. The graph has to be updated first.
+	void Draw(const cyMatrix4f& view, const cyMatrix4f& projection);
+
+	unsigned int GetObjectCount() const { return (unsigned int)Objects.size(); }
+	unsigned int GetDrawCount() const { return (unsigned int)Commands.size(); }
+	unsigned int GetDrawnTriangleCount() const { return DrawnTriangleCount; }
+	const SceneCullingStats& GetCullingStats() const { return CullingStats; }
+
+private:
+	void UpdateBounds();
+	void DeleteArenas();
+
+	//Layout fixed by the GL spec for GL_DRAW_INDIRECT_BUFFER.
+	struct DrawElementsIndirectCommand
+	{
+		GLuint Count;
+		GLuint InstanceCount;
+		GLuint FirstIndex;
+		GLint BaseVertex;
+		GLuint BaseInstance;
+	};
+
+	//Where a mesh's vertices and indices start in the arenas.
+	struct ArenaMesh
+	{
+		RenderableObject* Object;
+		unsigned int FirstVertex;
+		unsigned int FirstIndex;
+	};
+
+	struct SceneObject
+	{
+		unsigned int Mesh;
+		unsigned int Node;
+		Material* ObjectMaterial;
+	};
+
+	SceneGraph* Graph;
+	std::vector<ArenaMesh> Meshes;
+	std::vector<SceneObject> Objects;
+	bool Built;
+	bool UseDrawId;
+
+	GLuint VAO;
+	GLuint VertexArena;
+	GLuint IndexArena;
+	GLenum IndexType;
+
+	SceneBVH Bvh;
+	bool BvhBuilt;
+	std::vector<unsigned int> VisibleObjects;
+	SceneCullingStats CullingStats;
+
+	//Rebuilt every frame
+	std::vector<DrawElementsIndirectCommand> Commands;
+	std::vector<ObjectUniformBlock> DrawData;
+	unsigned int DrawnTriangleCount;
+
+	GLuint IndirectBuffer;
+	GLuint DrawDataBuffer;
+	GLuint DrawIndexBuffer; //0, 1, 2, ... read through the base instance when gl_DrawID is missing
+	unsigned int DrawIndexCapacity;
+};
@@ -1,151 +1,415 @@
 #include "Shader.h"
+#include "SceneRenderer.h"
+#include "PointLightShadow.h"
+#include "TraceProfiler.h"
+#include "ProgramBinaryCache.h"
 #include <fstream>
 #include <sstream>
 #include <stdlib.h>
 
-Shader::Shader(std::string vertexShaderFilename, std::string fragShaderFilename)
+static std::string insertDefines(const std::string& source, const std::string& defines)
 {
-	CompileShaders(vertexShaderFilename, fragShaderFilename);
+	//#version has to stay the first line
+	size_t lineEnd = source.find('\n');
+	if (defines.empty() || lineEnd == std::string::npos)
+	{
+		return source;
+	}
+	return source.substr(0, lineEnd + 1) + defines + source.substr(lineEnd + 1);
 }
 
-void Shader::Draw(RenderableObject* object, PointLight* light, Camera* camera, cyMatrix4f projectionTransform, float ambientLightIntensity)
+static std::string readShaderFile(const std::string& filename)
 {
-	cyMatrix4f modelTransform = object->CalculateModelTransform();
-	cyMatrix4f cameraTransform = camera->GetCameraTransform();
+	std::ifstream input(filename);
+	std::stringstream stringBuffer;
+	stringBuffer << input.rdbuf();
+	return stringBuffer.str();
+}
 
-	glUseProgram(ShaderProgram);
+static std::string variantDefines(unsigned int flags)
+{
+	const char* names[] = { "SHADER_SPECULAR", "SHADER_INSTANCING", "SHADER_CLUSTERED_LIGHTS", "SHADER_LIGHTING_GRID", "SHADER_POINT_SHADOW" };
+	std::string defines;
+	for (int i = 0; i < 5; i++)
+	{
+		if (flags & (1u << i))
+		{
+			defines.append("#define ").append(names[i]).append("\n");
+		}
+	}
+	return defines;
+}
 
-	cyMatrix4f mvp = projectionTransform * cameraTransform * modelTransform;
-	float mvpMatrixValues[4][4];
-	mvp.Get(&mvpMatrixValues[0][0]);
-	glUniformMatrix4fv(MVPUniformLocation, 1, GL_FALSE, &mvpMatrixValues[0][0]);
-	
-	cyMatrix4f mv = cameraTransform * modelTransform;
-	float mvMatrixValues[4][4];
-	mv.Get(&mvMatrixValues[0][0]);
-	glUniformMatrix4fv(MVUniformLocation, 1, GL_FALSE, &mvMatrixValues[0][0]);
+void FillObjectUniforms(ObjectUniformBlock& block, const cyMatrix4f& modelTransform, const cyMatrix3f& modelNormalTransform,
+	const Material* material, const VertexDecodeParameters& vertexDecode)
+{
+	for (int i = 0; i < 16; i++)
+	{
+		block.Model[i] = modelTransform.cell[i];
+	}
+	for (int column = 0; column < 3; column++)
+	{
+		for (int row = 0; row < 3; row++)
+		{
+			block.ModelNormal[column * 4 + row] = modelNormalTransform.cell[column * 3 + row];
+		}
+		block.ModelNormal[column * 4 + 3] = 0;
+	}
 
-	cyMatrix3f mvn = mv.GetSubMatrix3();
-	mvn.Invert();
-	mvn.Transpose();
-	float mvnMatrixValues[3][3];
-	mvn.Get(&mvnMatrixValues[0][0]);
-	glUniformMatrix3fv(MVNUniformLocation, 1, GL_FALSE, &mvnMatrixValues[0][0]);
-	
-	glUniform4fv(DiffuseAmbientColorLocation, 1, &object->ObjectMaterial->AmbientDiffuseColor[0]);
-	glUniform4fv(SpecularColorLocation, 1, &object->ObjectMaterial->SpecularColor[0]);
-	glUniform1f(SpecularShininessLocation, object->ObjectMaterial->SpecularShininess);
+	for (int i = 0; i < 4; i++)
+	{
+		block.DiffuseAmbientColor[i] = material->AmbientDiffuseColor[i];
+		block.SpecularColor[i] = material->SpecularColor[i];
+	}
+	block.SpecularShininess = material->SpecularShininess;
 
-	glUniform1f(AmbientLightIntensityLocation, ambientLightIntensity);
-	glUniform1f(LightIntensityLocation, light->LightIntensity);
-	cyVec4f lightPositionInViewSpace = cameraTransform * light->LightPosition;
-	glUniform3fv(LightPositionLocation, 1, &lightPositionInViewSpace[0]);
-	glUniform3fv(CameraPositionLocation, 1, &camera->Position[0]);
-	object->Draw();
+	for (int i = 0; i < 3; i++)
+	{
+		block.PositionDecodeOffset[i] = vertexDecode.PositionDecodeOffset[i];
+		block.PositionDecodeScale[i] = vertexDecode.PositionDecodeScale[i];
+	}
+	block.OctahedralNormals = vertexDecode.OctahedralNormals ? 1 : 0;
+}
+
+Shader::Shader(std::string vertexShaderFilename, std::string fragShaderFilename, std::string defines)
+{
+	UniformRing = new UniformRingBuffer();
+	HasFrameBlock = false;
+	FrameVariantFlags = 0;
+	VertexSource = readShaderFile(vertexShaderFilename);
+	FragSource = readShaderFile(fragShaderFilename);
+	size_t directoryEnd = fragShaderFilename.find_last_of("\\/");
+	LightingSource = readShaderFile(fragShaderFilename.substr(0, directoryEnd == std::string::npos ? 0 : directoryEnd + 1) + "lighting.glsl");
+	Defines = defines;
+	for (unsigned int flags = 0; flags < SHADER_VARIANT_COUNT; flags++)
+	{
+		ProgramVariant& variant = Variants[flags];
+		variant.Program = variant.VertexShader = variant.FragShader = 0;
+		variant.CacheKey = 0;
+		variant.Compiling = variant.Ready = variant.Failed = false;
+	}
+
+	//Without the extension a variant's compile is collected a frame after it started, when the driver has likely finished it
+	ParallelCompile = GLEW_KHR_parallel_shader_compile;
+	if (ParallelCompile)
+	{
+		glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+	}
+
+	//The full variant is the fallback of every other one, so it is waited for
+	TRACE_SCOPE("compile shaders");
+	StartVariant(SHADER_VARIANT_ALL);
+	if (Variants[SHADER_VARIANT_ALL].Compiling)
+	{
+		FinishVariant(SHADER_VARIANT_ALL);
+	}
+	InstanceBuffer::ResetDefaultAttributes();
+}
+
+Shader::~Shader()
+{
+	for (ProgramVariant& variant : Variants)
+	{
+		glDeleteShader(variant.VertexShader);
+		glDeleteShader(variant.FragShader);
+		glDeleteProgram(variant.Program);
+	}
+	delete UniformRing;
 }
 
-int Shader::CompileShaders(std::string vertexShaderFilename, std::string fragShaderFilename)
-{
-	char infoLog[512];
-	std::ifstream vertInput(vertexShaderFilename);
-	std::stringstream vertexStringBuffer;
-	vertexStringBuffer << vertInput.rdbuf();
-	std::string vertexShaderString = vertexStringBuffer.str();
-	GLchar const* vertexShaderSource = vertexShaderString.c_str();
-	GLuint vertexShader;
-	vertexShader = glCreateShader(GL_VERTEX_SHADER);
-	glShaderSource(vertexShader, 1, &vertexShaderSource, NULL);
-	glCompileShader(vertexShader);
-	int vertexSuccess;
-	glGetShaderiv(vertexShader, GL_COMPILE_STATUS, &vertexSuccess);
-	if (!vertexSuccess)
-	{
-		glGetShaderInfoLog(vertexShader, 512, NULL, infoLog);
-		fprintf(stderr, "Failed to compile vertex shader. Error: %s\n", infoLog);
-	}
-
-	std::ifstream fragInput(fragShaderFilename);
-	std::stringstream fragStringBuffer;
-	fragStringBuffer << fragInput.rdbuf();
-	std::string fragShaderString = fragStringBuffer.str();
-	GLchar const* fragShaderSource = fragShaderString.c_str();
-	GLuint fragShader;
-	fragShader = glCreateShader(GL_FRAGMENT_SHADER);
-	glShaderSource(fragShader, 1, &fragShaderSource, NULL);
-	glCompileShader(fragShader);
-	int fragSuccess;
-	glGetShaderiv(fragShader, GL_COMPILE_STATUS, &fragSuccess);
-	if (!fragSuccess)
-	{
-		glGetShaderInfoLog(fragShader, 512, NULL, infoLog);
-		fprintf(stderr, "Failed to compile fragment shader. Error: %s\n", infoLog);
-	}
-
-	if (vertexSuccess && fragSuccess)
-	{
-		GLuint newShaderProgram;
-		newShaderProgram = glCreateProgram();
-		glAttachShader(newShaderProgram, vertexShader);
-		glAttachShader(newShaderProgram, fragShader);
-		glLinkProgram(newShaderProgram);
-		int linkSuccess;
-		glGetProgramiv(newShaderProgram, GL_LINK_STATUS, &linkSuccess);
-		if (!linkSuccess)
+void Shader::BeginFrame(PointLight* light, Camera* camera, cyMatrix4f projectionTransform, float ambientLightIntensity,
+	const LightClusterGrid* clusters, const LightingGridBuffers* lightingGrid, const PointLightShadow* shadow)
+{
+	for (unsigned int flags = 0; flags < SHADER_VARIANT_COUNT; flags++)
+	{
+		GLint complete = GL_TRUE;
+		if (Variants[flags].Compiling && ParallelCompile)
 		{
-			glGetProgramInfoLog(newShaderProgram, 512, NULL, infoLog);
-			fprintf(stderr, "Failed to link shaders. Error: %s\n", infoLog);
-			return -1;
+			glGetProgramiv(Variants[flags].Program, GL_COMPLETION_STATUS_KHR, &complete);
 		}
-		else
+		if (Variants[flags].Compiling && complete)
 		{
-			GLint mvpLoc = glGetUniformLocation(newShaderProgram, "mvp");
-			GLint mvLoc = glGetUniformLocation(newShaderProgram, "mv");
-			GLint mvnLoc = glGetUniformLocation(newShaderProgram, "mvn");
-			
-			GLint diffuseAmbientLocation = glGetUniformLocation(newShaderProgram, "DiffuseAmbientColor");
-			GLint specularColorLocation = glGetUniformLocation(newShaderProgram, "SpecularColor");
-			GLint specularShininessLocation = glGetUniformLocation(newShaderProgram, "SpecularShininess");
-			
-			GLint ambientIntensityLocation = glGetUniformLocation(newShaderProgram, "AmbientLightIntensity");
-			GLint lightIntensityLoc = glGetUniformLocation(newShaderProgram, "LightIntensity");
-			GLint lightPositionLoc = glGetUniformLocation(newShaderProgram, "LightPosition");
-			GLint cameraPositionLoc = glGetUniformLocation(newShaderProgram, "CameraPosition");
-
-			if (mvpLoc == -1 || mvLoc == -1 || mvnLoc == -1 ||
-				diffuseAmbientLocation == -1 || specularColorLocation == -1 || 
-				specularShininessLocation == -1 || ambientIntensityLocation == -1 ||
-				lightIntensityLoc == -1 || lightPositionLoc == -1 || cameraPositionLoc == -1)
-			{
-				fprintf(stderr, "Could not get a uniform location.\n");
-				return -1;
-			}
-			else
-			{
-				MVPUniformLocation = mvpLoc;
-				MVUniformLocation = mvLoc;
-				MVNUniformLocation = mvnLoc;
-				
-				DiffuseAmbientColorLocation = diffuseAmbientLocation;
-				SpecularColorLocation = specularColorLocation;
-				SpecularShininessLocation = specularShininessLocation;
-
-				AmbientLightIntensityLocation = ambientIntensityLocation;
-				LightIntensityLocation = lightIntensityLoc;
-				LightPositionLocation = lightPositionLoc;
-				CameraPositionLocation = cameraPositionLoc;
-
-				ShaderProgram = newShaderProgram;
-			}
+			FinishVariant(flags);
 		}
 	}
-	else
+	FrameVariantFlags = (clusters ? SHADER_VARIANT_CLUSTERED_LIGHTS : 0) |
+		(lightingGrid && lightingGrid->GetLevelCount() > 0 ? SHADER_VARIANT_LIGHTING_GRID : 0) |
+		(shadow ? SHADER_VARIANT_POINT_SHADOW : 0);
+
+	UniformRing->BeginFrame();
+	FrameView = camera->GetCameraTransform();
+	FrameProjection = projectionTransform;
+
+	FrameUniformBlock* frame = (FrameUniformBlock*)UniformRing->Allocate(sizeof(FrameUniformBlock), FrameBlockOffset);
+	HasFrameBlock = frame != NULL;
+	if (!frame)
+	{
+		return;
+	}
+	FrameView.Get(frame->View);
+	FrameProjection.Get(frame->Projection);
+	cyVec4f lightPositionInViewSpace = FrameView * light->LightPosition;
+	for (int i = 0; i < 3; i++)
+	{
+		frame->LightPosition[i] = lightPositionInViewSpace[i];
+		frame->CameraPosition[i] = camera->Position[i];
+	}
+	frame->LightIntensity = light->LightIntensity;
+	frame->AmbientLightIntensity = ambientLightIntensity;
+	for (int i = 0; i < 3; i++)
+	{
+		frame->LightColor[i] = light->Color[i];
+	}
+	frame->ClusterLightCount = clusters ? clusters->GetLightCount() : 0;
+	frame->ClusterGridSize[0] = LIGHT_CLUSTER_GRID_X;
+	frame->ClusterGridSize[1] = LIGHT_CLUSTER_GRID_Y;
+	frame->ClusterGridSize[2] = LIGHT_CLUSTER_GRID_Z;
+	frame->ClusterSliceScale = clusters ? clusters->GetSliceScale() : 0;
+	frame->ClusterSliceBias = clusters ? clusters->GetSliceBias() : 0;
+	frame->ClusterTileSize[0] = clusters ? clusters->GetTileWidth() : 1;
+	frame->ClusterTileSize[1] = clusters ? clusters->GetTileHeight() : 1;
+	frame->LightingGridEnabled = lightingGrid && lightingGrid->GetLevelCount() > 0;
+	frame->PointShadowFarPlane = shadow ? shadow->GetFarPlane() : 0;
+	if (clusters)
+	{
+		clusters->Bind();
+	}
+	if (lightingGrid)
+	{
+		lightingGrid->Bind();
+	}
+	if (shadow)
+	{
+		shadow->Bind();
+	}
+	UniformRing->Bind(FRAME_UNIFORM_BINDING, FrameBlockOffset, sizeof(FrameUniformBlock));
+}
+
+void Shader::Draw(RenderableObject* object)
+{
+	cyMatrix4f modelTransform;
+	if (!BindObjectUniforms(object, false, modelTransform))
+	{
+		return;
+	}
+
+	cyMatrix4f mv = FrameView * modelTransform;
+	object->SelectLod(mv, FrameProjection);
+	object->CullMeshlets(mv, FrameProjection);
+	object->Draw();
+}
+
+void Shader::DrawInstanced(RenderableObject* object, InstanceBuffer* instances)
+{
+	cyMatrix4f modelTransform;
+	if (!BindObjectUniforms(object, true, modelTransform))
+	{
+		return;
+	}
+	object->DrawInstanced(*instances, FrameView, FrameProjection);
+}
+
+void Shader::DrawScene(SceneRenderer* scene)
+{
+	//Per draw data comes from the scene's own buffers; only the frame block is shared.
+	//One draw covers every material, so highlights stay compiled in
+	GLStateCache::UseProgram(VariantProgram(FrameVariantFlags | SHADER_VARIANT_SPECULAR));
+	if (HasFrameBlock)
+	{
+		UniformRing->BindRange(FRAME_UNIFORM_BINDING, FrameBlockOffset, sizeof(FrameUniformBlock));
+	}
+	scene->Draw(FrameView, FrameProjection);
+}
+
+bool Shader::BindObjectUniforms(RenderableObject* object, bool instanced, cyMatrix4f& modelTransform)
+{
+	GLintptr offset;
+	ObjectUniformBlock* block = (ObjectUniformBlock*)UniformRing->Allocate(sizeof(ObjectUniformBlock), offset);
+	if (!block)
+	{
+		return false;
+	}
+
+	//The view and projection are applied on the GPU; only the model matrix and its normal matrix are per object
+	modelTransform = object->CalculateModelTransform();
+	FillObjectUniforms(*block, modelTransform, object->GetModelNormalTransform(), object->ObjectMaterial, object->GetVertexDecode());
+
+	//Shaders drawn in between bound their own frame block; the state cache skips the rebind otherwise
+	GLStateCache::UseProgram(GetProgram(object, instanced));
+	if (HasFrameBlock)
+	{
+		UniformRing->BindRange(FRAME_UNIFORM_BINDING, FrameBlockOffset, sizeof(FrameUniformBlock));
+	}
+	UniformRing->Bind(OBJECT_UNIFORM_BINDING, offset, sizeof(ObjectUniformBlock));
+	return true;
+}
+
+void Shader::EndFrame()
+{
+	UniformRing->EndFrame();
+}
+
+unsigned int Shader::VariantFlags(const RenderableObject* object, bool instanced) const
+{
+	unsigned int flags = FrameVariantFlags;
+	const cyVec4f& specular = object->ObjectMaterial->SpecularColor;
+	if (specular.x != 0 || specular.y != 0 || specular.z != 0)
+	{
+		flags |= SHADER_VARIANT_SPECULAR;
+	}
+	if (instanced)
+	{
+		flags |= SHADER_VARIANT_INSTANCING;
+	}
+	return flags;
+}
+
+GLuint Shader::GetProgram(const RenderableObject* object, bool instanced)
+{
+	return VariantProgram(VariantFlags(object, instanced));
+}
+
+GLuint Shader::VariantProgram(unsigned int flags)
+{
+	ProgramVariant& variant = Variants[flags];
+	if (!variant.Ready && !variant.Compiling && !variant.Failed)
+	{
+		StartVariant(flags);
+	}
+	return variant.Ready ? variant.Program : Variants[SHADER_VARIANT_ALL].Program;
+}
+
+unsigned int Shader::GetReadyVariantCount() const
+{
+	unsigned int count = 0;
+	for (const ProgramVariant& variant : Variants)
+	{
+		count += variant.Ready ? 1 : 0;
+	}
+	return count;
+}
+
+static GLuint startCompile(GLenum stage, const std::string& source)
+{
+	GLchar const* shaderSource = source.c_str();
+	GLuint shader = glCreateShader(stage);
+	glShaderSource(shader, 1, &shaderSource, NULL);
+	glCompileShader(shader);
+	return shader;
+}
+
+static void printCompileErrors(GLuint shader, const char* stageName)
+{
+	int success;
+	glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+	if (!success)
+	{
+		char infoLog[512];
+		glGetShaderInfoLog(shader, 512, NULL, infoLog);
+		fprintf(stderr, "Failed to compile %s shader. Error: %s\n", stageName, infoLog);
+	}
+}
+
+//Binds the uniform blocks and samplers of a linked program; false if it has no frame block.
+static bool setupProgram(GLuint program)
+{
+	GLuint frameBlockIndex = glGetUniformBlockIndex(program, "FrameUniforms");
+	GLuint objectBlockIndex = glGetUniformBlockIndex(program, "ObjectUniforms");
+	if (frameBlockIndex == GL_INVALID_INDEX)
 	{
-		return -1;
+		fprintf(stderr, "Could not get a uniform block index.\n");
+		return false;
+	}
+	//Programs that read per draw data from a storage buffer have no object block
+	glUniformBlockBinding(program, frameBlockIndex, FRAME_UNIFORM_BINDING);
+	if (objectBlockIndex != GL_INVALID_INDEX)
+	{
+		glUniformBlockBinding(program, objectBlockIndex, OBJECT_UNIFORM_BINDING);
 	}
 
-	glDeleteShader(vertexShader);
-	glDeleteShader(fragShader);
+	//Variants without the lighting grid or some samplers compile them out, which leaves these lookups invalid
+	GLuint lightingGridBlockIndex = glGetUniformBlockIndex(program, "LightingGridUniforms");
+	if (lightingGridBlockIndex != GL_INVALID_INDEX)
+	{
+		glUniformBlockBinding(program, lightingGridBlockIndex, LIGHTING_GRID_UNIFORM_BINDING);
+	}
 
-	return 0;
+	//Sampler units are fixed per program, so they are set once here
+	const char* samplers[] = { "ClusterLights", "ClusterRanges", "ClusterLightIndices", "LightingGridLights", "LightingGridBuckets", "PointShadowMap" };
+	GLint samplerUnits[] = { LIGHT_CLUSTER_LIGHTS_TEXTURE_UNIT, LIGHT_CLUSTER_RANGES_TEXTURE_UNIT, LIGHT_CLUSTER_INDICES_TEXTURE_UNIT,
+		LIGHTING_GRID_LIGHTS_TEXTURE_UNIT, LIGHTING_GRID_BUCKETS_TEXTURE_UNIT, POINT_LIGHT_SHADOW_TEXTURE_UNIT };
+	GLStateCache::UseProgram(program);
+	for (int i = 0; i < 6; i++)
+	{
+		GLint location = glGetUniformLocation(program, samplers[i]);
+		if (location >= 0)
+		{
+			glUniform1i(location, samplerUnits[i]);
+		}
+	}
+	return true;
+}
 
+void Shader::StartVariant(unsigned int flags)
+{
+	TRACE_SCOPE("start shader variant");
+	ProgramVariant& variant = Variants[flags];
+	std::string defines = Defines + variantDefines(flags);
+	std::string sources[2] = { insertDefines(VertexSource, defines), insertDefines(FragSource, defines + LightingSource) };
+
+	variant.CacheKey = ProgramBinaryCache::Key(sources, 2);
+	variant.Program = ProgramBinaryCache::Load(variant.CacheKey);
+	if (variant.Program)
+	{
+		//Block bindings and sampler units are not part of a program binary, so they are set either way
+		variant.Ready = setupProgram(variant.Program);
+		variant.Failed = !variant.Ready;
+		if (variant.Failed)
+		{
+			glDeleteProgram(variant.Program);
+			variant.Program = 0;
+		}
+		return;
+	}
+
+	//None of these wait for the driver; FinishVariant queries the results
+	variant.VertexShader = startCompile(GL_VERTEX_SHADER, sources[0]);
+	variant.FragShader = startCompile(GL_FRAGMENT_SHADER, sources[1]);
+	variant.Program = glCreateProgram();
+	glAttachShader(variant.Program, variant.VertexShader);
+	glAttachShader(variant.Program, variant.FragShader);
+	ProgramBinaryCache::PrepareForLink(variant.Program);
+	glLinkProgram(variant.Program);
+	variant.Compiling = true;
+}
+
+void Shader::FinishVariant(unsigned int flags)
+{
+	TRACE_SCOPE("finish shader variant");
+	ProgramVariant& variant = Variants[flags];
+	variant.Compiling = false;
+	int linkSuccess;
+	glGetProgramiv(variant.Program, GL_LINK_STATUS, &linkSuccess);
+	if (linkSuccess)
+	{
+		ProgramBinaryCache::Save(variant.CacheKey, variant.Program);
+		variant.Ready = setupProgram(variant.Program);
+	}
+	else
+	{
+		printCompileErrors(variant.VertexShader, "vertex");
+		printCompileErrors(variant.FragShader, "fragment");
+		char infoLog[512];
+		glGetProgramInfoLog(variant.Program, 512, NULL, infoLog);
+		fprintf(stderr, "Failed to link shaders. Error: %s\n", infoLog);
+	}
+	variant.Failed = !variant.Ready;
+	if (variant.Failed)
+	{
+		glDeleteProgram(variant.Program);
+		variant.Program = 0;
+	}
+	glDeleteShader(variant.VertexShader);
+	glDeleteShader(variant.FragShader);
+	variant.VertexShader = variant.FragShader = 0;
 }
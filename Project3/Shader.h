@@ -10,30 +10,118 @@
 #include "PointLight.h"
 #include "RenderableObject.h"
 #include "Camera.h"
+#include "UniformRingBuffer.h"
+#include "LightClusterGrid.h"
+#include "LightingGridBuffers.h"
 
+//Uniform block bindings shared by every program.
+#define FRAME_UNIFORM_BINDING 0
+#define OBJECT_UNIFORM_BINDING 1
+
+//Feature flags of a program variant, each compiled in as the #define named after it. A variant without a flag leaves
+//that code out rather than branching around it at run time; the light flags form the frame's lighting tier.
+#define SHADER_VARIANT_SPECULAR 1 //SHADER_SPECULAR: Blinn-Phong highlights
+#define SHADER_VARIANT_INSTANCING 2 //SHADER_INSTANCING: per instance transforms and colors
+#define SHADER_VARIANT_CLUSTERED_LIGHTS 4 //SHADER_CLUSTERED_LIGHTS
+#define SHADER_VARIANT_LIGHTING_GRID 8 //SHADER_LIGHTING_GRID
+#define SHADER_VARIANT_POINT_SHADOW 16 //SHADER_POINT_SHADOW
+#define SHADER_VARIANT_COUNT 32
+#define SHADER_VARIANT_ALL (SHADER_VARIANT_COUNT - 1)
+
+//std140 mirror of the FrameUniforms block in shader.vert, scene.vert and lighting.glsl.
+struct FrameUniformBlock
+{
+	float View[16];
+	float Projection[16];
+	float LightPosition[3]; //view space
+	float LightIntensity;
+	float CameraPosition[3];
+	float AmbientLightIntensity;
+	float LightColor[3];
+	unsigned int ClusterLightCount; //0 skips the clustered lights
+	unsigned int ClusterGridSize[3];
+	float ClusterSliceScale;
+	float ClusterTileSize[2]; //pixels
+	float ClusterSliceBias;
+	unsigned int LightingGridEnabled;
+	float PointShadowFarPlane; //0 leaves the main light unshadowed
+};
+
+//std140 mirror of the ObjectUniforms block; a mat3 takes three vec4 columns.
+struct ObjectUniformBlock
+{
+	float Model[16];
+	float ModelNormal[12];
+	float DiffuseAmbientColor[4];
+	float SpecularColor[4];
+	float PositionDecodeOffset[3];
+	float SpecularShininess;
+	float PositionDecodeScale[3];
+	int OctahedralNormals;
+};
+
+//Fills an object block; SceneRenderer stores the same layout per draw in a std430 buffer.
+void FillObjectUniforms(ObjectUniformBlock& block, const cyMatrix4f& modelTransform, const cyMatrix3f& modelNormalTransform,
+	const Material* material, const VertexDecodeParameters& vertexDecode);
+
+class SceneRenderer;
+class PointLightShadow;
+
+//A vertex and fragment shader pair compiled into one program per feature variant. The variant with every feature is
+//built up front and draws anything; the others are compiled the first time a draw asks for them, in parallel where
+//GL_KHR_parallel_shader_compile allows, and replace it once they finish.
 class Shader
 {
 public:
-	Shader(std::string vertexShaderFilename, std::string fragShaderFilename);
+	//defines are inserted after the #version line of both stages, ahead of each variant's own. The fragment stage also
+	//gets lighting.glsl, from the fragment shader's directory, after the defines.
+	Shader(std::string vertexShaderFilename, std::string fragShaderFilename, std::string defines = "");
+	~Shader();
+
+	//Writes the camera, light and projection block that every Draw until EndFrame uses.
+	//clusters, built for the same camera, adds its point lights on top of the main light, and lightingGrid its virtual lights.
+	//shadow, updated for the same light, shadows the main light.
+	void BeginFrame(PointLight* light, Camera* camera, cyMatrix4f projectionTransform, float ambientLightIntensity,
+		const LightClusterGrid* clusters = NULL, const LightingGridBuffers* lightingGrid = NULL, const PointLightShadow* shadow = NULL);
+	void Draw(RenderableObject* object);
+	void DrawInstanced(RenderableObject* object, InstanceBuffer* instances);
+	void DrawScene(SceneRenderer* scene);
+	void EndFrame();
 
-	void Draw(RenderableObject* object, PointLight* light, Camera* camera, cyMatrix4f projectionTransform, float ambientLightIntensity);
+	//The program drawing object in this frame, falling back to the full variant while the cheaper one compiles.
+	GLuint GetProgram(const RenderableObject* object, bool instanced = false);
+	unsigned int GetReadyVariantCount() const;
 
 private:
+	struct ProgramVariant
+	{
+		GLuint Program;
+		GLuint VertexShader; //attached while compiling
+		GLuint FragShader;
+		unsigned long long CacheKey;
+		bool Compiling;
+		bool Ready;
+		bool Failed;
+	};
 
-	GLuint ShaderProgram;
-	GLint MVPUniformLocation;
-	GLint MVUniformLocation;
-	GLint MVNUniformLocation; 
+	std::string VertexSource;
+	std::string FragSource;
+	std::string LightingSource;
+	std::string Defines;
+	ProgramVariant Variants[SHADER_VARIANT_COUNT];
+	unsigned int FrameVariantFlags; //lighting tier of the current frame
+	bool ParallelCompile;
 
-	GLint DiffuseAmbientColorLocation;
-	GLint SpecularColorLocation;
-	GLint SpecularShininessLocation;
+	UniformRingBuffer* UniformRing;
 
-	GLint AmbientLightIntensityLocation;
-	GLint LightIntensityLocation;
-	GLint LightPositionLocation;
-	GLint CameraPositionLocation;
+	cyMatrix4f FrameView;
+	cyMatrix4f FrameProjection;
+	GLintptr FrameBlockOffset;
+	bool HasFrameBlock;
 
-	int CompileShaders(std::string vertexShaderFilename, std::string fragShaderFilename);
+	unsigned int VariantFlags(const RenderableObject* object, bool instanced) const;
+	GLuint VariantProgram(unsigned int flags);
+	void StartVariant(unsigned int flags);
+	void FinishVariant(unsigned int flags);
+	bool BindObjectUniforms(RenderableObject* object, bool instanced, cyMatrix4f& modelTransform);
 };
-
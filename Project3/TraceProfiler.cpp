@@ -0,0 +1,147 @@
+#include "TraceProfiler.h"
+
+#include <stdio.h>
+#include "cyTimer.h"
+
+struct TraceEvent
+{
+	const char* Name;
+	double Timestamp; //microseconds since Enable
+	char Phase; //'B' or 'E'
+};
+
+struct TraceChunk
+{
+	TraceEvent Events[TRACE_CHUNK_EVENTS];
+	std::atomic<unsigned int> Count; //events the owning thread has published
+	std::atomic<TraceChunk*> Next;
+
+	TraceChunk() : Count(0), Next(nullptr) {}
+};
+
+struct TraceThread
+{
+	unsigned int Id;
+	std::atomic<const char*> Name;
+	TraceChunk* First;
+	TraceChunk* Current; //only touched by the owning thread
+	TraceThread* Next; //set before the thread is published on the list
+};
+
+std::atomic<bool> TraceProfiler::Enabled(false);
+
+static cy::Timer traceClock;
+static std::atomic<TraceThread*> traceThreads(nullptr);
+static std::atomic<unsigned int> nextTraceThreadId(1);
+static thread_local TraceThread* currentTraceThread = nullptr;
+
+static TraceThread* registerTraceThread()
+{
+	TraceThread* thread = new TraceThread();
+	thread->Id = nextTraceThreadId.fetch_add(1, std::memory_order_relaxed);
+	thread->Name.store(nullptr, std::memory_order_relaxed);
+	thread->First = thread->Current = new TraceChunk();
+	thread->Next = traceThreads.load(std::memory_order_relaxed);
+	while (!traceThreads.compare_exchange_weak(thread->Next, thread, std::memory_order_release, std::memory_order_relaxed))
+	{
+	}
+	currentTraceThread = thread;
+	return thread;
+}
+
+static void recordTraceEvent(const char* name, char phase)
+{
+	TraceThread* thread = currentTraceThread ? currentTraceThread : registerTraceThread();
+	TraceChunk* chunk = thread->Current;
+	unsigned int count = chunk->Count.load(std::memory_order_relaxed);
+	if (count == TRACE_CHUNK_EVENTS)
+	{
+		TraceChunk* next = new TraceChunk();
+		chunk->Next.store(next, std::memory_order_release);
+		thread->Current = chunk = next;
+		count = 0;
+	}
+	TraceEvent& event = chunk->Events[count];
+	event.Name = name;
+	event.Timestamp = traceClock.Stop() * 1000000.0;
+	event.Phase = phase;
+	chunk->Count.store(count + 1, std::memory_order_release);
+}
+
+void TraceProfiler::Enable()
+{
+	if (!Enabled.load(std::memory_order_relaxed))
+	{
+		traceClock.Start();
+		Enabled.store(true, std::memory_order_release);
+	}
+}
+
+void TraceProfiler::SetThreadName(const char* name)
+{
+	TraceThread* thread = currentTraceThread ? currentTraceThread : registerTraceThread();
+	thread->Name.store(name, std::memory_order_release);
+}
+
+void TraceProfiler::Begin(const char* name)
+{
+	recordTraceEvent(name, 'B');
+}
+
+void TraceProfiler::End(const char* name)
+{
+	recordTraceEvent(name, 'E');
+}
+
+static void writeTraceString(FILE* file, const char* text)
+{
+	fputc('"', file);
+	for (const char* c = text; *c; c++)
+	{
+		if (*c == '"' || *c == '\\')
+		{
+			fputc('\\', file);
+		}
+		fputc(*c, file);
+	}
+	fputc('"', file);
+}
+
+bool TraceProfiler::WriteChromeTrace(const char* filename)
+{
+	FILE* file = fopen(filename, "w");
+	if (!file)
+	{
+		fprintf(stderr, "Could not write trace to %s\n", filename);
+		return false;
+	}
+
+	fprintf(file, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+	bool first = true;
+	for (TraceThread* thread = traceThreads.load(std::memory_order_acquire); thread; thread = thread->Next)
+	{
+		const char* threadName = thread->Name.load(std::memory_order_acquire);
+		if (threadName)
+		{
+			fprintf(file, "%s{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":", first ? "" : ",\n", thread->Id);
+			writeTraceString(file, threadName);
+			fprintf(file, "}}");
+			first = false;
+		}
+		for (TraceChunk* chunk = thread->First; chunk; chunk = chunk->Next.load(std::memory_order_acquire))
+		{
+			unsigned int count = chunk->Count.load(std::memory_order_acquire);
+			for (unsigned int i = 0; i < count; i++)
+			{
+				const TraceEvent& event = chunk->Events[i];
+				fprintf(file, "%s{\"ph\":\"%c\",\"name\":", first ? "" : ",\n", event.Phase);
+				writeTraceString(file, event.Name);
+				fprintf(file, ",\"ts\":%.3f,\"pid\":1,\"tid\":%u}", event.Timestamp, thread->Id);
+				first = false;
+			}
+		}
+	}
+	fprintf(file, "\n]}\n");
+	fclose(file);
+	return true;
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <atomic>
+
+//Events per buffer chunk; a thread that fills one links a new chunk after it.
+#define TRACE_CHUNK_EVENTS 4096
+
+//Scoped begin/end events on a timeline, written as Chrome trace event JSON that chrome://tracing and Perfetto open.
+//Every thread records into its own chunked buffer, which only that thread appends to and publishes with an atomic
+//count, so recording takes no lock; buffers are registered once per thread on a lock free list and kept until exit.
+//Names must outlive the process' trace, string literals in practice. Recording is off until Enable.
+class TraceProfiler
+{
+public:
+	//Starts the clock events are timed against; call before other threads record.
+	static void Enable();
+	static bool IsEnabled() { return Enabled.load(std::memory_order_relaxed); }
+
+	//Names the calling thread's track in the trace.
+	static void SetThreadName(const char* name);
+
+	static void Begin(const char* name);
+	static void End(const char* name);
+
+	//Writes the events recorded so far. Scopes still open on other threads show as running to the end of the trace.
+	static bool WriteChromeTrace(const char* filename);
+
+private:
+	static std::atomic<bool> Enabled;
+};
+
+//Records the enclosing block; use through TRACE_SCOPE.
+class TraceScope
+{
+public:
+	TraceScope(const char* name) : Name(TraceProfiler::IsEnabled() ? name : 0)
+	{
+		if (Name)
+		{
+			TraceProfiler::Begin(Name);
+		}
+	}
+	~TraceScope()
+	{
+		if (Name)
+		{
+			TraceProfiler::End(Name);
+		}
+	}
+
+private:
+	const char* Name;
+};
+
+#define TRACE_CONCATENATE_INNER(a, b) a##b
+#define TRACE_CONCATENATE(a, b) TRACE_CONCATENATE_INNER(a, b)
+
+//Define TRACE_PROFILER_DISABLED to compile every trace scope out.
+#ifdef TRACE_PROFILER_DISABLED
+#define TRACE_SCOPE(name)
+#define TRACE_THREAD_NAME(name)
+#else
+#define TRACE_SCOPE(name) TraceScope TRACE_CONCATENATE(traceScope, __LINE__)(name)
+#define TRACE_THREAD_NAME(name) TraceProfiler::SetThreadName(name)
+#endif
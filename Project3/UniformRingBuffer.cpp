@@ -0,0 +1,123 @@
+#include "UniformRingBuffer.h"
+
+#include <stdio.h>
+#include "GLStateCache.h"
+
+UniformRingBuffer::UniformRingBuffer(size_t regionSize)
+{
+	GLint alignment = 256;
+	glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+	Alignment = alignment > 0 ? (size_t)alignment : 256;
+	RegionSize = (regionSize + Alignment - 1) / Alignment * Alignment;
+	size_t bufferSize = RegionSize * UNIFORM_RING_FRAMES;
+
+	MappedData = NULL;
+	glGenBuffers(1, &Buffer);
+	glBindBuffer(GL_UNIFORM_BUFFER, Buffer);
+	if (GLEW_VERSION_4_4 || GLEW_ARB_buffer_storage)
+	{
+		GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		glBufferStorage(GL_UNIFORM_BUFFER, bufferSize, NULL, flags);
+		MappedData = (unsigned char*)glMapBufferRange(GL_UNIFORM_BUFFER, 0, bufferSize, flags);
+		if (!MappedData)
+		{
+			fprintf(stderr, "Could not map the uniform ring buffer, falling back to glBufferSubData\n");
+			glDeleteBuffers(1, &Buffer);
+			glGenBuffers(1, &Buffer);
+			glBindBuffer(GL_UNIFORM_BUFFER, Buffer);
+		}
+	}
+	if (!MappedData)
+	{
+		glBufferData(GL_UNIFORM_BUFFER, bufferSize, NULL, GL_STREAM_DRAW);
+		StagingData.resize(bufferSize);
+	}
+
+	for (int i = 0; i < UNIFORM_RING_FRAMES; i++)
+	{
+		Fences[i] = NULL;
+	}
+	CurrentRegion = 0;
+	RegionOffset = 0;
+	ReportedOverflow = false;
+}
+
+UniformRingBuffer::~UniformRingBuffer()
+{
+	for (int i = 0; i < UNIFORM_RING_FRAMES; i++)
+	{
+		if (Fences[i])
+		{
+			glDeleteSync(Fences[i]);
+		}
+	}
+	if (MappedData)
+	{
+		glBindBuffer(GL_UNIFORM_BUFFER, Buffer);
+		glUnmapBuffer(GL_UNIFORM_BUFFER);
+	}
+	glDeleteBuffers(1, &Buffer);
+}
+
+void UniformRingBuffer::BeginFrame()
+{
+	RegionOffset = 0;
+	GLsync fence = Fences[CurrentRegion];
+	if (!fence)
+	{
+		return;
+	}
+
+	//Only blocks when the CPU is UNIFORM_RING_FRAMES frames ahead
+	GLbitfield waitFlags = GL_SYNC_FLUSH_COMMANDS_BIT;
+	while (true)
+	{
+		GLenum result = glClientWaitSync(fence, waitFlags, 1000000000ull);
+		if (result == GL_ALREADY_SIGNALED || result == GL_CONDITION_SATISFIED || result == GL_WAIT_FAILED)
+		{
+			break;
+		}
+		waitFlags = 0;
+	}
+	glDeleteSync(fence);
+	Fences[CurrentRegion] = NULL;
+}
+
+void* UniformRingBuffer::Allocate(size_t size, GLintptr& offset)
+{
+	size_t alignedSize = (size + Alignment - 1) / Alignment * Alignment;
+	if (RegionOffset + alignedSize > RegionSize)
+	{
+		if (!ReportedOverflow)
+		{
+			fprintf(stderr, "Uniform ring buffer region of %zu bytes is full, objects will be skipped\n", RegionSize);
+			ReportedOverflow = true;
+		}
+		return NULL;
+	}
+
+	offset = (GLintptr)(CurrentRegion * RegionSize + RegionOffset);
+	RegionOffset += alignedSize;
+	return (MappedData ? MappedData : StagingData.data()) + offset;
+}
+
+void UniformRingBuffer::Bind(GLuint binding, GLintptr offset, size_t size)
+{
+	if (!MappedData)
+	{
+		glBindBuffer(GL_UNIFORM_BUFFER, Buffer);
+		glBufferSubData(GL_UNIFORM_BUFFER, offset, size, StagingData.data() + offset);
+	}
+	BindRange(binding, offset, size);
+}
+
+void UniformRingBuffer::BindRange(GLuint binding, GLintptr offset, size_t size)
+{
+	GLStateCache::BindBufferRange(GL_UNIFORM_BUFFER, binding, Buffer, offset, (GLsizeiptr)size);
+}
+
+void UniformRingBuffer::EndFrame()
+{
+	Fences[CurrentRegion] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	CurrentRegion = (CurrentRegion + 1) % UNIFORM_RING_FRAMES;
+}
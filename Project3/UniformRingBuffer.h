@@ -0,0 +1,50 @@
+#pragma once
+
+#include <stddef.h>
+#include <vector>
+#include "GL/glew.h"
+
+//Frames the CPU may run ahead of the GPU; each gets its own region of the ring.
+#define UNIFORM_RING_FRAMES 3
+
+//Default bytes of uniform data one frame may write.
+#define UNIFORM_RING_REGION_SIZE (4 * 1024 * 1024)
+
+//Uniform buffer split into one region per frame in flight. With GL 4.4 buffer storage the buffer stays mapped
+//and blocks are written in place; a fence per region keeps the CPU from overwriting data the GPU still reads.
+//Without it, blocks are staged on the CPU and copied with glBufferSubData when bound.
+class UniformRingBuffer
+{
+public:
+	UniformRingBuffer(size_t regionSize = UNIFORM_RING_REGION_SIZE);
+	~UniformRingBuffer();
+
+	//Waits until the GPU is done with the region this frame reuses.
+	void BeginFrame();
+
+	//Returns space for a uniform block of the given size, aligned for glBindBufferRange, or NULL when the frame's region is full.
+	void* Allocate(size_t size, GLintptr& offset);
+
+	//Binds an allocated block to a uniform block binding point.
+	void Bind(GLuint binding, GLintptr offset, size_t size);
+
+	//Binds a block that Bind already made visible to the GPU earlier in the frame.
+	void BindRange(GLuint binding, GLintptr offset, size_t size);
+
+	//Fences the commands that read this frame's region.
+	void EndFrame();
+
+	bool IsPersistentlyMapped() const { return MappedData != NULL; }
+
+private:
+	GLuint Buffer;
+	size_t RegionSize;
+	size_t Alignment;
+	unsigned char* MappedData;
+	std::vector<unsigned char> StagingData; //used instead of MappedData without buffer storage
+
+	GLsync Fences[UNIFORM_RING_FRAMES];
+	int CurrentRegion;
+	size_t RegionOffset;
+	bool ReportedOverflow;
+};
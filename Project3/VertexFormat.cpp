@@ -0,0 +1,177 @@
+#include "VertexFormat.h"
+
+#include <string.h>
+#include <math.h>
+
+unsigned short FloatToHalf(float value)
+{
+	unsigned int bits;
+	memcpy(&bits, &value, sizeof(bits));
+	unsigned int sign = (bits >> 16) & 0x8000;
+	int exponent = (int)((bits >> 23) & 0xFF) - 127 + 15;
+	unsigned int mantissa = bits & 0x7FFFFF;
+
+	if (((bits >> 23) & 0xFF) == 0xFF)
+	{
+		//Infinity stays infinity, NaN stays NaN
+		return (unsigned short)(sign | 0x7C00 | (mantissa ? 0x200 : 0));
+	}
+	if (exponent >= 31)
+	{
+		return (unsigned short)(sign | 0x7C00);
+	}
+	if (exponent <= 0)
+	{
+		if (exponent < -10)
+		{
+			return (unsigned short)sign;
+		}
+		//Subnormal half: shift in the implicit bit and round to nearest even
+		mantissa |= 0x800000;
+		unsigned int shift = (unsigned int)(14 - exponent);
+		unsigned int halfMantissa = mantissa >> shift;
+		unsigned int remainder = mantissa & ((1u << shift) - 1);
+		unsigned int halfway = 1u << (shift - 1);
+		if (remainder > halfway || (remainder == halfway && (halfMantissa & 1)))
+		{
+			halfMantissa++;
+		}
+		return (unsigned short)(sign | halfMantissa);
+	}
+
+	unsigned int half = sign | ((unsigned int)exponent << 10) | (mantissa >> 13);
+	unsigned int remainder = mantissa & 0x1FFF;
+	if (remainder > 0x1000 || (remainder == 0x1000 && (half & 1)))
+	{
+		//May carry into the exponent, which correctly rounds up to the next power of two or infinity
+		half++;
+	}
+	return (unsigned short)half;
+}
+
+static float signNotZero(float value)
+{
+	return value >= 0.0f ? 1.0f : -1.0f;
+}
+
+static short floatToSnorm16(float value)
+{
+	if (value > 1.0f) value = 1.0f;
+	if (value < -1.0f) value = -1.0f;
+	return (short)floorf(value * 32767.0f + 0.5f);
+}
+
+static unsigned short floatToUnorm16(float value)
+{
+	if (value > 1.0f) value = 1.0f;
+	if (value < 0.0f) value = 0.0f;
+	return (unsigned short)floorf(value * 65535.0f + 0.5f);
+}
+
+void OctahedralEncode(const cyVec3f& normal, short encoded[2])
+{
+	float length1 = fabsf(normal.x) + fabsf(normal.y) + fabsf(normal.z);
+	if (length1 == 0.0f)
+	{
+		encoded[0] = 0;
+		encoded[1] = 0;
+		return;
+	}
+	float x = normal.x / length1;
+	float y = normal.y / length1;
+	if (normal.z < 0.0f)
+	{
+		//Fold the lower hemisphere over the diagonals
+		float foldedX = (1.0f - fabsf(y)) * signNotZero(x);
+		float foldedY = (1.0f - fabsf(x)) * signNotZero(y);
+		x = foldedX;
+		y = foldedY;
+	}
+	encoded[0] = floatToSnorm16(x);
+	encoded[1] = floatToSnorm16(y);
+}
+
+bool ParseVertexLayout(const char* name, VertexLayout& layout)
+{
+	if (strcmp(name, "float") == 0)
+	{
+		layout = VertexLayoutSeparateFloat;
+	}
+	else if (strcmp(name, "half") == 0)
+	{
+		layout = VertexLayoutInterleavedHalf;
+	}
+	else if (strcmp(name, "unorm16") == 0)
+	{
+		layout = VertexLayoutInterleavedUnorm16;
+	}
+	else
+	{
+		return false;
+	}
+	return true;
+}
+
+const char* VertexLayoutName(VertexLayout layout)
+{
+	switch (layout)
+	{
+	case VertexLayoutInterleavedHalf:
+		return "half";
+	case VertexLayoutInterleavedUnorm16:
+		return "unorm16";
+	default:
+		return "float";
+	}
+}
+
+VertexDecodeParameters GetVertexDecodeParameters(VertexLayout layout, const cyVec3f& boundMin, const cyVec3f& boundMax)
+{
+	VertexDecodeParameters decode;
+	decode.OctahedralNormals = layout != VertexLayoutSeparateFloat;
+	decode.PositionDecodeOffset = cyVec3f(0, 0, 0);
+	decode.PositionDecodeScale = cyVec3f(1, 1, 1);
+
+	cyVec3f extent = boundMax - boundMin;
+	for (int i = 0; i < 3; i++)
+	{
+		//Flat meshes would otherwise divide by zero while encoding
+		if (!(extent[i] > 0.0f))
+		{
+			extent[i] = 1.0f;
+		}
+	}
+
+	if (layout == VertexLayoutInterleavedHalf)
+	{
+		//Halfs are most precise around zero, so encode [-1, 1] around the center
+		decode.PositionDecodeOffset = boundMin + (boundMax - boundMin) / 2;
+		decode.PositionDecodeScale = extent / 2;
+	}
+	else if (layout == VertexLayoutInterleavedUnorm16)
+	{
+		decode.PositionDecodeOffset = boundMin;
+		decode.PositionDecodeScale = extent;
+	}
+	return decode;
+}
+
+void PackVertices(VertexLayout layout, const VertexDecodeParameters& decode,
+	const cyVec3f* positions, const cyVec3f* normals, const cyVec2f* texCoords, unsigned int vertexCount,
+	std::vector<PackedVertex>& packedVertices)
+{
+	packedVertices.resize(vertexCount);
+	for (unsigned int i = 0; i < vertexCount; i++)
+	{
+		PackedVertex& packed = packedVertices[i];
+		cyVec3f encodedPosition = (positions[i] - decode.PositionDecodeOffset) / decode.PositionDecodeScale;
+		for (int j = 0; j < 3; j++)
+		{
+			packed.Position[j] = layout == VertexLayoutInterleavedHalf ? FloatToHalf(encodedPosition[j]) : floatToUnorm16(encodedPosition[j]);
+		}
+		packed.Position[3] = 0;
+		OctahedralEncode(normals[i], packed.Normal);
+		packed.TexCoord[0] = FloatToHalf(texCoords[i].x);
+		packed.TexCoord[1] = FloatToHalf(texCoords[i].y);
+	}
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <vector>
+#include "cyVector.h"
+
+//How RenderableObject lays out its vertex buffers on the GPU.
+enum VertexLayout
+{
+	VertexLayoutSeparateFloat,      //float3 position, float3 normal and float2 uv in separate buffers
+	VertexLayoutInterleavedHalf,    //half float positions relative to the bounding box center
+	VertexLayoutInterleavedUnorm16  //16 bit normalized positions relative to the bounding box minimum
+};
+
+//16 byte interleaved vertex of the compressed layouts. Normals are octahedral encoded as two 16 bit snorms.
+struct PackedVertex
+{
+	unsigned short Position[4];
+	short Normal[2];
+	unsigned short TexCoord[2];
+};
+
+//The vertex shader reconstructs positions as PositionDecodeOffset + aPos * PositionDecodeScale.
+struct VertexDecodeParameters
+{
+	cyVec3f PositionDecodeOffset;
+	cyVec3f PositionDecodeScale;
+	bool OctahedralNormals;
+};
+
+unsigned short FloatToHalf(float value);
+void OctahedralEncode(const cyVec3f& normal, short encoded[2]);
+
+//Parses "float", "half" or "unorm16". Returns false for anything else.
+bool ParseVertexLayout(const char* name, VertexLayout& layout);
+const char* VertexLayoutName(VertexLayout layout);
+
+VertexDecodeParameters GetVertexDecodeParameters(VertexLayout layout, const cyVec3f& boundMin, const cyVec3f& boundMax);
+
+void PackVertices(VertexLayout layout, const VertexDecodeParameters& decode,
+	const cyVec3f* positions, const cyVec3f* normals, const cyVec2f* texCoords, unsigned int vertexCount,
+	std::vector<PackedVertex>& packedVertices);
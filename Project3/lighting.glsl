@@ -0,0 +1,206 @@
+//Lighting shared by shader.frag and scene.frag. Shader inserts this file after the #version line of the fragment stage,
+//behind the defines, so it sees the variant flags but none of the including shader's own declarations; the material
+//comes in through SceneLighting's parameters.
+layout(std140) uniform FrameUniforms
+{
+	mat4 View;
+	mat4 Projection;
+	vec3 LightPosition;
+	float LightIntensity;
+	vec3 CameraPosition;
+	float AmbientLightIntensity;
+	vec3 LightColor;
+	uint ClusterLightCount;
+	uvec3 ClusterGridSize;
+	float ClusterSliceScale;
+	vec2 ClusterTileSize;
+	float ClusterSliceBias;
+	uint LightingGridEnabled;
+	float PointShadowFarPlane;
+};
+
+//Variants without SHADER_SPECULAR fold every highlight to zero, which also drops the half vectors feeding it.
+float specularFactor(vec3 halfVector, vec3 normal, float shininess)
+{
+#ifdef SHADER_SPECULAR
+	return pow(max(0, dot(halfVector, normal)), shininess);
+#else
+	return 0.0;
+#endif
+}
+
+#ifdef SHADER_CLUSTERED_LIGHTS
+//Clustered point lights, filled by LightClusterGrid: two texels per light (view space position and radius, then color),
+//an offset and count into ClusterLightIndices per froxel, and the froxels' concatenated light lists.
+uniform samplerBuffer ClusterLights;
+uniform usamplerBuffer ClusterRanges;
+uniform usamplerBuffer ClusterLightIndices;
+
+vec3 ClusteredLighting(vec3 fragPosition, vec3 normal, vec3 viewDirection, vec3 diffuseColor, vec3 specularColor, float shininess)
+{
+	uvec2 tile = min(uvec2(gl_FragCoord.xy / ClusterTileSize), ClusterGridSize.xy - 1u);
+	uint slice = uint(clamp(log(-fragPosition.z) * ClusterSliceScale + ClusterSliceBias, 0.0, float(ClusterGridSize.z - 1u)));
+	uvec2 range = texelFetch(ClusterRanges, int((slice * ClusterGridSize.y + tile.y) * ClusterGridSize.x + tile.x)).xy;
+
+	vec3 color = vec3(0);
+	for (uint i = 0u; i < range.y; i++)
+	{
+		int light = int(texelFetch(ClusterLightIndices, int(range.x + i)).x);
+		vec4 positionRadius = texelFetch(ClusterLights, light * 2);
+		vec3 toLight = positionRadius.xyz - fragPosition;
+		float distanceSquared = dot(toLight, toLight);
+		float falloff = clamp(1.0 - distanceSquared / (positionRadius.w * positionRadius.w), 0.0, 1.0);
+		if (falloff <= 0.0)
+		{
+			continue;
+		}
+		vec3 lightDirection = toLight * inversesqrt(distanceSquared);
+		vec3 halfVector = normalize(lightDirection + viewDirection);
+		color += falloff * falloff * texelFetch(ClusterLights, light * 2 + 1).rgb *
+			(max(0, dot(lightDirection, normal)) * diffuseColor + specularFactor(halfVector, normal, shininess) * specularColor);
+	}
+	return color;
+}
+#endif
+
+#ifdef SHADER_LIGHTING_GRID
+//Lighting grid hierarchy exported by LightingGridBuffers: per level the first light texel, light count, first hash
+//bucket and bucket mask, and the hash cell size. Lights take two texels, world position and intensity.
+layout(std140) uniform LightingGridUniforms
+{
+	ivec4 LightingGridLevels[16];
+	vec4 LightingGridBucketCellSizes[16];
+	int LightingGridLevelCount;
+	float LightingGridCellSize;
+	float LightingGridAlpha;
+};
+uniform samplerBuffer LightingGridLights;
+uniform usamplerBuffer LightingGridBuckets;
+
+uint lightingGridBucket(ivec3 cell, int mask)
+{
+	uvec3 c = uvec3(cell);
+	return ((c.x * 73856093u) ^ (c.y * 19349663u) ^ (c.z * 83492791u)) & uint(mask);
+}
+
+vec3 lightingGridLight(int light, float weight, vec3 fragPosition, vec3 normal, vec3 viewDirection, vec3 diffuseColor, vec3 specularColor, float shininess)
+{
+	//Inverse square falloff, held at the finest cell size so lights right on a surface do not blow out
+	vec3 toLight = (View * vec4(texelFetch(LightingGridLights, light * 2).xyz, 1)).xyz - fragPosition;
+	float distanceSquared = max(dot(toLight, toLight), LightingGridCellSize * LightingGridCellSize);
+	vec3 lightDirection = normalize(toLight);
+	vec3 halfVector = normalize(lightDirection + viewDirection);
+	return weight / distanceSquared * texelFetch(LightingGridLights, light * 2 + 1).rgb *
+		(max(0, dot(lightDirection, normal)) * diffuseColor + specularFactor(halfVector, normal, shininess) * specularColor);
+}
+
+//Mirrors cy::LightingGridHierarchy::Light with alpha set to LightingGridAlpha and no stochastic shadow samples.
+vec3 LightingGridLighting(vec3 fragPosition, vec3 normal, vec3 viewDirection, vec3 diffuseColor, vec3 specularColor, float shininess)
+{
+	//View is rigid, so it is undone with its transposed rotation
+	vec3 worldPosition = transpose(mat3(View)) * (fragPosition - View[3].xyz);
+	vec3 color = vec3(0);
+	int lastLevel = LightingGridLevelCount - 1;
+	float r = LightingGridAlpha * LightingGridCellSize;
+	for (int level = 0; level < lastLevel; level++)
+	{
+		//Lights within 2r; the hash cells are at least twice that, so the search sphere overlaps at most 2x2x2 of them
+		float rMin = 0.5 * r;
+		ivec4 levelInfo = LightingGridLevels[level];
+		ivec3 firstCell = ivec3(floor(worldPosition / LightingGridBucketCellSizes[level].x - 0.5));
+		uint visited[8];
+		for (int cell = 0; cell < 8; cell++)
+		{
+			uint bucket = lightingGridBucket(firstCell + ivec3(cell & 1, (cell >> 1) & 1, cell >> 2), levelInfo.w);
+			bool seen = false;
+			for (int i = 0; i < cell; i++)
+			{
+				seen = seen || visited[i] == bucket;
+			}
+			visited[cell] = bucket;
+			if (seen)
+			{
+				continue;
+			}
+			uvec2 range = texelFetch(LightingGridBuckets, levelInfo.z + int(bucket)).xy;
+			for (int light = int(range.x); light < int(range.x + range.y); light++)
+			{
+				float d = distance(worldPosition, texelFetch(LightingGridLights, light * 2).xyz);
+				if (d >= 2 * r || (level > 0 && d <= rMin))
+				{
+					continue;
+				}
+				float weight = d > r ? 1 - (d - r) / r : (level > 0 ? (d - rMin) / rMin : 1.0);
+				color += lightingGridLight(light, weight, fragPosition, normal, viewDirection, diffuseColor, specularColor, shininess);
+			}
+		}
+		r *= 2;
+	}
+
+	//The coarsest level, or a single level hierarchy, is summed in full
+	ivec4 levelInfo = LightingGridLevels[lastLevel];
+	float rMin = 0.5 * r;
+	for (int light = levelInfo.x; light < levelInfo.x + levelInfo.y; light++)
+	{
+		float weight = 1;
+		if (lastLevel > 0)
+		{
+			float d = distance(worldPosition, texelFetch(LightingGridLights, light * 2).xyz);
+			if (d <= rMin)
+			{
+				continue;
+			}
+			weight = d < r ? (d - rMin) / rMin : 1.0;
+		}
+		color += lightingGridLight(light, weight, fragPosition, normal, viewDirection, diffuseColor, specularColor, shininess);
+	}
+	return color;
+}
+#endif
+
+#ifdef SHADER_POINT_SHADOW
+//Cube shadow map of the main light from PointLightShadow, holding the distance to the light over PointShadowFarPlane.
+uniform samplerCubeShadow PointShadowMap;
+
+float PointShadow(vec3 fragPosition)
+{
+	//View is rigid, so its transposed rotation takes view space offsets back to the world space the map was drawn in
+	vec3 lightToFragment = transpose(mat3(View)) * (fragPosition - LightPosition);
+	float distance = length(lightToFragment);
+	//The bias grows with distance like a texel's footprint does; depths past the far plane are clamped so they still meet casters
+	return texture(PointShadowMap, vec4(lightToFragment, min(0.99 * distance / PointShadowFarPlane, 1.0)));
+}
+#endif
+
+//Main light with its shadow and ambient term, then the clustered and lighting grid lights the variant has.
+vec4 SceneLighting(vec3 normal, vec3 fragPosition, vec4 diffuseAmbientColor, vec4 specularColor, float shininess)
+{
+	vec3 normalizedNormal = normalize(normal);
+	vec3 lightDirection = normalize(LightPosition - fragPosition);
+	//fragPosition is in view space, where the camera sits at the origin
+	vec3 viewDirection = normalize(-fragPosition);
+	vec3 halfVector = normalize(lightDirection + viewDirection);
+#ifdef SHADER_POINT_SHADOW
+	float shadow = PointShadowFarPlane > 0.0 ? PointShadow(fragPosition) : 1.0;
+#else
+	float shadow = 1.0;
+#endif
+	vec4 color = vec4(LightColor, 1) * LightIntensity * shadow * 
+		(
+			max(0,dot(lightDirection, normalizedNormal)) * diffuseAmbientColor + 
+			specularFactor(halfVector, normalizedNormal, shininess) * specularColor
+		) + AmbientLightIntensity * diffuseAmbientColor;
+#ifdef SHADER_CLUSTERED_LIGHTS
+	if (ClusterLightCount > 0u)
+	{
+		color.rgb += ClusteredLighting(fragPosition, normalizedNormal, viewDirection, diffuseAmbientColor.rgb, specularColor.rgb, shininess);
+	}
+#endif
+#ifdef SHADER_LIGHTING_GRID
+	if (LightingGridEnabled != 0u)
+	{
+		color.rgb += LightingGridLighting(fragPosition, normalizedNormal, viewDirection, diffuseAmbientColor.rgb, specularColor.rgb, shininess);
+	}
+#endif
+	return color;
+}
@@ -0,0 +1,33 @@
+#version 430 core
+
+in vec3 SurfaceNormal;
+in vec4 ViewSpacePosition;
+flat in int DrawIndex;
+
+struct DrawData
+{
+	mat4 Model;
+	mat3 ModelNormal;
+	vec4 DiffuseAmbientColor;
+	vec4 SpecularColor;
+	vec3 PositionDecodeOffset;
+	float SpecularShininess;
+	vec3 PositionDecodeScale;
+	bool OctahedralNormals;
+};
+
+layout(std430, binding=0) readonly buffer DrawBuffer
+{
+	DrawData Draws[];
+};
+
+//Material fields of the fragment's object.
+#define MATERIAL(field) Draws[DrawIndex].field
+
+out vec4 FragColor;
+
+void main()
+{
+	FragColor = SceneLighting(SurfaceNormal, ViewSpacePosition.xyz, MATERIAL(DiffuseAmbientColor), MATERIAL(SpecularColor),
+		MATERIAL(SpecularShininess));
+}
\ No newline at end of file
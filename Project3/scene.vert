@@ -0,0 +1,75 @@
+#version 430 core
+//USE_DRAW_ID is defined when the driver exposes gl_DrawID; otherwise each command's base instance selects an entry of aDrawIndex.
+#ifdef USE_DRAW_ID
+#extension GL_ARB_shader_draw_parameters : require
+#define DRAW_INDEX gl_DrawIDARB
+#else
+layout(location=7) in uint aDrawIndex;
+#define DRAW_INDEX aDrawIndex
+#endif
+layout(location=0) in vec3 aPos;
+layout(location=1) in vec3 aNormal;
+layout(location=2) in vec2 aTexCoord;
+
+out vec3 SurfaceNormal;
+out vec4 ViewSpacePosition;
+out vec2 TexCoord;
+flat out int DrawIndex;
+
+layout(std140) uniform FrameUniforms
+{
+	mat4 View;
+	mat4 Projection;
+	vec3 LightPosition;
+	float LightIntensity;
+	vec3 CameraPosition;
+	float AmbientLightIntensity;
+	vec3 LightColor;
+	uint ClusterLightCount;
+	uvec3 ClusterGridSize;
+	float ClusterSliceScale;
+	vec2 ClusterTileSize;
+	float ClusterSliceBias;
+	uint LightingGridEnabled;
+	float PointShadowFarPlane;
+};
+
+//Same members as ObjectUniforms in shader.vert, one entry per indirect command.
+struct DrawData
+{
+	mat4 Model;
+	mat3 ModelNormal;
+	vec4 DiffuseAmbientColor;
+	vec4 SpecularColor;
+	vec3 PositionDecodeOffset;
+	float SpecularShininess;
+	vec3 PositionDecodeScale;
+	bool OctahedralNormals;
+};
+
+layout(std430, binding=0) readonly buffer DrawBuffer
+{
+	DrawData Draws[];
+};
+
+vec3 octahedralDecode(vec2 e)
+{
+	vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+	float t = max(-n.z, 0.0);
+	n.x += n.x >= 0.0 ? -t : t;
+	n.y += n.y >= 0.0 ? -t : t;
+	return normalize(n);
+}
+
+void main()
+{
+	DrawIndex = int(DRAW_INDEX);
+	DrawData draw = Draws[DrawIndex];
+	vec4 position = vec4(draw.PositionDecodeOffset + aPos * draw.PositionDecodeScale, 1);
+	vec3 normal = draw.OctahedralNormals ? octahedralDecode(aNormal.xy) : aNormal;
+
+	ViewSpacePosition = View * (draw.Model * position);
+	gl_Position = Projection * ViewSpacePosition;
+	SurfaceNormal = normalize(mat3(View) * (draw.ModelNormal * normal));
+	TexCoord = aTexCoord;
+}
\ No newline at end of file
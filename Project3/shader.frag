@@ -2,28 +2,27 @@
 
 in vec3 SurfaceNormal;
 in vec4 ViewSpacePosition;
+in vec4 InstanceColor;
 
-uniform vec4 DiffuseAmbientColor;
-uniform vec4 SpecularColor;
-uniform float SpecularShininess;
+layout(std140) uniform ObjectUniforms
+{
+	mat4 Model;
+	mat3 ModelNormal;
+	vec4 DiffuseAmbientColor;
+	vec4 SpecularColor;
+	vec3 PositionDecodeOffset;
+	float SpecularShininess;
+	vec3 PositionDecodeScale;
+	bool OctahedralNormals;
+};
 
-uniform float AmbientLightIntensity;
-uniform float LightIntensity;
-uniform vec3 LightPosition;
-uniform vec3 CameraPosition;
+//Material fields of the fragment's object.
+#define MATERIAL(field) field
 
 out vec4 FragColor;
 
 void main()
 {
-	vec3 normalizedNormal = normalize(SurfaceNormal);
-	vec3 fragPosition = ViewSpacePosition.xyz;
-	vec3 lightDirection = normalize(LightPosition - fragPosition);
-	vec3 viewDirection = normalize(CameraPosition - fragPosition);
-	vec3 halfVector = normalize(lightDirection + viewDirection);
-	FragColor = LightIntensity * 
-		(
-			max(0,dot(lightDirection, normalizedNormal)) * DiffuseAmbientColor + 
-			pow(max(0,dot(halfVector, normalizedNormal)), SpecularShininess) * SpecularColor
-		) + AmbientLightIntensity * DiffuseAmbientColor;
+	FragColor = SceneLighting(SurfaceNormal, ViewSpacePosition.xyz, MATERIAL(DiffuseAmbientColor) * InstanceColor, MATERIAL(SpecularColor),
+		MATERIAL(SpecularShininess));
 }
\ No newline at end of file
@@ -1,17 +1,80 @@
 #version 330 core
 layout(location=0) in vec3 aPos;
 layout(location=1) in vec3 aNormal;
+layout(location=2) in vec2 aTexCoord;
+#ifdef SHADER_INSTANCING
+//Per-instance affine transform rows and color; constant identity and white for objects drawn without instances.
+layout(location=3) in vec4 aInstanceRow0;
+layout(location=4) in vec4 aInstanceRow1;
+layout(location=5) in vec4 aInstanceRow2;
+layout(location=6) in vec4 aInstanceColor;
+#endif
 
 out vec3 SurfaceNormal;
 out vec4 ViewSpacePosition;
+out vec2 TexCoord;
+out vec4 InstanceColor;
 
-uniform mat4 mvp;
-uniform mat4 mv;
-uniform mat3 mvn;
+layout(std140) uniform FrameUniforms
+{
+	mat4 View;
+	mat4 Projection;
+	vec3 LightPosition;
+	float LightIntensity;
+	vec3 CameraPosition;
+	float AmbientLightIntensity;
+	vec3 LightColor;
+	uint ClusterLightCount;
+	uvec3 ClusterGridSize;
+	float ClusterSliceScale;
+	vec2 ClusterTileSize;
+	float ClusterSliceBias;
+	uint LightingGridEnabled;
+	float PointShadowFarPlane;
+};
+
+//Compressed vertex layouts store positions relative to the bounding box and octahedral normals in aNormal.xy.
+layout(std140) uniform ObjectUniforms
+{
+	mat4 Model;
+	mat3 ModelNormal;
+	vec4 DiffuseAmbientColor;
+	vec4 SpecularColor;
+	vec3 PositionDecodeOffset;
+	float SpecularShininess;
+	vec3 PositionDecodeScale;
+	bool OctahedralNormals;
+};
+
+vec3 octahedralDecode(vec2 e)
+{
+	vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+	float t = max(-n.z, 0.0);
+	n.x += n.x >= 0.0 ? -t : t;
+	n.y += n.y >= 0.0 ? -t : t;
+	return normalize(n);
+}
 
 void main()
 {
-	gl_Position = mvp * vec4(aPos,1);
-	SurfaceNormal = normalize(mvn * aNormal);
-	ViewSpacePosition = mv * vec4(aPos,1);
+	vec4 position = vec4(PositionDecodeOffset + aPos * PositionDecodeScale, 1);
+	vec3 normal = OctahedralNormals ? octahedralDecode(aNormal.xy) : aNormal;
+	vec4 worldPosition = Model * position;
+	vec3 worldNormal = ModelNormal * normal;
+#ifdef SHADER_INSTANCING
+	mat4 instance = transpose(mat4(aInstanceRow0, aInstanceRow1, aInstanceRow2, vec4(0, 0, 0, 1)));
+	//Cofactor matrix: the inverse transpose up to a scale, which normalize removes
+	mat3 instanceNormal = mat3(cross(instance[1].xyz, instance[2].xyz), cross(instance[2].xyz, instance[0].xyz), cross(instance[0].xyz, instance[1].xyz));
+	worldPosition = instance * worldPosition;
+	worldNormal = instanceNormal * worldNormal;
+	InstanceColor = aInstanceColor;
+#else
+	InstanceColor = vec4(1);
+#endif
+
+	ViewSpacePosition = View * worldPosition;
+	gl_Position = Projection * ViewSpacePosition;
+	//The camera transform is rigid, so its rotation part is its own normal matrix
+	SurfaceNormal = normalize(mat3(View) * worldNormal);
+	TexCoord = aTexCoord;
 }
\ No newline at end of file
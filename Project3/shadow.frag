@@ -0,0 +1,15 @@
+#version 330 core
+in vec3 LightToVertex;
+
+layout(std140) uniform ShadowUniforms
+{
+	mat4 FaceViewProjections[6];
+	vec3 ShadowLightPosition;
+	float ShadowFarPlane;
+};
+
+//Distance to the light instead of the face's depth, so the map can be looked up along any direction.
+void main()
+{
+	gl_FragDepth = length(LightToVertex) / ShadowFarPlane;
+}
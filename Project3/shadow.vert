@@ -0,0 +1,21 @@
+#version 330 core
+layout(location=0) in vec3 aPos;
+
+//Same layout as in shader.vert; only the model matrix and position decoding are used here.
+layout(std140) uniform ObjectUniforms
+{
+	mat4 Model;
+	mat3 ModelNormal;
+	vec4 DiffuseAmbientColor;
+	vec4 SpecularColor;
+	vec3 PositionDecodeOffset;
+	float SpecularShininess;
+	vec3 PositionDecodeScale;
+	bool OctahedralNormals;
+};
+
+//World space; shadow.geom projects each triangle onto the cube faces.
+void main()
+{
+	gl_Position = Model * vec4(PositionDecodeOffset + aPos * PositionDecodeScale, 1);
+}
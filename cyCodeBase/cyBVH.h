@@ -141,6 +141,10 @@ public:
 		delete tempRoot;
 	}
 
+	//! Recomputes the bounding boxes of all nodes from the current element bounds, keeping the tree structure.
+	//! Much cheaper than Build when elements move, but the tree gets looser the further they move from where they were built.
+	void Refit() { if ( nodes ) RefitNode( GetRootNodeID() ); }
+
 	/////////////////////////////////////////////////////////////////////////////////
 
 protected:
@@ -189,6 +193,8 @@ private:
 	public:
 		void SetLeafNode( Box const &bound, unsigned int elemCount, unsigned int elemOffset ) { box=bound; data=(elemOffset&_CY_BVH_ELEMENT_OFFSET_MASK)|((elemCount-1)<<_CY_BVH_ELEMENT_OFFSET_BITS)|_CY_BVH_LEAF_BIT_MASK; }
 		void SetInternalNode( Box const &bound, unsigned int chilIndex ) { box=bound; data=(chilIndex&_CY_BVH_CHILD_INDEX_MASK); }
+		void SetBounds( Box const &bound ) { box=bound; }																		//!< replaces the bounding box, keeping the node data
+		Box const &   GetBox       () const { return box; }																	//!< returns the bounding box of the node
 		unsigned int  ChildIndex   () const { return (data&_CY_BVH_CHILD_INDEX_MASK); }									//!< returns the index to the first child (must be internal node)
 		unsigned int  ElementOffset() const { return (data&_CY_BVH_ELEMENT_OFFSET_MASK); }									//!< returns the offset to the first element (must be leaf node)
 		unsigned int  ElementCount () const { return ((data>>_CY_BVH_ELEMENT_OFFSET_BITS)&_CY_BVH_ELEMENT_COUNT_MASK)+1; }	//!< returns the number of elements in this node (must be leaf node)
@@ -290,6 +296,27 @@ private:
 		}
 	}
 
+	//! Recursively recomputes the bounding box of the given node from its elements or child nodes.
+	void RefitNode( unsigned int nodeID )
+	{
+		Box box;
+		if ( nodes[nodeID].IsLeafNode() ) {
+			unsigned int const *nodeElements = &elements[nodes[nodeID].ElementOffset()];
+			for ( unsigned int i=0; i<nodes[nodeID].ElementCount(); i++ ) {
+				Box eBox;
+				GetElementBounds( nodeElements[i], eBox.b );
+				box += eBox;
+			}
+		} else {
+			unsigned int child = nodes[nodeID].ChildIndex();
+			RefitNode( child );
+			RefitNode( child+1 );
+			box += nodes[child].GetBox();
+			box += nodes[child+1].GetBox();
+		}
+		nodes[nodeID].SetBounds( box );
+	}
+
 	//! Called by the default implementation of FindSplit.
 	//! Splits the elements using the widest axis of the given bounding box.
 	unsigned int MeanSplit(unsigned int elementCount, unsigned int *nodeElements, float const *box, unsigned int maxElementsPerNode )
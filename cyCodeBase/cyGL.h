@@ -780,6 +780,16 @@ public:
 	//! Writes any error or warning messages to the given output stream.
 	bool Link( std::ostream *outStream=&std::cout );
 
+	//! Returns the linked program's binary and its format, as given by glGetProgramBinary.
+	//! Returns false if the program has no binary to give.
+	//! Requires OpenGL 4.1 or ARB_get_program_binary.
+	bool GetBinary( std::vector<char> &binary, GLenum &format ) const;
+
+	//! Creates the program from a binary that GetBinary returned earlier.
+	//! Returns false and deletes the program if the driver rejects the binary,
+	//! which happens after driver updates, so the program must then be built from source.
+	bool LoadBinary( GLenum format, void const *binary, GLsizei length );
+
 	//!@name Build Methods
 
 	//! Creates a program, compiles the given shaders, and links them.
@@ -1583,6 +1593,27 @@ inline bool GLSLProgram::Link( std::ostream *outStream )
 	return result == GL_TRUE;
 }
 
+inline bool GLSLProgram::GetBinary( std::vector<char> &binary, GLenum &format ) const
+{
+	GLint length = 0;
+	glGetProgramiv(programID, GL_PROGRAM_BINARY_LENGTH, &length);
+	if ( length <= 0 ) return false;
+	binary.resize(length);
+	glGetProgramBinary(programID, length, &length, &format, binary.data());
+	binary.resize(length);
+	return length > 0;
+}
+
+inline bool GLSLProgram::LoadBinary( GLenum format, void const *binary, GLsizei length )
+{
+	CreateProgram();
+	glProgramBinary(programID, format, binary, length);
+	GLint result = GL_FALSE;
+	glGetProgramiv(programID, GL_LINK_STATUS, &result);
+	if ( result != GL_TRUE ) Delete();
+	return result == GL_TRUE;
+}
+
 inline bool GLSLProgram::Build( GLSLShader const *vertexShader, 
                                 GLSLShader const *fragmentShader,
 	                            GLSLShader const *geometryShader,
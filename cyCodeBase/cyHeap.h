@@ -155,7 +155,7 @@ public:
 		if ( p > heapItemCount ) return false;
 		SwapItems( p, heapItemCount );
 		heapItemCount--;
-		return HeapMoveDown(p);
+		return HeapOrder(p);	// the last item may belong above the removed one as well as below it
 	}
 
 	//! Returns if the item with the given id is in the heap or removed by Pop.
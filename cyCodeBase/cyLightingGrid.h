@@ -56,6 +56,10 @@
 #include "cyColor.h"
 #include "cyPointCloud.h"
 #include <random>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <algorithm>
 
 //-------------------------------------------------------------------------------
 namespace cy {
@@ -82,6 +86,7 @@ public:
 
 	int   GetNumLevels() const { return numLevels; }	//!< Returns the number of levels in the hierarchy.
 	float GetCellSize () const { return cellSize; }		//!< Returns the size of a cell in the lowest (finest) level of the hierarchy.
+	int   GetNumLights( int level ) const { return levels[level].pc.GetPointCount(); }	//!< Returns the number of lights at the given level.
 	const Vec3f& GetLightPos   ( int level, int i  ) const { return levels[level].pc.GetPoint(i); }							//!< Returns the i^th light position at the given level. Note that this is not the position of the light with index i.
 	const int    GetLightIndex ( int level, int i  ) const { return levels[level].pc.GetPointIndex(i); }					//!< Returns the i^th light index at the given level.
 	const Color& GetLightIntens( int level, int ix ) const { return levels[level].colors[ix]; }								//!< Returns the intensity of the light with index ix at the given level.
@@ -114,6 +119,33 @@ public:
 		return DoBuild( lightPos, lightIntensities, numLights, autoFitScale, minLevelLights );
 	}
 
+	//! Same as the Build method with a cell size, but splits the work over multiple threads.
+	//! The result matches Build up to the order of floating point sums.
+	bool BuildParallel( const Vec3f *lightPos,			//!< Light positions.
+	                    const Color *lightIntensities, 	//!< Light intensities.
+	                    int          numLights, 		//!< Number of lights.
+	                    int          minLevelLights,	//!< The minimum number of lights permitted for the highest (coarsest) level of the hierarchy.
+	                    float        cellSize,			//!< The size of a grid cell in the lowest (finest) level of the hierarchy.
+	                    int          highestLevel,		//!< The highest level permitted, where level 0 contains the original lights.
+	                    unsigned int numThreads			//!< Number of threads. Uses all hardware threads if zero.
+	                  )
+	{
+		return DoBuild( lightPos, lightIntensities, numLights, 0, minLevelLights, cellSize, highestLevel, ThreadCount(numThreads) );
+	}
+
+	//! Same as the automatically fitted Build method, but splits the work over multiple threads.
+	//! The result matches Build up to the order of floating point sums.
+	bool BuildParallel( const Vec3f *lightPos,				//!< Light positions.
+	                    const Color *lightIntensities, 		//!< Light intensities.
+	                    int          numLights, 			//!< Number of lights.
+	                    int          minLevelLights, 		//!< The minimum number of lights permitted for the highest (coarsest) level of the hierarchy.
+	                    float        autoFitScale = 1.01f,	//!< Extends the bounding box of the light positions using the given scale. This value must be 1 or greater.
+	                    unsigned int numThreads = 0			//!< Number of threads. Uses all hardware threads if zero.
+	                  )
+	{
+		return DoBuild( lightPos, lightIntensities, numLights, autoFitScale, minLevelLights, 0, 10, ThreadCount(numThreads) );
+	}
+
 	//! Computes the illumination at the given position using the given accuracy parameter alpha.
 	template <typename LightingFunction>
 	void Light( const Vec3f      &pos,				//!< The position where the lighting will be evaluated.
@@ -200,6 +232,62 @@ public:
 		}
 	}
 
+	//! Computes the illumination at many positions at once, using multiple threads.
+	//! The positions are visited in Morton order, so that consecutive queries on a thread are spatially close
+	//! and walk mostly the same parts of the point cloud trees.
+	template <typename LightingFunction>
+	void LightBatch( const Vec3f      *positions,			//!< The positions where the lighting will be evaluated.
+	                 int              numPositions,			//!< Number of positions.
+	                 float            alpha,				//!< The accuracy parameter. It should be 1 or greater.
+	                 Color            *irradiance,			//!< Receives the sum of the lighting function's results for each position.
+	                 LightingFunction lightingFunction,		//!< This function is called for each light used at each position. It should be in the form Color LightingFunction(const Vec3f &position, int level, int light_id, const Vec3f &light_position, const Color &light_intensity) and return the light's contribution. It is called from multiple threads.
+	                 unsigned int     numThreads = 0		//!< Number of threads. Uses all hardware threads if zero.
+	               )
+	{
+		if ( numPositions <= 0 ) return;
+
+		// Sort the queries along a Z-order curve over their bounding box
+		Vec3f boundMin = positions[0];
+		Vec3f boundMax = positions[0];
+		for ( int i=1; i<numPositions; i++ ) {
+			for ( int d=0; d<3; d++ ) {
+				if ( boundMin[d] > positions[i][d] ) boundMin[d] = positions[i][d];
+				if ( boundMax[d] < positions[i][d] ) boundMax[d] = positions[i][d];
+			}
+		}
+		Vec3f scale = boundMax - boundMin;
+		for ( int d=0; d<3; d++ ) scale[d] = scale[d] > 0 ? 1023.0f / scale[d] : 0;
+		std::vector< std::pair<uint32_t,int> > order( numPositions );
+		for ( int i=0; i<numPositions; i++ ) {
+			Vec3f q = (positions[i] - boundMin) * scale;
+			order[i] = std::pair<uint32_t,int>( SpreadBits(uint32_t(q.x)) | (SpreadBits(uint32_t(q.y)) << 1) | (SpreadBits(uint32_t(q.z)) << 2), i );
+		}
+		std::sort( order.begin(), order.end() );
+
+		// Threads take small runs of the sorted queries, so uneven query costs still balance out
+		const int runSize = 64;
+		std::atomic<int> nextRun(0);
+		auto lightRuns = [&]() {
+			for ( int start = nextRun.fetch_add(runSize); start < numPositions; start = nextRun.fetch_add(runSize) ) {
+				int end = (std::min)( start + runSize, numPositions );
+				for ( int j=start; j<end; j++ ) {
+					int i = order[j].second;
+					const Vec3f &pos = positions[i];
+					Color sum(0,0,0);
+					Light( pos, alpha, 0, [&]( int level, int light_id, const Vec3f &light_position, const Color &light_intensity ) {
+						sum += lightingFunction( pos, level, light_id, light_position, light_intensity );
+					} );
+					irradiance[i] = sum;
+				}
+			}
+		};
+		numThreads = ThreadCount(numThreads);
+		std::vector<std::thread> threads;
+		for ( unsigned int t=1; t<numThreads; t++ ) threads.push_back( std::thread( lightRuns ) );
+		lightRuns();
+		for ( std::thread &t : threads ) t.join();
+	}
+
 private:
 	struct Level {
 		Level() : colors(nullptr), pDev(nullptr) {}
@@ -231,7 +319,36 @@ private:
 		return p;
 	}
 
-	bool DoBuild( const Vec3f *lightPos, const Color *lightColor, int numLights, float autoFitScale, int minLevelLights, float cellSize=0, int highestLevel=10 )
+	static unsigned int ThreadCount( unsigned int numThreads )
+	{
+		if ( numThreads == 0 ) numThreads = std::thread::hardware_concurrency();
+		return numThreads > 0 ? numThreads : 1;
+	}
+
+	// Calls func(start,end,thread) for consecutive ranges of [0,count) on up to numThreads threads.
+	template <typename RangeFunc>
+	static void ParallelFor( unsigned int numThreads, int count, RangeFunc func )
+	{
+		int chunk = (count + (int)numThreads - 1) / (int)numThreads;
+		if ( numThreads <= 1 || chunk >= count ) { func( 0, count, 0u ); return; }
+		std::vector<std::thread> threads;
+		for ( int t=1; t*chunk<count; t++ ) threads.push_back( std::thread( [&func,t,chunk,count]{ func( t*chunk, (std::min)( (t+1)*chunk, count ), (unsigned int)t ); } ) );
+		func( 0, chunk, 0u );
+		for ( std::thread &t : threads ) t.join();
+	}
+
+	// Spreads the lowest 10 bits of x three bits apart for Morton codes.
+	static uint32_t SpreadBits( uint32_t x )
+	{
+		x &= 0x3FF;
+		x = (x | (x << 16)) & 0x030000FF;
+		x = (x | (x <<  8)) & 0x0300F00F;
+		x = (x | (x <<  4)) & 0x030C30C3;
+		x = (x | (x <<  2)) & 0x09249249;
+		return x;
+	}
+
+	bool DoBuild( const Vec3f *lightPos, const Color *lightColor, int numLights, float autoFitScale, int minLevelLights, float cellSize=0, int highestLevel=10, unsigned int numThreads=1 )
 	{
 		Clear();
 		if ( numLights <= 0 || highestLevel <= 0 ) return false;
@@ -284,6 +401,13 @@ private:
 				color    += w * c;
 				stdev    += w * (p*p);
 			}
+			void Add( const Node &n )
+			{
+				weight   += n.weight;
+				position += n.position;
+				color    += n.color;
+				stdev    += n.stdev;
+			}
 			void Normalize()
 			{ 
 				if ( weight > 0 ) {
@@ -312,6 +436,31 @@ private:
 			}
 		};
 
+		// Splats all lights into the nodes of a level and normalizes them.
+		// Each thread but the first adds its share of the lights to a private copy of the nodes, which are summed at the end.
+		auto addLightsToLevel = [&]( std::vector<Node> &nds, const Vec3f &gridCorner, float nodeCellSize, auto findNodeIDs )
+		{
+			unsigned int levelThreads = numLights < 4096 ? 1 : numThreads;
+			std::vector< std::vector<Node> > copies( levelThreads > 1 ? levelThreads-1 : 0 );
+			ParallelFor( levelThreads, numLights, [&]( int start, int end, unsigned int thread ) {
+				if ( thread > 0 ) copies[thread-1].resize( nds.size() );
+				std::vector<Node> &target = thread > 0 ? copies[thread-1] : nds;
+				for ( int i=start; i<end; i++ ) {
+					IVec3i index;
+					Vec3f interp = gridIndex( index, Vec3f(lightPos[i])-gridCorner, nodeCellSize );
+					int nodeIDs[8];
+					findNodeIDs( index, nodeIDs );
+					addLightToNodes( target, nodeIDs, interp, lightPos[i], lightColor[i] );
+				}
+			} );
+			ParallelFor( levelThreads, (int)nds.size(), [&]( int start, int end, unsigned int ) {
+				for ( int i=start; i<end; i++ ) {
+					for ( const std::vector<Node> &c : copies ) if ( !c.empty() ) nds[i].Add( c[i] );
+					nds[i].Normalize();
+				}
+			} );
+		};
+
 		// Generate the grid for the highest level
 		Vec3f highestGridSize = Vec3f(highestGridRes-1) * highestCellSize;
 		Vec3f center = (boundMax + boundMin) / 2;
@@ -326,24 +475,18 @@ private:
 			}
 		}
 #endif // CY_LIGHTING_GRID_ORIG_POS
-		for ( int i=0; i<numLights; i++ ) {
-			IVec3i index;
-			Vec3f interp = gridIndex( index, Vec3f(lightPos[i])-corner, highestCellSize );
+		addLightsToLevel( nodes[highestLevel], corner, highestCellSize, [&]( IVec3i &index, int nodeIDs[8] ) {
 			int is = index.z*highestGridRes.y*highestGridRes.x + index.y*highestGridRes.x + index.x;
-			int nodeIDs[8] = {
-				is,
-				is + 1,
-				is + highestGridRes.x,
-				is + highestGridRes.x + 1,
-				is + highestGridRes.x*highestGridRes.y,
-				is + highestGridRes.x*highestGridRes.y + 1,
-				is + highestGridRes.x*highestGridRes.y + highestGridRes.x,
-				is + highestGridRes.x*highestGridRes.y + highestGridRes.x + 1,
-			};
+			nodeIDs[0] = is;
+			nodeIDs[1] = is + 1;
+			nodeIDs[2] = is + highestGridRes.x;
+			nodeIDs[3] = is + highestGridRes.x + 1;
+			nodeIDs[4] = is + highestGridRes.x*highestGridRes.y;
+			nodeIDs[5] = is + highestGridRes.x*highestGridRes.y + 1;
+			nodeIDs[6] = is + highestGridRes.x*highestGridRes.y + highestGridRes.x;
+			nodeIDs[7] = is + highestGridRes.x*highestGridRes.y + highestGridRes.x + 1;
 			for ( int j=0; j<8; j++ ) assert( nodeIDs[j] >= 0 && nodeIDs[j] < (int)nodes[highestLevel].size() );
-			addLightToNodes( nodes[highestLevel], nodeIDs, interp, lightPos[i], lightColor[i] );
-		}
-		for ( int i=0; i<(int)nodes[highestLevel].size(); i++ ) nodes[highestLevel][i].Normalize();
+		} );
 
 		// Generate the lower levels
 		float nodeCellSize = highestCellSize;
@@ -381,11 +524,8 @@ private:
 				}
 			}
 #endif // CY_LIGHTING_GRID_ORIG_POS
-			for ( int i=0; i<numLights; i++ ) {
-				IVec3i index;
-				Vec3f interp = gridIndex( index, Vec3f(lightPos[i])-corner, nodeCellSize );
+			addLightsToLevel( nodes[level], corner, nodeCellSize, [&]( IVec3i &index, int nodeIDs[8] ) {
 				// find the node IDs
-				int nodeIDs[8];
 				index <<= level+2;
 				for ( int z=0, j=0; z<2; z++ ) {
 					int iz = index.z + z;
@@ -407,9 +547,7 @@ private:
 						}
 					}
 				}
-				addLightToNodes( nodes[level], nodeIDs, interp, lightPos[i], lightColor[i] );
-			}
-			for ( int i=0; i<(int)nodes[level].size(); i++ ) nodes[level][i].Normalize();
+			} );
 		}
 
 		// Copy light data
@@ -431,39 +569,45 @@ private:
 		}
 
 		levels = new Level[ numLevels ];
-		for ( int level=1; level<numLevels; level++ ) {
-			std::vector<Node> &levelNodes = nodes[level+levelSkip];
-			Level &thisLevel = levels[level];
-			std::vector<Vec3f> pos( levelNodes.size() );
-			int lightCount = 0;
-			for ( int i=0; i<(int)levelNodes.size(); i++ ) {
-				if ( levelNodes[i].weight > 0 ) {
-					pos[lightCount++] = levelNodes[i].position;
+		// The levels' k-d trees are independent, so they are built concurrently
+		ParallelFor( (std::min)( numThreads, (unsigned int)numLevels ), numLevels, [&]( int start, int end, unsigned int ) {
+			for ( int level=start; level<end; level++ ) {
+				if ( level == 0 ) {
+					std::vector<Vec3f> pos( numLights );
+					levels[0].colors = new Color[ numLights ];
+					for ( int i=0; i<numLights; i++ ) {
+						pos[i] = lightPos[i];
+						levels[0].colors[i] = lightColor[i];
+					}
+					levels[0].pc.Build( numLights, pos.data() );
+					continue;
 				}
-			}
-			thisLevel.pc.Build( lightCount, pos.data() );
-			thisLevel.colors = new Color[ lightCount ];
-			thisLevel.pDev = new Vec3f[ lightCount ];
-			for ( int i=0, j=0; i<(int)levelNodes.size(); i++ ) {
-				if ( levelNodes[i].weight > 0 ) {
-					assert( j < lightCount );
-					thisLevel.colors[j] = levelNodes[i].color;
-					thisLevel.pDev[j].x = sqrtf( levelNodes[i].stdev.x ) * Pi<float>();
-					thisLevel.pDev[j].y = sqrtf( levelNodes[i].stdev.y ) * Pi<float>();
-					thisLevel.pDev[j].z = sqrtf( levelNodes[i].stdev.z ) * Pi<float>();
-					j++;
+				std::vector<Node> &levelNodes = nodes[level+levelSkip];
+				Level &thisLevel = levels[level];
+				std::vector<Vec3f> pos( levelNodes.size() );
+				int lightCount = 0;
+				for ( int i=0; i<(int)levelNodes.size(); i++ ) {
+					if ( levelNodes[i].weight > 0 ) {
+						pos[lightCount++] = levelNodes[i].position;
+					}
+				}
+				thisLevel.pc.Build( lightCount, pos.data() );
+				thisLevel.colors = new Color[ lightCount ];
+				thisLevel.pDev = new Vec3f[ lightCount ];
+				for ( int i=0, j=0; i<(int)levelNodes.size(); i++ ) {
+					if ( levelNodes[i].weight > 0 ) {
+						assert( j < lightCount );
+						thisLevel.colors[j] = levelNodes[i].color;
+						thisLevel.pDev[j].x = sqrtf( levelNodes[i].stdev.x ) * Pi<float>();
+						thisLevel.pDev[j].y = sqrtf( levelNodes[i].stdev.y ) * Pi<float>();
+						thisLevel.pDev[j].z = sqrtf( levelNodes[i].stdev.z ) * Pi<float>();
+						j++;
+					}
 				}
+				levelNodes.resize(0);
+				levelNodes.shrink_to_fit();
 			}
-			levelNodes.resize(0);
-			levelNodes.shrink_to_fit();
-		}
-		std::vector<Vec3f> pos( numLights );
-		levels[0].colors = new Color[ numLights ];
-		for ( int i=0; i<numLights; i++ ) {
-			pos[i] = lightPos[i];
-			levels[0].colors[i] = lightColor[i];
-		}
-		levels[0].pc.Build( numLights, pos.data() );
+		} );
 		this->cellSize = nodeCellSize;
 
 		return true;
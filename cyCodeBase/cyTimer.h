@@ -153,6 +153,12 @@ public:
 	//! Returns the time passed since Start call in seconds.
 	double Stop() {
 		double t = timer.Stop();
+		Record( t );
+		return t;
+	}
+
+	//! Records a time measured by other means, such as TimerCPU or a GPU timer query.
+	void Record( double t ) {
 		unsigned char p = pos & 0x7F;
 		totalTime += t - times[ p ];
 		times[ p ] = t;
@@ -161,7 +167,6 @@ public:
 		// Increment pos such that the first bit shows if times array is full.
 		p++;
 		pos = ( p & 0x7F ) + ( ( pos | p ) & 0x80 );
-		return t;
 	}
 
 
@@ -38,6 +38,7 @@
 
 #include "cyVector.h"
 #include <vector>
+#include <string>
 #include <iostream>
 
 //-------------------------------------------------------------------------------
@@ -182,6 +183,7 @@ public:
 
 	//!@name Load and Save methods
 	bool LoadFromFileObj( char const *filename, bool loadMtl=true, std::ostream *outStream=&std::cout );	//!< Loads the mesh from an OBJ file. Automatically converts all faces to triangles.
+	bool LoadFromFileObjParallel( char const *filename, bool loadMtl=true, std::ostream *outStream=&std::cout, unsigned int numThreads=0 );	//!< Same result as LoadFromFileObj, but memory maps the file and parses newline-aligned chunks of it on multiple threads. Uses all hardware threads if numThreads is zero. Defined in ObjParallelLoader.cpp.
 	bool SaveToFileObj( char const *filename, std::ostream *outStream );									//!< Saves the mesh to an OBJ file with the given name.
 
 private:
@@ -200,6 +202,205 @@ private:
 		MtlData() { faceCount=0; firstFace=0; }
 	};
 	struct MtlLibName { std::string filename; };
+	struct MtlList {
+		std::vector<MtlData> mtlData;
+		int GetMtlIndex( char const *mtlName )
+		{
+			for ( unsigned int i=0; i<mtlData.size(); i++ ) {
+				if ( mtlData[i].mtlName == mtlName ) return (int)i;
+			}
+			return -1;
+		}
+		int CreateMtl( char const *mtlName, unsigned int firstFace )
+		{
+			if ( mtlName[0] == '\0' ) return 0;
+			int i = GetMtlIndex(mtlName);
+			if ( i >= 0 ) return i;
+			MtlData m;
+			m.mtlName = mtlName;
+			m.firstFace = firstFace;
+			mtlData.push_back(m);
+			return (int)mtlData.size()-1;
+		}
+	};
+	class Buffer
+	{
+		char data[1024];
+		int readLine;
+	public:
+		int ReadLine(FILE *fp)
+		{
+			char c = fgetc(fp);
+			while ( !feof(fp) ) {
+				while ( isspace(c) && ( !feof(fp) || c!='\0' ) ) c = fgetc(fp);	// skip empty space
+				if ( c == '#' ) while ( !feof(fp) && c!='\n' && c!='\r' && c!='\0' ) c = fgetc(fp);	// skip comment line
+				else break;
+			}
+			int i=0;
+			bool inspace = false;
+			while ( i<1024-1 ) {
+				if ( feof(fp) || c=='\n' || c=='\r' || c=='\0' ) break;
+				if ( isspace(c) ) {	// only use a single space as the space character
+					inspace = true;
+				} else {
+					if ( inspace ) data[i++] = ' ';
+					inspace = false;
+					data[i++] = c;
+				}
+				c = fgetc(fp);
+			}
+			data[i] = '\0';
+			readLine = i;
+			return i;
+		}
+		// Reads the next line from memory, following the same rules as ReadLine(FILE*).
+		int ReadLine( char const * &p, char const *end )
+		{
+			while ( p < end ) {
+				while ( p < end && isspace((unsigned char)*p) ) p++;	// skip empty space
+				if ( p < end && *p == '#' ) while ( p < end && *p!='\n' && *p!='\r' && *p!='\0' ) p++;	// skip comment line
+				else break;
+			}
+			int i=0;
+			bool inspace = false;
+			while ( i<1024-1 ) {
+				if ( p >= end || *p=='\n' || *p=='\r' || *p=='\0' ) break;
+				if ( isspace((unsigned char)*p) ) {	// only use a single space as the space character
+					inspace = true;
+				} else {
+					if ( inspace ) data[i++] = ' ';
+					inspace = false;
+					data[i++] = *p;
+				}
+				p++;
+			}
+			if ( p < end ) p++;	// the terminating character is consumed, like the last fgetc of ReadLine(FILE*)
+			data[i] = '\0';
+			readLine = i;
+			return i;
+		}
+		// Locale-independent version of ReadVertex. Falls back to ReadVertex for anything ParseFloat cannot convert exactly.
+		void ReadVertexFast( Vec3f &v ) const
+		{
+			v.Zero();
+			if ( data[0]=='\0' || data[1]=='\0' ) return;
+			float *f = &v.x;
+			char const *s = data+2;
+			for ( int i=0; i<3; i++ ) {
+				while ( *s == ' ' ) s++;
+				if ( *s == '\0' ) return;
+				if ( !ParseFloat(s,f[i]) || ( *s!=' ' && *s!='\0' ) ) { ReadVertex(v); return; }
+			}
+		}
+		// Parses a decimal floating point number and advances s past it.
+		// Returns false without a result when the number cannot be converted with correct rounding using exact float or double arithmetic.
+		static bool ParseFloat( char const * &s, float &f )
+		{
+			static const float  pow10f[] = { 1e0f, 1e1f, 1e2f, 1e3f, 1e4f, 1e5f, 1e6f, 1e7f, 1e8f, 1e9f, 1e10f };
+			static const double pow10d[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+			char const *p = s;
+			bool negative = false;
+			if ( *p=='-' || *p=='+' ) negative = ( *p++ == '-' );
+			unsigned long long mantissa = 0;
+			int digits = 0, exponent = 0;
+			bool anyDigit = false;
+			for ( ; *p>='0' && *p<='9'; p++ ) {
+				anyDigit = true;
+				if ( mantissa == 0 && *p == '0' ) continue;
+				if ( ++digits > 19 ) return false;
+				mantissa = mantissa*10 + (*p-'0');
+			}
+			if ( *p == '.' ) {
+				for ( p++; *p>='0' && *p<='9'; p++ ) {
+					anyDigit = true;
+					exponent--;
+					if ( mantissa == 0 && *p == '0' ) continue;
+					if ( ++digits > 19 ) return false;
+					mantissa = mantissa*10 + (*p-'0');
+				}
+			}
+			if ( !anyDigit ) return false;
+			if ( *p=='e' || *p=='E' ) {
+				p++;
+				bool negativeExp = false;
+				if ( *p=='-' || *p=='+' ) negativeExp = ( *p++ == '-' );
+				if ( *p<'0' || *p>'9' ) return false;
+				int e = 0;
+				for ( ; *p>='0' && *p<='9'; p++ ) if ( e < 10000 ) e = e*10 + (*p-'0');
+				exponent += negativeExp ? -e : e;
+			}
+			if ( mantissa == 0 ) {
+				f = negative ? -0.0f : 0.0f;
+			} else if ( mantissa <= (1ull<<24) && exponent >= -10 && exponent <= 10 ) {
+				// both operands are exact floats, so a single operation rounds correctly
+				float m = (float)mantissa;
+				f = exponent < 0 ? m / pow10f[-exponent] : m * pow10f[exponent];
+				if ( negative ) f = -f;
+			} else if ( mantissa <= (1ull<<53) && exponent >= -22 && exponent <= 22 ) {
+				double m = (double)mantissa;
+				double d = exponent < 0 ? m / pow10d[-exponent] : m * pow10d[exponent];
+				// Rounding the double to float gives the correctly rounded float unless d landed exactly half way between two floats.
+				float lo = (float)d;
+				if ( (double)lo != d ) {
+					float hi = std::nextafter( lo, (double)lo < d ? std::numeric_limits<float>::infinity() : -std::numeric_limits<float>::infinity() );
+					if ( ((double)lo + (double)hi) * 0.5 == d ) return false;
+				}
+				f = negative ? -lo : lo;
+			} else return false;
+			s = p;
+			return true;
+		}
+		char& operator[](int i) { return data[i]; }
+		void ReadVertex( Vec3f &v ) const { v.Zero(); sscanf( data+2, "%f %f %f", &v.x, &v.y, &v.z ); }
+		void ReadFloat3( float f[3] ) const { f[2]=f[1]=f[0]=0; int n = sscanf( data+2, "%f %f %f", &f[0], &f[1], &f[2] ); if ( n==1 ) f[2]=f[1]=f[0]; }
+		void ReadFloat( float *f ) const { sscanf( data+2, "%f", f ); }
+		void ReadInt( int *i, int start ) const { sscanf( data+start, "%d", i ); }
+		bool IsCommand( char const *cmd ) const {
+			int i=0;
+			while ( cmd[i]!='\0' ) {
+				if ( cmd[i] != data[i] ) return false;
+				i++;
+			}
+			return (data[i]=='\0' || data[i]==' ');
+		}
+		char const * Data(int start=0) { return data+start; }
+		void Copy( Str &str, int start=0 )
+		{
+			while ( data[start] != '\0' && data[start] <= ' ' ) start++;
+			str = Data(start);
+		}
+	};
+
+	//! Raw arrays collected while parsing an OBJ file, before they are copied into the mesh.
+	struct ObjData
+	{
+		std::vector<Vec3f>      v;		// vertices
+		std::vector<TriFace>    f;		// faces
+		std::vector<Vec3f>      vn;		// vertex normal
+		std::vector<TriFace>    fn;		// normal faces
+		std::vector<Vec3f>      vt;		// texture vertices
+		std::vector<TriFace>    ft;		// texture faces
+		std::vector<MtlLibName> mtlFiles;
+		std::vector<int>        faceMtlIndex;
+	};
+	bool SetFromObjData( char const *filename, bool loadMtl, std::ostream *outStream, ObjData const &data, MtlList &mtlList );
+
+	//! Part of an OBJ file parsed by a single thread of LoadFromFileObjParallel.
+	//! Indices are chunk-local until the chunks are stitched together.
+	struct ObjChunk
+	{
+		char const *begin, *end;
+		std::vector<Vec3f>   v, vn, vt;
+		std::vector<TriFace> f, fn, ft;		// fn and ft have an entry for every face
+		unsigned int firstTextureFace, firstNormalFace;	// first face stored after the texture/normal flags of the serial loader would have been set
+		std::vector<int>          faceUseMtl;		// usemtl entry in effect for each face, -1 if it is inherited from the previous chunk
+		std::vector<std::string>  useMtlNames;
+		std::vector<unsigned int> useMtlFirstFace;
+		std::vector<MtlLibName>   mtlFiles;
+		std::vector<unsigned int>   relativeFaces;	// faces that use negative (relative) indices
+		std::vector<unsigned short> relativeMasks;	// bits 0-2: f, 3-5: ft, 6-8: fn corners that must be offset by the preceding chunks' counts
+	};
+	static void ParseObjChunk( ObjChunk &chunk, bool loadMtl );
 };
 
 //-------------------------------------------------------------------------------
@@ -271,90 +472,18 @@ inline bool TriMesh::LoadFromFileObj( char const *filename, bool loadMtl, std::o
 
 	Clear();
 
-	class Buffer
-	{
-		char data[1024];
-		int readLine;
-	public:
-		int ReadLine(FILE *fp)
-		{
-			char c = fgetc(fp);
-			while ( !feof(fp) ) {
-				while ( isspace(c) && ( !feof(fp) || c!='\0' ) ) c = fgetc(fp);	// skip empty space
-				if ( c == '#' ) while ( !feof(fp) && c!='\n' && c!='\r' && c!='\0' ) c = fgetc(fp);	// skip comment line
-				else break;
-			}
-			int i=0;
-			bool inspace = false;
-			while ( i<1024-1 ) {
-				if ( feof(fp) || c=='\n' || c=='\r' || c=='\0' ) break;
-				if ( isspace(c) ) {	// only use a single space as the space character
-					inspace = true;
-				} else {
-					if ( inspace ) data[i++] = ' ';
-					inspace = false;
-					data[i++] = c;
-				}
-				c = fgetc(fp);
-			}
-			data[i] = '\0';
-			readLine = i;
-			return i;
-		}
-		char& operator[](int i) { return data[i]; }
-		void ReadVertex( Vec3f &v ) const { v.Zero(); sscanf( data+2, "%f %f %f", &v.x, &v.y, &v.z ); }
-		void ReadFloat3( float f[3] ) const { f[2]=f[1]=f[0]=0; int n = sscanf( data+2, "%f %f %f", &f[0], &f[1], &f[2] ); if ( n==1 ) f[2]=f[1]=f[0]; }
-		void ReadFloat( float *f ) const { sscanf( data+2, "%f", f ); }
-		void ReadInt( int *i, int start ) const { sscanf( data+start, "%d", i ); }
-		bool IsCommand( char const *cmd ) const {
-			int i=0;
-			while ( cmd[i]!='\0' ) {
-				if ( cmd[i] != data[i] ) return false;
-				i++;
-			}
-			return (data[i]=='\0' || data[i]==' ');
-		}
-		char const * Data(int start=0) { return data+start; }
-		void Copy( Str &str, int start=0 )
-		{
-			while ( data[start] != '\0' && data[start] <= ' ' ) start++;
-			str = Data(start);
-		}
-	};
 	Buffer buffer;
-
-
-	struct MtlList {
-		std::vector<MtlData> mtlData;
-		int GetMtlIndex( char const *mtlName )
-		{
-			for ( unsigned int i=0; i<mtlData.size(); i++ ) {
-				if ( mtlData[i].mtlName == mtlName ) return (int)i;
-			}
-			return -1;
-		}
-		int CreateMtl( char const *mtlName, unsigned int firstFace )
-		{
-			if ( mtlName[0] == '\0' ) return 0;
-			int i = GetMtlIndex(mtlName);
-			if ( i >= 0 ) return i;
-			MtlData m;
-			m.mtlName = mtlName;
-			m.firstFace = firstFace;
-			mtlData.push_back(m);
-			return (int)mtlData.size()-1;
-		}
-	};
 	MtlList mtlList;
 
-	std::vector<Vec3f>      _v;		// vertices
-	std::vector<TriFace>    _f;		// faces
-	std::vector<Vec3f>      _vn;	// vertex normal
-	std::vector<TriFace>    _fn;	// normal faces
-	std::vector<Vec3f>      _vt;	// texture vertices
-	std::vector<TriFace>    _ft;	// texture faces
-	std::vector<MtlLibName> mtlFiles;
-	std::vector<int>        faceMtlIndex;
+	ObjData data;
+	std::vector<Vec3f>      &_v = data.v;		// vertices
+	std::vector<TriFace>    &_f = data.f;		// faces
+	std::vector<Vec3f>      &_vn = data.vn;	// vertex normal
+	std::vector<TriFace>    &_fn = data.fn;	// normal faces
+	std::vector<Vec3f>      &_vt = data.vt;	// texture vertices
+	std::vector<TriFace>    &_ft = data.ft;	// texture faces
+	std::vector<MtlLibName> &mtlFiles = data.mtlFiles;
+	std::vector<int>        &faceMtlIndex = data.faceMtlIndex;
 
 	int currentMtlIndex = -1;
 	bool hasTextures=false, hasNormals=false;
@@ -450,8 +579,25 @@ inline bool TriMesh::LoadFromFileObj( char const *filename, bool loadMtl, std::o
 		if ( feof(fp) ) break;
 	}
 
+
 	fclose(fp);
 
+	return SetFromObjData( filename, loadMtl, outStream, data, mtlList );
+}
+
+//-------------------------------------------------------------------------------
+
+inline bool TriMesh::SetFromObjData( char const *filename, bool loadMtl, std::ostream *outStream, ObjData const &data, MtlList &mtlList )
+{
+	std::vector<Vec3f>   const &_v  = data.v;
+	std::vector<TriFace> const &_f  = data.f;
+	std::vector<Vec3f>   const &_vn = data.vn;
+	std::vector<TriFace> const &_fn = data.fn;
+	std::vector<Vec3f>   const &_vt = data.vt;
+	std::vector<TriFace> const &_ft = data.ft;
+	std::vector<MtlLibName> const &mtlFiles = data.mtlFiles;
+	std::vector<int>        const &faceMtlIndex = data.faceMtlIndex;
+	Buffer buffer;
 
 	if ( _f.size() == 0 ) return true; // No faces found
 	SetNumVertex((unsigned int)_v.size());